@@ -0,0 +1,103 @@
+#include "vtkDICOMWriter.h"
+#include "vtkDICOMReader.h"
+#include "vtkDICOMMetaData.h"
+#include "vtkDICOMDictionary.h"
+
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkVersion.h>
+
+#include <string.h>
+#include <stdio.h>
+
+// macro for performing tests
+#define TestAssert(t) \
+if (!(t)) \
+{ \
+  cout << exename << ": Assertion Failed: " << #t << "\n"; \
+  cout << __FILE__ << ":" << __LINE__ << "\n"; \
+  cout.flush(); \
+  rval |= 1; \
+}
+
+int main(int argc, char *argv[])
+{
+  int rval = 0;
+  const char *exename = (argc > 0 ? argv[0] : "TestDICOMDeflate");
+
+  // remove path portion of exename
+  const char *cp = exename + strlen(exename);
+  while (cp != exename && cp[-1] != '\\' && cp[-1] != '/') { --cp; }
+  exename = cp;
+
+  const char *filename = "TestDICOMDeflate.dcm";
+  const char *deflated = "1.2.840.10008.1.2.1.99";
+
+  // create an image with a pattern that is not trivially compressible
+  vtkImageData *image = vtkImageData::New();
+  image->SetExtent(0, 127, 0, 95, 0, 0);
+#if VTK_MAJOR_VERSION >= 6
+  image->AllocateScalars(VTK_SHORT, 1);
+#else
+  image->SetScalarTypeToShort();
+  image->SetNumberOfScalarComponents(1);
+  image->AllocateScalars();
+#endif
+  short *sp = static_cast<short *>(image->GetScalarPointer());
+  unsigned int seed = 1;
+  for (int j = 0; j < 96; j++)
+    {
+    for (int i = 0; i < 128; i++)
+      {
+      seed = seed*1103515245u + 12345u;
+      *sp++ = static_cast<short>(i*j - 2000 + ((seed >> 16) & 0x3F));
+      }
+    }
+
+  // write the image with the deflated transfer syntax
+  vtkDICOMWriter *writer = vtkDICOMWriter::New();
+#if VTK_MAJOR_VERSION >= 6
+  writer->SetInputData(image);
+#else
+  writer->SetInput(image);
+#endif
+  writer->SetFileName(filename);
+  writer->SetTransferSyntaxUID(deflated);
+  writer->Write();
+  TestAssert(writer->GetErrorCode() == 0);
+  writer->Delete();
+
+  // read the image back, the pixel data must be inflated
+  vtkDICOMReader *reader = vtkDICOMReader::New();
+  reader->SetFileName(filename);
+  reader->Update();
+  TestAssert(reader->GetErrorCode() == 0);
+  TestAssert(reader->GetMetaData()->GetAttributeValue(
+    DC::TransferSyntaxUID).AsString() == deflated);
+
+  vtkImageData *output = reader->GetOutput();
+  int extent[6];
+  output->GetExtent(extent);
+  TestAssert(extent[1] == 127 && extent[3] == 95 && extent[5] == 0);
+
+  vtkDataArray *a = image->GetPointData()->GetScalars();
+  vtkDataArray *b = output->GetPointData()->GetScalars();
+  TestAssert(b != 0 && b->GetNumberOfTuples() == a->GetNumberOfTuples());
+  if (b != 0 && b->GetNumberOfTuples() == a->GetNumberOfTuples())
+    {
+    vtkIdType n = a->GetNumberOfTuples();
+    vtkIdType mismatches = 0;
+    for (vtkIdType k = 0; k < n; k++)
+      {
+      mismatches += (a->GetComponent(k, 0) != b->GetComponent(k, 0));
+      }
+    TestAssert(mismatches == 0);
+    }
+
+  reader->Delete();
+  image->Delete();
+  remove(filename);
+
+  return rval;
+}
@@ -204,5 +204,26 @@ int main(int argc, char *argv[])
   TestAssert(val3.GetVL() == 0xffffffffu);
   TestAssert(val3.GetNumberOfValues() == 0);
 
+  // test modifying an item that shares its data with another item
+  vtkDICOMItem item4;
+  item4.SetAttributeValue(DC::PatientName, "DOE^JOHN");
+  item4.SetAttributeValue(DC::PatientID, "12345");
+  vtkDICOMItem item5 = item4;
+  item5.SetAttributeValue(DC::PatientSex, "M");
+  item5.SetAttributeValue(DC::PatientAge, "043Y");
+  TestAssert(item4.GetNumberOfDataElements() == 2);
+  TestAssert(item5.GetNumberOfDataElements() == 4);
+  TestAssert(item5.GetAttributeValue(DC::PatientName).AsString() ==
+             "DOE^JOHN");
+  TestAssert(item5.GetAttributeValue(DC::PatientAge).AsString() == "043Y");
+  int count = 0;
+  vtkDICOMDataElementIterator iter5 = item5.Begin();
+  while (iter5 != item5.End() && count < 10)
+    {
+    ++iter5;
+    ++count;
+    }
+  TestAssert(count == 4);
+
   return rval;
 }
@@ -288,5 +288,60 @@ int main(int argc, char *argv[])
   TestAssert(v.AsInt() == 0);
   }
 
+  { // test Matches
+  vtkDICOMValue v;
+  // universal matching
+  v = vtkDICOMValue(vtkDICOMVR::CS, "CT");
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::CS, "")));
+  TestAssert(v.Matches(vtkDICOMValue()));
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::CS, "CT")));
+  TestAssert(!v.Matches(vtkDICOMValue(vtkDICOMVR::CS, "MR")));
+  TestAssert(!vtkDICOMValue().Matches(vtkDICOMValue(vtkDICOMVR::CS, "CT")));
+  // wildcards
+  v = vtkDICOMValue(vtkDICOMVR::LO, "HEAD^ROUTINE");
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::LO, "HEAD*")));
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::LO, "*ROUT*")));
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::LO, "HEAD?ROUTINE")));
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::LO, "*")));
+  TestAssert(!v.Matches(vtkDICOMValue(vtkDICOMVR::LO, "*NECK*")));
+  TestAssert(!v.Matches(vtkDICOMValue(vtkDICOMVR::LO, "head*")));
+  v = vtkDICOMValue(vtkDICOMVR::PN, "Doe^John");
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::PN, "DOE^*")));
+  // multiple values
+  v = vtkDICOMValue(vtkDICOMVR::CS, "ORIGINAL\\PRIMARY\\AXIAL");
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::CS, "AXIAL")));
+  TestAssert(!v.Matches(vtkDICOMValue(vtkDICOMVR::CS, "LOCALIZER")));
+  // date and time ranges
+  v = vtkDICOMValue(vtkDICOMVR::DA, "20140612");
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::DA, "20140101-20141231")));
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::DA, "20140612-")));
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::DA, "-20140612")));
+  TestAssert(!v.Matches(vtkDICOMValue(vtkDICOMVR::DA, "20150101-")));
+  TestAssert(!v.Matches(vtkDICOMValue(vtkDICOMVR::DA, "-20131231")));
+  v = vtkDICOMValue(vtkDICOMVR::TM, "120030.5");
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::TM, "0800-1200")));
+  TestAssert(!v.Matches(vtkDICOMValue(vtkDICOMVR::TM, "1201-")));
+  // a negative UTC offset in DT is not a range separator
+  v = vtkDICOMValue(vtkDICOMVR::DT, "20200101120000-0500");
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::DT, "20200101120000-0500")));
+  TestAssert(!v.Matches(vtkDICOMValue(vtkDICOMVR::DT, "20200101120000-0600")));
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::DT,
+    "20200101000000-0500-20200102000000-0500")));
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::DT, "2019-2020")));
+  TestAssert(!v.Matches(vtkDICOMValue(vtkDICOMVR::DT, "2021-")));
+  // UID lists
+  v = vtkDICOMValue(vtkDICOMVR::UI, "1.2.840.10008.5.1.4.1.1.2");
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::UI,
+    "1.2.840.10008.5.1.4.1.1.4\\1.2.840.10008.5.1.4.1.1.2")));
+  TestAssert(!v.Matches(vtkDICOMValue(vtkDICOMVR::UI,
+    "1.2.840.10008.5.1.4.1.1.4\\1.2.840.10008.5.1.4.1.1.20")));
+  // numerical values
+  v = vtkDICOMValue(vtkDICOMVR::US, "512");
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::US, "512")));
+  TestAssert(!v.Matches(vtkDICOMValue(vtkDICOMVR::US, "256")));
+  v = vtkDICOMValue(vtkDICOMVR::IS, "3\\2\\1");
+  TestAssert(v.Matches(vtkDICOMValue(vtkDICOMVR::IS, "2")));
+  }
+
   return rval;
 }
@@ -130,6 +130,138 @@ bool vtkDICOMCTGenerator::GenerateCTImageModule(vtkDICOMMetaData *meta)
           this->CopyOptionalAttributes(optional, meta));
 }
 
+//----------------------------------------------------------------------------
+bool vtkDICOMCTGenerator::GenerateEnhancedCTImageModule(
+  vtkDICOMMetaData *meta)
+{
+  // ImageType has four values for enhanced images, the third is
+  // specific to CT (AXIAL, LOCALIZER, etc.) and the fourth gives
+  // the derivation (NONE if not derived in a special way)
+  std::string it;
+  if (this->MetaData)
+    {
+    it = this->MetaData->GetAttributeValue(DC::ImageType).AsString();
+    }
+  if (it == "")
+    {
+    it = "DERIVED\\SECONDARY\\AXIAL";
+    }
+  int nvalues = 1;
+  for (size_t i = 0; i < it.length(); i++)
+    {
+    nvalues += (it[i] == '\\');
+    }
+  if (nvalues == 3)
+    {
+    it += "\\NONE";
+    }
+  meta->SetAttributeValue(DC::ImageType, it);
+
+  // These are mandatory, and are repeated in the frame type
+  meta->SetAttributeValue(DC::PixelPresentation, "MONOCHROME");
+  meta->SetAttributeValue(DC::VolumetricProperties, "VOLUME");
+  meta->SetAttributeValue(DC::VolumeBasedCalculationTechnique, "NONE");
+
+  vtkDICOMItem frameType;
+  frameType.SetAttributeValue(DC::FrameType, it);
+  frameType.SetAttributeValue(DC::PixelPresentation, "MONOCHROME");
+  frameType.SetAttributeValue(DC::VolumetricProperties, "VOLUME");
+  frameType.SetAttributeValue(DC::VolumeBasedCalculationTechnique, "NONE");
+  vtkDICOMSequence frameTypeSeq(1);
+  frameTypeSeq.SetItem(0, frameType);
+  meta->SetAttributeValue(
+    vtkDICOMTagPath(DC::SharedFunctionalGroupsSequence, 0,
+                    DC::CTImageFrameTypeSequence),
+    frameTypeSeq);
+
+  // The Pixel Value Transformation is mandatory for Enhanced CT
+  vtkDICOMItem pixelValueTransformation;
+  pixelValueTransformation.SetAttributeValue(
+    DC::RescaleIntercept, this->RescaleIntercept);
+  pixelValueTransformation.SetAttributeValue(
+    DC::RescaleSlope, this->RescaleSlope);
+  pixelValueTransformation.SetAttributeValue(DC::RescaleType, "HU");
+  vtkDICOMSequence pixelValueTransformationSeq(1);
+  pixelValueTransformationSeq.SetItem(0, pixelValueTransformation);
+  meta->SetAttributeValue(
+    vtkDICOMTagPath(DC::SharedFunctionalGroupsSequence, 0,
+                    DC::PixelValueTransformationSequence),
+    pixelValueTransformationSeq);
+
+  // ContentQualification is mandatory
+  std::string cq;
+  if (this->MetaData)
+    {
+    cq = this->MetaData->GetAttributeValue(
+      DC::ContentQualification).AsString();
+    }
+  if (cq == "")
+    {
+    cq = "PRODUCT";
+    }
+  meta->SetAttributeValue(DC::ContentQualification, cq);
+
+  // optional and conditional: direct copy of values with no checks
+  static const DC::EnumType optional[] = {
+    DC::AcquisitionNumber,
+    DC::AcquisitionDateTime, // 1C, required if ORIGINAL
+    DC::AcquisitionDuration, // 2C, required if ORIGINAL
+    DC::ReferencedImageSequence,
+    DC::DerivationDescription,
+    DC::DerivationCodeSequence,
+    DC::SourceImageSequence,
+    DC::ImageComments,
+    DC::BurnedInAnnotation,
+    DC::RecognizableVisualFeatures,
+    DC::LossyImageCompression,
+    DC::LossyImageCompressionRatio,
+    DC::LossyImageCompressionMethod,
+    DC::PresentationLUTShape,
+    DC::IrradiationEventUID,
+    DC::ItemDelimitationItem
+  };
+
+  return this->CopyOptionalAttributes(optional, meta);
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMCTGenerator::GenerateEnhancedCTInstance(
+  vtkInformation *info, vtkDICOMMetaData *meta)
+{
+  this->SetPixelRestrictions(
+    RepresentationSigned | RepresentationUnsigned,
+    BitsStored12 | BitsStored16,
+    1);
+
+  const char *SOPClass = "1.2.840.10008.5.1.4.1.1.2.1";
+  this->InitializeMetaData(info, meta);
+
+  if (!this->GenerateSOPCommonModule(meta, SOPClass) ||
+      !this->GeneratePatientModule(meta) ||
+      !this->GenerateClinicalTrialSubjectModule(meta) ||
+      !this->GenerateGeneralStudyModule(meta) ||
+      !this->GeneratePatientStudyModule(meta) ||
+      !this->GenerateClinicalTrialStudyModule(meta) ||
+      !this->GenerateGeneralSeriesModule(meta) ||
+      !this->GenerateClinicalTrialSeriesModule(meta) ||
+      !this->GenerateCTSeriesModule(meta) ||
+      !this->GenerateFrameOfReferenceModule(meta) ||
+      !this->GenerateGeneralEquipmentModule(meta) ||
+      !this->GenerateEnhancedGeneralEquipmentModule(meta) ||
+      !this->GenerateImagePixelModule(meta) ||
+      !this->GenerateMultiFrameFunctionalGroupsModule(meta) ||
+      !this->GenerateMultiFrameDimensionModule(meta) ||
+      !this->GenerateAcquisitionContextModule(meta) ||
+      !this->GenerateDeviceModule(meta) ||
+      !this->GenerateSpecimenModule(meta) ||
+      !this->GenerateEnhancedCTImageModule(meta))
+    {
+    return false;
+    }
+
+  return true;
+}
+
 //----------------------------------------------------------------------------
 bool vtkDICOMCTGenerator::GenerateCTInstance(
   vtkInformation *info, vtkDICOMMetaData *meta)
@@ -175,8 +307,7 @@ bool vtkDICOMCTGenerator::GenerateInstance(
 {
   if (this->MultiFrame)
     {
-    vtkErrorMacro("Enhanced Multi-Frame CT is not yet supported.");
-    return false;
+    return this->GenerateEnhancedCTInstance(info, meta);
     }
 
   return this->GenerateCTInstance(info, meta);
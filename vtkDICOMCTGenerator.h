@@ -24,6 +24,7 @@
  *  are being written out as derived images after being processed.
  *  The specific IOD classes supported are as follows:
  *  - CT Image, 1.2.840.10008.5.1.4.1.1.2
+ *  - Enhanced CT Image, 1.2.840.10008.5.1.4.1.1.2.1 (if MultiFrame is On)
  */
 class VTK_DICOM_EXPORT vtkDICOMCTGenerator : public vtkDICOMGenerator
 {
@@ -54,10 +55,17 @@ protected:
   //! Generate the Image Module.
   virtual bool GenerateCTImageModule(vtkDICOMMetaData *meta);
 
+  //! Generate the Enhanced CT Image Module.
+  virtual bool GenerateEnhancedCTImageModule(vtkDICOMMetaData *meta);
+
   //! Instantiate a DICOM Secondary Capture Image object.
   virtual bool GenerateCTInstance(
     vtkInformation *info, vtkDICOMMetaData *meta);
 
+  //! Instantiate a DICOM Enhanced CT Image object.
+  virtual bool GenerateEnhancedCTInstance(
+    vtkInformation *info, vtkDICOMMetaData *meta);
+
 private:
   vtkDICOMCTGenerator(const vtkDICOMCTGenerator&);  // Not implemented.
   void operator=(const vtkDICOMCTGenerator&);  // Not implemented.
@@ -21,8 +21,16 @@
 #include <vtkObjectFactory.h>
 #include <vtkStringArray.h>
 #include <vtkUnsignedShortArray.h>
+#include <vtkUnsignedCharArray.h>
 #include <vtkErrorCode.h>
 
+// Header for zlib
+#ifdef DICOM_USE_VTKZLIB
+#include "vtk_zlib.h"
+#else
+#include "zlib.h"
+#endif
+
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -37,6 +45,7 @@
 #include <assert.h>
 
 #include <string>
+#include <vector>
 
 vtkStandardNewMacro(vtkDICOMCompiler);
 vtkCxxSetObjectMacro(vtkDICOMCompiler, MetaData, vtkDICOMMetaData);
@@ -780,8 +789,310 @@ bool Encoder<E>::WriteElements(
   return true;
 }
 
+//----------------------------------------------------------------------------
+// Check whether an element is the same for every instance.  The UIDs
+// are replaced by the compiler, so they are never considered constant.
+bool IsConstantElement(const vtkDICOMDataElement& elem)
+{
+  vtkDICOMTag tag = elem.GetTag();
+  return (!elem.IsPerInstance() &&
+          tag != vtkDICOMTag(DC::SOPInstanceUID) &&
+          tag != vtkDICOMTag(DC::SeriesInstanceUID) &&
+          tag != vtkDICOMTag(DC::StudyInstanceUID));
+}
+
+// Find the end of a run of elements that are either all the same for
+// every instance (in which case "constant" is set), or that must all be
+// encoded separately for each instance.  The iterator must not be at end.
+vtkDICOMDataElementIterator FindSegmentEnd(
+  vtkDICOMDataElementIterator iter,
+  vtkDICOMDataElementIterator iterEnd,
+  bool *constant)
+{
+  unsigned short group = iter->GetTag().GetGroup();
+  if (iter->GetTag().GetElement() == Hx0000)
+    {
+    // the group length depends on every element in the group,
+    // so the whole group must be encoded for each instance
+    do { ++iter; }
+    while (iter != iterEnd && iter->GetTag().GetGroup() == group);
+    *constant = false;
+    return iter;
+    }
+
+  bool isConstant = IsConstantElement(*iter);
+  do { ++iter; }
+  while (iter != iterEnd && iter->GetTag().GetElement() != Hx0000 &&
+         IsConstantElement(*iter) == isConstant);
+
+  *constant = isConstant;
+  return iter;
+}
+
+//----------------------------------------------------------------------------
+// Compress one row with the PackBits scheme that is used by RLE Lossless
+// (see DICOM Part 5, Annex G.3.1), and append it to the output.
+void EncodeRLERow(
+  const unsigned char *row, unsigned int n, std::vector<unsigned char> *op)
+{
+  unsigned int i = 0;
+  while (i < n)
+    {
+    // look for a run of identical bytes
+    unsigned int r = 1;
+    while (i + r < n && r < 128 && row[i + r] == row[i])
+      {
+      r++;
+      }
+
+    if (r > 1)
+      {
+      // replicate run, the count byte is 1 - r as a signed char
+      op->push_back(static_cast<unsigned char>(257 - r));
+      op->push_back(row[i]);
+      i += r;
+      }
+    else
+      {
+      // literal run, continue until a run of three or more begins
+      unsigned int j = i + 1;
+      while (j < n && j - i < 128 &&
+             !(j + 2 < n && row[j] == row[j+1] && row[j] == row[j+2]))
+        {
+        j++;
+        }
+      op->push_back(static_cast<unsigned char>(j - i - 1));
+      op->insert(op->end(), row + i, row + j);
+      i = j;
+      }
+    }
+}
+
+// Compress one frame with RLE Lossless, and append it to the output.
+// There is one segment for each byte of each sample, and the segments
+// are ordered from the most significant byte to the least significant.
+// The return value is false if the frame needs more than 15 segments.
+bool EncodeRLEFrame(
+  const unsigned char *ip, int rows, int cols, int spp, int bps,
+  bool planar, bool bigEndian, std::vector<unsigned char> *op)
+{
+  int numSegments = spp*bps;
+  if (numSegments > 15)
+    {
+    return false;
+    }
+
+  // the header has the number of segments, followed by their offsets
+  size_t start = op->size();
+  op->resize(start + 64, 0);
+  Encoder<LE>::PutInt32(&(*op)[start], numSegments);
+
+  vtkIdType pixelStride = (planar ? bps : spp*bps);
+  vtkIdType planeSize = static_cast<vtkIdType>(rows)*cols*bps;
+  std::vector<unsigned char> row(cols > 0 ? cols : 1);
+
+  for (int k = 0; k < numSegments; k++)
+    {
+    int s = k/bps;
+    int b = k - s*bps;
+    Encoder<LE>::PutInt32(&(*op)[start + 4 + 4*k],
+      static_cast<unsigned int>(op->size() - start));
+
+    // find the first byte of the segment within the frame
+    const unsigned char *sp = ip + (bigEndian ? b : bps - b - 1);
+    sp += (planar ? s*planeSize : s*bps);
+
+    // each row is compressed separately
+    for (int y = 0; y < rows; y++)
+      {
+      for (int x = 0; x < cols; x++)
+        {
+        row[x] = *sp;
+        sp += pixelStride;
+        }
+      EncodeRLERow(&row[0], cols, op);
+      }
+
+    // pad the segment to an even length
+    if (((op->size() - start) & 1) != 0)
+      {
+      op->push_back(0);
+      }
+    }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Copy n values while swapping their bytes.  The values are loaded and
+// stored with memcpy, since the data might not be aligned, and the swap
+// is done with shifts so that the compiler can use bswap or vectorize.
+void SwapCopy16(const char *cp, char *dp, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+    unsigned short v;
+    memcpy(&v, cp + 2*i, 2);
+    v = static_cast<unsigned short>((v >> 8) | (v << 8));
+    memcpy(dp + 2*i, &v, 2);
+    }
+}
+
+void SwapCopy32(const char *cp, char *dp, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+    unsigned int v;
+    memcpy(&v, cp + 4*i, 4);
+    v = ((v >> 24) | ((v >> 8) & 0x0000ff00u) |
+         ((v << 8) & 0x00ff0000u) | (v << 24));
+    memcpy(dp + 4*i, &v, 4);
+    }
+}
+
+void SwapCopy64(const char *cp, char *dp, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+    unsigned long long v;
+    memcpy(&v, cp + 8*i, 8);
+    v = ((v >> 56) | ((v >> 40) & 0x000000000000ff00ull) |
+         ((v >> 24) & 0x0000000000ff0000ull) |
+         ((v >> 8) & 0x00000000ff000000ull) |
+         ((v << 8) & 0x000000ff00000000ull) |
+         ((v << 24) & 0x0000ff0000000000ull) |
+         ((v << 40) & 0x00ff000000000000ull) | (v << 56));
+    memcpy(dp + 8*i, &v, 8);
+    }
+}
+
 } // end anonymous namespace
 
+//----------------------------------------------------------------------------
+// The compressed frames, which must be buffered until the final frame
+// has been compressed so that the offset table can be written first.
+// The image dimensions are copied from the meta data by WriteHeader(),
+// so that frames can be compressed without touching the meta data.
+class vtkDICOMCompiler::FrameData
+{
+public:
+  FrameData() : Rows(0), Columns(0), SamplesPerPixel(1), BitsAllocated(0),
+                Planar(false) {}
+
+  int Rows;
+  int Columns;
+  int SamplesPerPixel;
+  int BitsAllocated;
+  bool Planar;
+  // one fragment per frame, which stays empty until it is compressed
+  std::vector<std::vector<unsigned char> > Fragments;
+};
+
+//----------------------------------------------------------------------------
+// The zlib stream for the deflated transfer syntax, which is active from
+// the end of the meta header until the file is closed.
+class vtkDICOMCompiler::DeflateState
+{
+public:
+  DeflateState() : Active(false) {}
+
+  // Start a raw deflate stream (no zlib header, as required by DICOM).
+  bool Begin(int level, size_t bufferSize);
+
+  // Compress the bytes and write the compressed bytes to the output.
+  bool Write(vtkDICOMCompiler *self, const char *cp, size_t n, int flush);
+
+  // Free the zlib stream.
+  void End();
+
+  z_stream Stream;
+  std::vector<unsigned char> Output;
+  bool Active;
+};
+
+//----------------------------------------------------------------------------
+bool vtkDICOMCompiler::DeflateState::Begin(int level, size_t bufferSize)
+{
+  this->End();
+  this->Stream.zalloc = Z_NULL;
+  this->Stream.zfree = Z_NULL;
+  this->Stream.opaque = Z_NULL;
+  this->Active = (deflateInit2(&this->Stream, level, Z_DEFLATED, -MAX_WBITS,
+                               8, Z_DEFAULT_STRATEGY) == Z_OK);
+  this->Output.resize(bufferSize);
+  return this->Active;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMCompiler::DeflateState::Write(
+  vtkDICOMCompiler *self, const char *cp, size_t n, int flush)
+{
+  z_stream *zs = &this->Stream;
+  zs->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(cp));
+
+  // avail_in is only 32 bits, so large writes are done in chunks
+  do
+    {
+    size_t m = (n < 0x40000000 ? n : 0x40000000);
+    zs->avail_in = static_cast<uInt>(m);
+    n -= m;
+    int f = (n == 0 ? flush : Z_NO_FLUSH);
+    do
+      {
+      zs->next_out = &this->Output[0];
+      zs->avail_out = static_cast<uInt>(this->Output.size());
+      if (deflate(zs, f) == Z_STREAM_ERROR)
+        {
+        return false;
+        }
+      size_t k = this->Output.size() - zs->avail_out;
+      const char *op = reinterpret_cast<const char *>(&this->Output[0]);
+      if (k != 0 && !self->WriteOutput(op, k))
+        {
+        return false;
+        }
+      }
+    while (zs->avail_out == 0);
+    }
+  while (n != 0);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMCompiler::DeflateState::End()
+{
+  if (this->Active)
+    {
+    deflateEnd(&this->Stream);
+    this->Active = false;
+    }
+}
+
+//----------------------------------------------------------------------------
+// The template holds the encoded bytes for the constant elements, and
+// a list of segments that are either constant or per-instance.
+class vtkDICOMCompiler::HeaderTemplate
+{
+public:
+  struct Segment
+  {
+    vtkDICOMDataElementIterator Begin;
+    vtkDICOMDataElementIterator End;
+    size_t Offset;
+    size_t Length;
+    bool Constant;
+  };
+
+  HeaderTemplate() : MetaData(0), MTime(0) {}
+
+  std::vector<Segment> Segments;
+  std::vector<unsigned char> Bytes;
+  vtkDICOMMetaData *MetaData;
+  unsigned long MTime;
+  std::string TransferSyntax;
+};
+
 //----------------------------------------------------------------------------
 //----------------------------------------------------------------------------
 // Constructor
@@ -797,6 +1108,11 @@ vtkDICOMCompiler::vtkDICOMCompiler()
   this->TransferSyntaxUID = NULL;
   this->MetaData = NULL;
   this->OutputFile = NULL;
+  this->OutputOpen = false;
+  this->WriteToMemory = 0;
+  this->Result = vtkUnsignedCharArray::New();
+  this->Callback = 0;
+  this->ClientData = 0;
   this->Buffer = NULL;
   this->BufferSize = 8192;
   this->ChunkSize = 0;
@@ -805,8 +1121,14 @@ vtkDICOMCompiler::vtkDICOMCompiler()
   this->BigEndian = 0;
   this->Compressed = 0;
   this->KeepOriginalPixelDataVR = 0;
+  this->ReuseHeaderTemplate = 0;
+  this->CompressionLevel = -1;
   this->ErrorCode = 0;
   this->SeriesUIDs = 0;
+  this->Template = new HeaderTemplate;
+  this->CaptureTemplate = false;
+  this->Frames = new FrameData;
+  this->Deflate = new DeflateState;
 
   // This is our default implementation UID
   const char *impuid =
@@ -849,6 +1171,11 @@ vtkDICOMCompiler::~vtkDICOMCompiler()
     {
     this->SeriesUIDs->Delete();
     }
+  this->Result->Delete();
+
+  delete this->Template;
+  delete this->Frames;
+  delete this->Deflate;
 }
 
 //----------------------------------------------------------------------------
@@ -870,6 +1197,18 @@ void vtkDICOMCompiler::SetBufferSize(int size)
     }
 }
 
+//----------------------------------------------------------------------------
+void vtkDICOMCompiler::SetOutputCallback(
+  OutputCallback callback, void *clientData)
+{
+  if (this->Callback != callback || this->ClientData != clientData)
+    {
+    this->Callback = callback;
+    this->ClientData = clientData;
+    this->Modified();
+    }
+}
+
 //----------------------------------------------------------------------------
 void vtkDICOMCompiler::GenerateSeriesUIDs()
 {
@@ -900,18 +1239,47 @@ void vtkDICOMCompiler::GenerateSeriesUIDs()
 //----------------------------------------------------------------------------
 void vtkDICOMCompiler::WriteHeader()
 {
+  FrameData *frames = this->Frames;
   this->FrameCounter = 0;
+  frames->Fragments.clear();
   this->WriteFile(this->MetaData, this->Index);
+
+  // prepare to compress the frames, if the transfer syntax is RLE
+  if (this->OutputOpen && this->Compressed && this->TransferSyntaxUID &&
+      strcmp(this->TransferSyntaxUID, "1.2.840.10008.1.2.5") == 0)
+    {
+    vtkDICOMMetaData *meta = this->MetaData;
+    int idx = this->Index;
+    int spp = meta->GetAttributeValue(idx, DC::SamplesPerPixel).AsInt();
+    int numFrames = meta->GetAttributeValue(idx, DC::NumberOfFrames).AsInt();
+    frames->Rows = meta->GetAttributeValue(idx, DC::Rows).AsInt();
+    frames->Columns = meta->GetAttributeValue(idx, DC::Columns).AsInt();
+    frames->SamplesPerPixel = (spp > 0 ? spp : 1);
+    frames->BitsAllocated =
+      meta->GetAttributeValue(idx, DC::BitsAllocated).AsInt();
+    frames->Planar =
+      (meta->GetAttributeValue(idx, DC::PlanarConfiguration).AsInt() != 0);
+    frames->Fragments.resize(numFrames > 0 ? numFrames : 1);
+    }
 }
 
 //----------------------------------------------------------------------------
 void vtkDICOMCompiler::Close()
 {
-  if (this->OutputFile)
+  // write the remainder of the deflated stream
+  if (this->OutputOpen && this->Deflate->Active &&
+      !this->Deflate->Write(this, 0, 0, Z_FINISH))
     {
-    fclose(this->OutputFile);
-    this->OutputFile = NULL;
+    if (this->ErrorCode == vtkErrorCode::NoError)
+      {
+      this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
+      vtkErrorMacro("Error while writing file "
+                    << this->FileName << ": Out of disk space.");
+      }
+    this->CloseOutput(true);
     }
+
+  this->CloseOutput(false);
 }
 
 //----------------------------------------------------------------------------
@@ -933,17 +1301,7 @@ bool vtkDICOMCompiler::WriteFile(vtkDICOMMetaData *data, int idx)
     this->GenerateSeriesUIDs();
     }
 
-  // Remove the file if it exists, just in case it is a hard link
-  // to a file elsewhere on the filesystem.
-  struct stat fs;
-  if (stat(this->FileName, &fs))
-    {
-    unlink(this->FileName);
-    }
-
-  this->OutputFile = fopen(this->FileName, "wb");
-
-  if (this->OutputFile == 0)
+  if (!this->OpenOutput())
     {
     this->SetErrorCode(vtkErrorCode::CannotOpenFileError);
     vtkErrorMacro("WriteFile: Can't open the file " << this->FileName);
@@ -973,6 +1331,19 @@ bool vtkDICOMCompiler::WriteFile(vtkDICOMMetaData *data, int idx)
     cp += 4;
 
     r = this->WriteMetaHeader(cp, ep, data, idx);
+
+    // everything after the meta header is deflated
+    if (r && strcmp(this->TransferSyntaxUID, "1.2.840.10008.1.2.1.99") == 0)
+      {
+      r = this->FlushBuffer(cp, ep);
+      if (r && !this->Deflate->Begin(this->CompressionLevel, this->ChunkSize))
+        {
+        this->SetErrorCode(vtkErrorCode::UnknownError);
+        vtkErrorMacro("WriteFile: Can't initialize zlib for "
+                      << this->FileName);
+        r = false;
+        }
+      }
     }
   if (r)
     {
@@ -988,15 +1359,14 @@ bool vtkDICOMCompiler::WriteFile(vtkDICOMMetaData *data, int idx)
   // delete the file if an error occurred
   if (!r)
     {
-    this->Close();
-    unlink(this->FileName);
-
     if (this->GetErrorCode() == vtkErrorCode::NoError)
       {
       this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
       vtkErrorMacro("Error while writing file "
                     << this->FileName << ": Out of disk space.");
       }
+
+    this->CloseOutput(true);
     }
 
   return r;
@@ -1005,26 +1375,24 @@ bool vtkDICOMCompiler::WriteFile(vtkDICOMMetaData *data, int idx)
 //----------------------------------------------------------------------------
 void vtkDICOMCompiler::WritePixelData(const char *cp, vtkIdType size)
 {
-  if (this->OutputFile == 0)
+  if (!this->OutputOpen)
     {
     return;
     }
 
-  size_t n = fwrite(cp, 1, size, this->OutputFile);
-  if (n != static_cast<size_t>(size))
+  if (!this->WriteBytes(cp, size))
     {
-    this->Close();
-    unlink(this->FileName);
     this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
     vtkErrorMacro("Error while writing file "
                   << this->FileName << ": Out of disk space.");
+    this->CloseOutput(true);
     }
 }
 
 //----------------------------------------------------------------------------
 void vtkDICOMCompiler::WriteFrame(const char *cp, vtkIdType size)
 {
-  if (this->OutputFile == 0)
+  if (!this->OutputOpen)
     {
     return;
     }
@@ -1056,46 +1424,215 @@ void vtkDICOMCompiler::WriteFrame(const char *cp, vtkIdType size)
     // The entire compressed PixelData must be buffered in memory
     // in order for the offset table to be filled in.
 
-    if (this->ErrorCode == 0)
+    std::string tsyntax =
+      (this->TransferSyntaxUID ? this->TransferSyntaxUID : "");
+    if (tsyntax == "1.2.840.10008.1.2.5") // RLE Lossless
+      {
+      n = size;
+      if (!this->CompressFrame(cp, size))
+        {
+        return;
+        }
+      }
+    else if (this->ErrorCode == 0)
       {
       this->SetErrorCode(vtkErrorCode::FileFormatError);
-      vtkErrorMacro("Writing compressed DICOM is not supported.");
+      vtkErrorMacro("Writing compressed DICOM is only supported for "
+                    "RLE Lossless.");
       }
     }
   else if (((this->BigEndian != 0) ^ (endiancheck.s != 1)) &&
            this->MetaData->GetAttributeValue(DC::BitsAllocated).AsInt() > 8)
     {
     // Swap bytes before writing
-    char *buf = new char[size];
-    char *dp = buf;
-    for (vtkIdType i = 0; i < size; i += 2)
-      {
-      dp[0] = cp[1];
-      dp[1] = cp[0];
-      dp += 2;
-      cp += 2;
-      }
-    n = fwrite(buf, 1, size, this->OutputFile);
-    delete [] buf;
+    n = (this->WriteSwappedBytes(cp, size) ? size : 0);
     }
   else
     {
     // For uncompressed frames, write the data raw
-    n = fwrite(cp, 1, size, this->OutputFile);
+    n = (this->WriteBytes(cp, size) ? size : 0);
     }
 
   if (n != static_cast<size_t>(size))
     {
-    this->Close();
-    unlink(this->FileName);
     this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
     vtkErrorMacro("Error while writing file "
                   << this->FileName << ": Out of disk space.");
+    this->CloseOutput(true);
     }
 
   this->FrameCounter++;
 }
 
+//----------------------------------------------------------------------------
+bool vtkDICOMCompiler::WriteSwappedBytes(const char *cp, vtkIdType size)
+{
+  int bitsAllocated =
+    this->MetaData->GetAttributeValue(this->Index, DC::BitsAllocated).AsInt();
+  size_t bps = (bitsAllocated <= 16 ? 2 : (bitsAllocated <= 32 ? 4 : 8));
+
+  // swap through a small buffer, rather than copying the whole frame
+  size_t chunk = (static_cast<size_t>(this->ChunkSize) & ~7u);
+  size_t m = static_cast<size_t>(size);
+  std::vector<char> buffer(m < chunk ? m : chunk);
+
+  bool r = true;
+  while (r && m >= bps)
+    {
+    size_t k = (m < chunk ? m : chunk)/bps;
+    char *dp = &buffer[0];
+    if (bps == 2)
+      {
+      SwapCopy16(cp, dp, k);
+      }
+    else if (bps == 4)
+      {
+      SwapCopy32(cp, dp, k);
+      }
+    else
+      {
+      SwapCopy64(cp, dp, k);
+      }
+    r = this->WriteBytes(dp, k*bps);
+    cp += k*bps;
+    m -= k*bps;
+    }
+
+  // a partial value at the end is written as-is
+  if (r && m > 0)
+    {
+    r = this->WriteBytes(cp, m);
+    }
+
+  return r;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMCompiler::EncodeFrame(
+  int frameIdx, const char *cp, vtkIdType size)
+{
+  union { char c[2]; short s; } endiancheck;
+  endiancheck.c[0] = 1;
+  endiancheck.c[1] = 0;
+
+  // nothing here may touch the meta data or report errors, since this
+  // is called from several threads at once
+  FrameData *frames = this->Frames;
+  int numFrames = static_cast<int>(frames->Fragments.size());
+  int spp = frames->SamplesPerPixel;
+  int bps = frames->BitsAllocated/8;
+
+  if (frameIdx < 0 || frameIdx >= numFrames ||
+      !frames->Fragments[frameIdx].empty() ||
+      frames->BitsAllocated % 8 != 0 || bps == 0 ||
+      size != static_cast<vtkIdType>(frames->Rows)*frames->Columns*spp*bps)
+    {
+    return false;
+    }
+
+  return EncodeRLEFrame(reinterpret_cast<const unsigned char *>(cp),
+                        frames->Rows, frames->Columns, spp, bps,
+                        frames->Planar, (endiancheck.s != 1),
+                        &frames->Fragments[frameIdx]);
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMCompiler::CompressFrame(const char *cp, vtkIdType size)
+{
+  FrameData *frames = this->Frames;
+  std::vector<std::vector<unsigned char> >& fragments = frames->Fragments;
+  int numFrames = static_cast<int>(fragments.size());
+  int frameIdx = this->FrameCounter;
+  int spp = frames->SamplesPerPixel;
+  int bps = frames->BitsAllocated/8;
+
+  // if cp is null, the frame should already have been compressed
+  const char *message = 0;
+  if (frameIdx >= numFrames)
+    {
+    message = "There are more frames than NumberOfFrames.";
+    }
+  else if (frames->BitsAllocated % 8 != 0 || bps == 0 ||
+           size != static_cast<vtkIdType>(frames->Rows)*frames->Columns*
+                   spp*bps)
+    {
+    message = "Frame size does not match the image dimensions.";
+    }
+  else if (spp*bps > 15)
+    {
+    message = "RLE cannot encode more than 15 segments.";
+    }
+  else if (cp ? !this->EncodeFrame(frameIdx, cp, size) :
+           fragments[frameIdx].empty())
+    {
+    message = "The frame was not compressed.";
+    }
+
+  if (message)
+    {
+    this->SetErrorCode(vtkErrorCode::FileFormatError);
+    vtkErrorMacro("Error while writing file " << this->FileName
+                  << ": " << message);
+    return false;
+    }
+
+  if (frameIdx + 1 < numFrames)
+    {
+    // wait until all of the frames have been compressed
+    return true;
+    }
+
+  // the offset table gives the position of each fragment item,
+  // followed by the fragments, followed by the sequence delimiter
+  unsigned int n = static_cast<unsigned int>(numFrames);
+  std::vector<unsigned char> table(8 + 4*n);
+  Encoder<LE>::PutInt16(&table[0], HxFFFE);
+  Encoder<LE>::PutInt16(&table[2], HxE000);
+  Encoder<LE>::PutInt32(&table[4], 4*n);
+  unsigned int offset = 0;
+  for (unsigned int i = 0; i < n; i++)
+    {
+    Encoder<LE>::PutInt32(&table[8 + 4*i], offset);
+    offset += 8 + static_cast<unsigned int>(fragments[i].size());
+    }
+
+  bool r = this->WriteBytes(
+    reinterpret_cast<const char *>(&table[0]), table.size());
+
+  for (unsigned int i = 0; i < n && r; i++)
+    {
+    unsigned int l = static_cast<unsigned int>(fragments[i].size());
+    unsigned char item[8];
+    Encoder<LE>::PutInt16(&item[0], HxFFFE);
+    Encoder<LE>::PutInt16(&item[2], HxE000);
+    Encoder<LE>::PutInt32(&item[4], l);
+    r = (this->WriteBytes(reinterpret_cast<const char *>(item), 8) &&
+         this->WriteBytes(
+           reinterpret_cast<const char *>(&fragments[i][0]), l));
+    }
+
+  if (r)
+    {
+    unsigned char item[8];
+    Encoder<LE>::PutInt16(&item[0], HxFFFE);
+    Encoder<LE>::PutInt16(&item[2], HxE0DD);
+    Encoder<LE>::PutInt32(&item[4], 0);
+    r = this->WriteBytes(reinterpret_cast<const char *>(item), 8);
+    }
+
+  fragments.clear();
+
+  if (!r)
+    {
+    this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
+    vtkErrorMacro("Error while writing file "
+                  << this->FileName << ": Out of disk space.");
+    this->CloseOutput(true);
+    }
+
+  return r;
+}
+
 //----------------------------------------------------------------------------
 bool vtkDICOMCompiler::WriteMetaHeader(
   unsigned char* &cp, unsigned char* &ep,
@@ -1119,6 +1656,12 @@ bool vtkDICOMCompiler::WriteMetaHeader(
   // Secondary Capture is 1.2.840.10008.5.1.4.1.1.7
   std::string classUIDString =
     meta->GetAttributeValue(DC::SOPClassUID).AsString();
+  if (classUIDString == "")
+    {
+    // files without a SOP Class (e.g. DICOMDIR) must provide it here
+    classUIDString =
+      meta->GetAttributeValue(DC::MediaStorageSOPClassUID).AsString();
+    }
   const char *classUID = classUIDString.c_str();
 
   if (instanceUID == 0)
@@ -1208,7 +1751,8 @@ bool vtkDICOMCompiler::WriteMetaData(
     {
     this->BigEndian = true;
     }
-  else if (tsyntax != "1.2.840.10008.1.2.1") // Explicit LE
+  else if (tsyntax != "1.2.840.10008.1.2.1" &&  // Explicit LE
+           tsyntax != "1.2.840.10008.1.2.1.99") // Deflated Explicit LE
     {
     this->Compressed = true;
     }
@@ -1257,8 +1801,83 @@ bool vtkDICOMCompiler::WriteMetaData(
       }
     }
 
-  // write the meta data, get boolean status value
-  bool r = encoder->WriteElements(cp, ep, iter, iterEnd);
+  // the template can only be reused if the caller has promised
+  // that the meta data will not change between instances
+  HeaderTemplate *t = this->Template;
+  bool r = true;
+  if (!this->ReuseHeaderTemplate)
+    {
+    t->MetaData = 0;
+    r = encoder->WriteElements(cp, ep, iter, iterEnd);
+    }
+  else
+    {
+    // rebuild the template if this might be a new series
+    if (idx == 0 || t->MetaData != meta || t->MTime != meta->GetMTime() ||
+        t->TransferSyntax != tsyntax)
+      {
+      t->Segments.clear();
+      t->Bytes.clear();
+      t->MetaData = meta;
+      t->MTime = meta->GetMTime();
+      t->TransferSyntax = tsyntax;
+
+      // write out whatever is in the buffer before capturing
+      r = this->FlushBuffer(cp, ep);
+
+      vtkDICOMDataElementIterator segIter = iter;
+      while (r && segIter != iterEnd)
+        {
+        HeaderTemplate::Segment seg;
+        seg.Begin = segIter;
+        seg.End = FindSegmentEnd(segIter, iterEnd, &seg.Constant);
+        seg.Offset = t->Bytes.size();
+        seg.Length = 0;
+        if (seg.Constant)
+          {
+          // encode the constant elements into the template
+          this->CaptureTemplate = true;
+          encoder->WriteElements(cp, ep, seg.Begin, seg.End);
+          r = this->FlushBuffer(cp, ep);
+          this->CaptureTemplate = false;
+          seg.Length = t->Bytes.size() - seg.Offset;
+          }
+        t->Segments.push_back(seg);
+        segIter = seg.End;
+        }
+      }
+
+    // write the meta data, splicing the per-instance elements
+    // in between the pre-encoded constant elements
+    std::vector<HeaderTemplate::Segment>::iterator segIter;
+    for (segIter = t->Segments.begin();
+         r && segIter != t->Segments.end();
+         ++segIter)
+      {
+      if (segIter->Constant)
+        {
+        const unsigned char *bp = &t->Bytes[segIter->Offset];
+        size_t n = segIter->Length;
+        while (n > 0 && r)
+          {
+          if (cp == ep)
+            {
+            r = this->FlushBuffer(cp, ep);
+            }
+          size_t m = ep - cp;
+          m = (m < n ? m : n);
+          memcpy(cp, bp, m);
+          cp += m;
+          bp += m;
+          n -= m;
+          }
+        }
+      else
+        {
+        r = encoder->WriteElements(cp, ep, segIter->Begin, segIter->End);
+        }
+      }
+    }
 
   // write the PixelData element head
   if (r && hasPixelData &&
@@ -1340,9 +1959,102 @@ bool vtkDICOMCompiler::FlushBuffer(
   ucp = reinterpret_cast<unsigned char *>(dp);
   size_t n = cp - dp;
 
-  size_t m = fwrite(dp, 1, n, this->OutputFile);
+  if (this->CaptureTemplate)
+    {
+    // append to the template, rather than writing to the file
+    const unsigned char *up = reinterpret_cast<unsigned char *>(dp);
+    this->Template->Bytes.insert(this->Template->Bytes.end(), up, up + n);
+    return true;
+    }
+
+  return this->WriteBytes(dp, n);
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMCompiler::WriteBytes(const char *cp, size_t n)
+{
+  if (this->Deflate->Active)
+    {
+    return this->Deflate->Write(this, cp, n, Z_NO_FLUSH);
+    }
+
+  return this->WriteOutput(cp, n);
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMCompiler::OpenOutput()
+{
+  this->Result->Reset();
+
+  if (this->Callback == 0 && !this->WriteToMemory)
+    {
+    // Remove the file if it exists, just in case it is a hard link
+    // to a file elsewhere on the filesystem.
+    struct stat fs;
+    if (stat(this->FileName, &fs))
+      {
+      unlink(this->FileName);
+      }
+
+    this->OutputFile = fopen(this->FileName, "wb");
+
+    if (this->OutputFile == 0)
+      {
+      return false;
+      }
+    }
+
+  this->OutputOpen = true;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMCompiler::WriteOutput(const char *cp, size_t n)
+{
+  if (this->Callback)
+    {
+    return (n == 0 || this->Callback(this, cp, n, this->ClientData));
+    }
+  else if (this->WriteToMemory)
+    {
+    vtkIdType m = this->Result->GetNumberOfTuples();
+    unsigned char *dp = this->Result->WritePointer(m, n);
+    memcpy(dp, cp, n);
+    return true;
+    }
 
-  return (n == m);
+  return (fwrite(cp, 1, n, this->OutputFile) == n);
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMCompiler::CloseOutput(bool discard)
+{
+  if (!this->OutputOpen)
+    {
+    return;
+    }
+
+  this->OutputOpen = false;
+  this->Deflate->End();
+
+  if (this->OutputFile)
+    {
+    fclose(this->OutputFile);
+    this->OutputFile = NULL;
+    if (discard)
+      {
+      unlink(this->FileName);
+      }
+    }
+  else if (this->Callback)
+    {
+    // signal the end of the file, the callback can check the error code
+    this->Callback(this, 0, 0, this->ClientData);
+    }
+  else if (discard)
+    {
+    this->Result->Reset();
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -1379,9 +2091,17 @@ void vtkDICOMCompiler::PrintSelf(ostream& os, vtkIndent indent)
          this->SourceApplicationEntityTitle : "(NULL)") << "\n";
   os << indent << "TransferSyntaxUID: "
      << (this->TransferSyntaxUID ? this->TransferSyntaxUID : "(NULL)") << "\n";
+  os << indent << "CompressionLevel: " << this->CompressionLevel << "\n";
   os << indent << "MetaData: " << this->MetaData << "\n";
   os << indent << "Index: " << this->Index << "\n";
   os << indent << "BufferSize: " << this->BufferSize << "\n";
   os << indent << "KeepOriginalPixelDataVR: "
      << (this->KeepOriginalPixelDataVR ? "On\n" : "Off\n");
+  os << indent << "ReuseHeaderTemplate: "
+     << (this->ReuseHeaderTemplate ? "On\n" : "Off\n");
+  os << indent << "WriteToMemory: "
+     << (this->WriteToMemory ? "On\n" : "Off\n");
+  os << indent << "Result: " << this->Result << "\n";
+  os << indent << "OutputCallback: "
+     << (this->Callback ? "Set\n" : "(none)\n");
 }
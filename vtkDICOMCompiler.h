@@ -20,6 +20,7 @@
 #include <stdio.h>
 
 class vtkStringArray;
+class vtkUnsignedCharArray;
 class vtkDICOMMetaData;
 class vtkDICOMCompilerInternalFriendship;
 
@@ -97,11 +98,58 @@ public:
    *  1.2.840.10008.1.2.1 (uncompressed little-endian with explicit VR)
    *  unless you are cloning the PixelData byte for byte from another
    *  image, in which case you should use the transfer syntax from that
-   *  image.
+   *  image.  The exceptions are 1.2.840.10008.1.2.5 (RLE Lossless),
+   *  for which WriteFrame() will compress the uncompressed frames that
+   *  it is given, and 1.2.840.10008.1.2.1.99 (Deflated Explicit VR
+   *  Little Endian), for which everything after the meta header is
+   *  compressed with zlib as it is written.
    */
   vtkSetStringMacro(TransferSyntaxUID);
   vtkGetStringMacro(TransferSyntaxUID);
 
+  //! Set the compression level for the deflated transfer syntax.
+  /*!
+   *  The level goes from 1 (fastest) to 9 (smallest), or 0 for none.
+   *  The default of -1 uses the zlib default, which is level 6.  This
+   *  is ignored unless the transfer syntax is 1.2.840.10008.1.2.1.99.
+   */
+  vtkSetClampMacro(CompressionLevel, int, -1, 9);
+  vtkGetMacro(CompressionLevel, int);
+
+  //! Write the file to memory, instead of to disk.
+  /*!
+   *  When this is on, the file is written to the array given by
+   *  GetResult(), which is cleared whenever a new file is started.
+   *  The FileName must still be set, since it is used in messages,
+   *  but nothing is written to disk.
+   */
+  vtkSetMacro(WriteToMemory, int);
+  vtkBooleanMacro(WriteToMemory, int);
+  vtkGetMacro(WriteToMemory, int);
+
+  //! Get the array that holds the file, if WriteToMemory is on.
+  vtkUnsignedCharArray *GetResult() { return this->Result; }
+
+  //! A function that receives the bytes of the file as they are written.
+  /*!
+   *  This should return false if it could not accept the bytes, which
+   *  will cause the compiler to stop with an error.
+   */
+  typedef bool (*OutputCallback)(
+    vtkDICOMCompiler *caller, const char *data, size_t size,
+    void *clientData);
+
+  //! Send the file to a callback function, instead of writing it to disk.
+  /*!
+   *  The callback is given the bytes of the file in order, in pieces
+   *  that are no larger than the buffer size, except for pixel data.
+   *  When the file is closed, the callback is called once more with
+   *  a size of zero, and it should check GetErrorCode() on the caller
+   *  to see if the file was complete.  Use a NULL callback to go back
+   *  to writing files.  This takes precedence over WriteToMemory.
+   */
+  void SetOutputCallback(OutputCallback callback, void *clientData);
+
   //! Set the metadata object to write to the file.
   void SetMetaData(vtkDICOMMetaData *);
   vtkDICOMMetaData *GetMetaData() { return this->MetaData; }
@@ -130,8 +178,24 @@ public:
   virtual void WritePixelData(const char *cp, vtkIdType size);
 
   //! Write one frame to the end of the file.
+  /*!
+   *  For RLE Lossless, the frame can instead be compressed beforehand
+   *  with EncodeFrame(), and then WriteFrame() is called with a null
+   *  pointer, but with the same size.
+   */
   virtual void WriteFrame(const char *cp, vtkIdType size);
 
+  //! Compress a frame without writing it (RLE Lossless only).
+  /*!
+   *  This allows the frames of a multi-frame file to be compressed by
+   *  several threads at once.  After WriteHeader(), each thread can call
+   *  this method for a different frame, and then WriteFrame(0, size) must
+   *  be called for each frame, in order, from a single thread.  Errors
+   *  are not reported until WriteFrame() is called.  The return value is
+   *  false if the frame could not be compressed.
+   */
+  bool EncodeFrame(int frameIdx, const char *cp, vtkIdType size);
+
   //! Close the file.
   virtual void Close();
 
@@ -156,6 +220,19 @@ public:
   vtkBooleanMacro(KeepOriginalPixelDataVR, int);
   vtkGetMacro(KeepOriginalPixelDataVR, int);
 
+  //! Reuse the encoded elements that are the same for every instance.
+  /*!
+   *  When this is on, the elements that are the same for every instance
+   *  are encoded once, when the header of the first instance is written,
+   *  and the encoded bytes are copied into the headers of the following
+   *  instances.  Only turn this on if the meta data will not be modified
+   *  until all of the instances have been written, since the compiler
+   *  cannot detect such changes.  The default is Off.
+   */
+  vtkSetMacro(ReuseHeaderTemplate, int);
+  vtkBooleanMacro(ReuseHeaderTemplate, int);
+  vtkGetMacro(ReuseHeaderTemplate, int);
+
 protected:
   vtkDICOMCompiler();
   ~vtkDICOMCompiler();
@@ -185,6 +262,14 @@ protected:
     vtkDICOMMetaData *data, int idx);
 
   //! Write the meta data following the meta header.
+  /*!
+   *  By default, all of the data elements are encoded for every file.
+   *  If ReuseHeaderTemplate is on, the elements that have the same value
+   *  for every instance are encoded once and kept as a byte template,
+   *  and only the per-instance elements are encoded for each file.  The
+   *  template is rebuilt when the index is zero, or when the meta data
+   *  object, its modification time, or the transfer syntax changes.
+   */
   bool WriteMetaData(
     unsigned char* &cp, unsigned char* &ep,
     vtkDICOMMetaData *data, int idx);
@@ -192,6 +277,42 @@ protected:
   //! Compute the size of the pixel data (0xffffffff if compressed).
   unsigned int ComputePixelDataSize();
 
+  //! Compress a frame, and write all frames after the final frame.
+  /*!
+   *  The compressed frames are kept in memory until the final frame
+   *  has been compressed, and then they are written to the file as
+   *  encapsulated fragments preceded by a basic offset table.  If cp
+   *  is null, the frame must already have been given to EncodeFrame().
+   *  This returns false if an error occurred.
+   */
+  bool CompressFrame(const char *cp, vtkIdType size);
+
+  //! Swap the bytes of a frame while writing it to the file.
+  /*!
+   *  The size of the values is given by BitsAllocated.  The data is
+   *  swapped and written in pieces that are no larger than the buffer,
+   *  so no copy of the whole frame is made.  This returns false if an
+   *  error occurred.
+   */
+  bool WriteSwappedBytes(const char *cp, vtkIdType size);
+
+  //! Open the output, which is either a file, memory, or a callback.
+  bool OpenOutput();
+
+  //! Write bytes to the output.
+  bool WriteOutput(const char *cp, size_t n);
+
+  //! Close the output, and remove the file if "discard" is set.
+  void CloseOutput(bool discard);
+
+  //! Write bytes to the file, deflating them if necessary.
+  /*!
+   *  The data set and the uncompressed pixel data are written through
+   *  this method, so that they can be compressed when the transfer syntax
+   *  is deflated.  This returns false if an error occurred.
+   */
+  bool WriteBytes(const char *cp, size_t n);
+
   char *FileName;
   char *SOPInstanceUID;
   char *SeriesInstanceUID;
@@ -203,6 +324,11 @@ protected:
   vtkDICOMMetaData *MetaData;
   vtkStringArray *SeriesUIDs;
   FILE *OutputFile;
+  bool OutputOpen;
+  int WriteToMemory;
+  vtkUnsignedCharArray *Result;
+  OutputCallback Callback;
+  void *ClientData;
   char *Buffer;
   int BufferSize;
   int ChunkSize;
@@ -211,6 +337,8 @@ protected:
   int BigEndian;
   int Compressed;
   int KeepOriginalPixelDataVR;
+  int ReuseHeaderTemplate;
+  int CompressionLevel;
   unsigned long ErrorCode;
 
   static char StudyUID[64];
@@ -221,6 +349,22 @@ protected:
 private:
   vtkDICOMCompiler(const vtkDICOMCompiler&);  // Not implemented.
   void operator=(const vtkDICOMCompiler&);  // Not implemented.
+
+  class HeaderTemplate;
+  class FrameData;
+  class DeflateState;
+
+  //! The pre-encoded elements that are shared by all instances.
+  HeaderTemplate *Template;
+
+  //! The compressed frames for the current file.
+  FrameData *Frames;
+
+  //! The zlib stream, when writing the deflated transfer syntax.
+  DeflateState *Deflate;
+
+  //! If set, FlushBuffer() appends to the template instead of the file.
+  bool CaptureTemplate;
 };
 
 #endif /* __vtkDICOMCompiler_h */
@@ -38,6 +38,22 @@
 
 #include <ctype.h>
 
+// On Linux, read directories with readdir() and use d_type so that
+// a stat() call is not needed for every directory entry
+#if defined(__linux__)
+#define DICOM_USE_DIRENT
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <set>
+#include <sys/inotify.h>
+#define DICOM_USE_INOTIFY
+#endif
+
+#include <time.h>
+
 vtkStandardNewMacro(vtkDICOMDirectory);
 
 //----------------------------------------------------------------------------
@@ -101,6 +117,11 @@ struct vtkDICOMDirectory::SeriesInfo
   vtkDICOMValue SeriesUID;
   unsigned int SeriesNumber;
   std::vector<FileInfo> Files;
+  // -- STORAGE --
+  std::vector<vtkSmartPointer<vtkStringArray> > FileNameArrays;
+  // -- STREAMING --
+  int Depth; // the series is held until the scan leaves this depth
+  bool Found; // files were found in the directory that was just parsed
 };
 
 bool vtkDICOMDirectory::CompareInstance(
@@ -116,6 +137,64 @@ class vtkDICOMDirectory::SeriesInfoList
   : public std::list<vtkDICOMDirectory::SeriesInfo>
 {};
 
+//----------------------------------------------------------------------------
+// The (device, inode) of each directory that has been scanned, and the
+// depth that it was scanned to, for directories that are reached more than
+// once through symbolic links.  Also the (device, inode) of each file that
+// has been listed, for files that are reached through symbolic links or
+// hard links.
+
+#ifdef DICOM_USE_DIRENT
+class vtkDICOMDirectory::VisitedSet
+{
+public:
+  void clear() { this->Directories.clear(); this->Files.clear(); }
+
+  std::map<std::pair<dev_t, ino_t>, int> Directories;
+  std::set<std::pair<dev_t, ino_t> > Files;
+};
+#else
+class vtkDICOMDirectory::VisitedSet
+{};
+#endif
+
+//----------------------------------------------------------------------------
+// Information that is kept while the directory is being watched.
+
+class vtkDICOMDirectory::WatchInfo
+{
+public:
+  // Size and modification time, for files that might still be growing.
+  struct PendingFile
+  {
+    off_t Size;
+    time_t ModifiedTime;
+  };
+
+  // The state of each series, used to decide when to invoke events.
+  struct SeriesState
+  {
+    vtkIdType NumberOfFiles;
+    time_t LastChange;
+    bool Complete;
+  };
+
+  WatchInfo() : Descriptor(-1) {}
+
+  // The inotify descriptor, or -1 if polling is used.
+  int Descriptor;
+  // The path and scan depth for each inotify watch descriptor.
+  std::map<int, std::pair<std::string, int> > Directories;
+  // Every file that has been seen, whether or not it was DICOM.
+  std::set<std::string> KnownFiles;
+  // New files that will be read once their size is stable.
+  std::map<std::string, PendingFile> PendingFiles;
+  // The sorted series, which new files are merged into.
+  SeriesInfoList SeriesList;
+  // The state of each series, according to SeriesInstanceUID.
+  std::map<std::string, SeriesState> SeriesStates;
+};
+
 //----------------------------------------------------------------------------
 vtkDICOMDirectory::vtkDICOMDirectory()
 {
@@ -123,15 +202,24 @@ vtkDICOMDirectory::vtkDICOMDirectory()
   this->Series = new SeriesVector;
   this->Studies = new StudyVector;
   this->Patients = new PatientVector;
+  this->Visited = new VisitedSet;
+  this->Watch = 0;
+  this->StreamList = 0;
+  this->Query = new vtkDICOMItem;
   this->FileSetID = 0;
   this->InternalFileName = 0;
   this->RequirePixelData = 1;
   this->ScanDepth = 1;
+  this->SeriesCompleteDelay = 10.0;
+  this->WatchUsePolling = 0;
+  this->StreamSeries = 0;
 }
 
 //----------------------------------------------------------------------------
 vtkDICOMDirectory::~vtkDICOMDirectory()
 {
+  this->StopWatch();
+
   if (this->DirectoryName)
     {
     delete [] this->DirectoryName;
@@ -144,6 +232,8 @@ vtkDICOMDirectory::~vtkDICOMDirectory()
   delete this->Series;
   delete this->Studies;
   delete this->Patients;
+  delete this->Visited;
+  delete this->Query;
   delete [] this->FileSetID;
 }
 
@@ -160,6 +250,21 @@ void vtkDICOMDirectory::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "RequirePixelData: "
      << (this->RequirePixelData ? "On\n" : "Off\n");
 
+  os << indent << "Watching: "
+     << (this->Watch ? "True\n" : "False\n");
+
+  os << indent << "WatchUsePolling: "
+     << (this->WatchUsePolling ? "On\n" : "Off\n");
+
+  os << indent << "SeriesCompleteDelay: "
+     << this->SeriesCompleteDelay << "\n";
+
+  os << indent << "StreamSeries: "
+     << (this->StreamSeries ? "On\n" : "Off\n");
+
+  os << indent << "FindQuery: ("
+     << this->Query->GetNumberOfDataElements() << " elements)\n";
+
   os << indent << "NumberOfSeries: " << this->GetNumberOfSeries() << "\n";
   os << indent << "NumberOfStudies: " << this->GetNumberOfStudies() << "\n";
   os << indent << "NumberOfPatients: " << this->GetNumberOfPatients() << "\n";
@@ -189,6 +294,45 @@ void vtkDICOMDirectory::SetDirectoryName(const char *name)
   this->Modified();
 }
 
+//----------------------------------------------------------------------------
+void vtkDICOMDirectory::SetFindQuery(const vtkDICOMItem& query)
+{
+  *this->Query = query;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMDirectory::MatchesQuery(
+  const vtkDICOMItem& patientRecord,
+  const vtkDICOMItem& studyRecord,
+  const vtkDICOMItem& seriesRecord)
+{
+  const vtkDICOMItem *records[3] =
+    { &seriesRecord, &studyRecord, &patientRecord };
+
+  vtkDICOMDataElementIterator iter = this->Query->Begin();
+  vtkDICOMDataElementIterator iterEnd = this->Query->End();
+  for (; iter != iterEnd; ++iter)
+    {
+    // use the first record that has the attribute
+    vtkDICOMTag tag = iter->GetTag();
+    for (int i = 0; i < 3; i++)
+      {
+      const vtkDICOMValue& v = records[i]->GetAttributeValue(tag);
+      if (v.IsValid())
+        {
+        if (!v.Matches(iter->GetValue()))
+          {
+          return false;
+          }
+        break;
+        }
+      }
+    }
+
+  return true;
+}
+
 //----------------------------------------------------------------------------
 int vtkDICOMDirectory::GetNumberOfSeries()
 {
@@ -387,6 +531,38 @@ void vtkDICOMDirectory::FillPatientRecord(
 
 //----------------------------------------------------------------------------
 void vtkDICOMDirectory::SortFiles(vtkStringArray *input)
+{
+  if (this->Watch)
+    {
+    // Keep the sorted list, so that new files can be merged into it.
+    vtkSmartPointer<vtkStringArray> files =
+      vtkSmartPointer<vtkStringArray>::New();
+    vtkIdType n = input->GetNumberOfValues();
+    for (vtkIdType i = 0; i < n; i++)
+      {
+      if (this->Watch->KnownFiles.insert(input->GetValue(i)).second)
+        {
+        files->InsertNextValue(input->GetValue(i));
+        }
+      }
+    if (this->ParseFiles(files, &this->Watch->SeriesList))
+      {
+      this->UpdateWatchedSeries(true, false);
+      }
+    return;
+    }
+
+  SeriesInfoList sortedFiles;
+
+  if (this->ParseFiles(input, &sortedFiles))
+    {
+    this->AddSortedSeries(&sortedFiles);
+    }
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMDirectory::ParseFiles(
+  vtkStringArray *input, SeriesInfoList *sortedFiles)
 {
   vtkSmartPointer<vtkUnsignedShortArray> groups =
     vtkSmartPointer<vtkUnsignedShortArray>::New();
@@ -403,8 +579,9 @@ void vtkDICOMDirectory::SortFiles(vtkStringArray *input)
   groups->InsertNextValue(0x0020); // For study and series info.
   parser->SetMetaData(meta);
   parser->SetGroups(groups);
+  parser->SetQuery(*this->Query);
+  parser->SniffOn();
 
-  SeriesInfoList sortedFiles;
   SeriesInfoList::iterator li;
 
   vtkIdType numberOfStrings = input->GetNumberOfValues();
@@ -412,17 +589,24 @@ void vtkDICOMDirectory::SortFiles(vtkStringArray *input)
     {
     const std::string& fileName = input->GetValue(j);
 
-    // Skip anything that does not look like a DICOM file.
-    if (!vtkDICOMUtilities::IsDICOMFile(fileName.c_str()))
-      {
-      continue;
-      }
-
     // Read the file metadata
     meta->Initialize();
     this->SetInternalFileName(fileName.c_str());
     parser->SetFileName(fileName.c_str());
     parser->Update();
+
+    // Skip anything that does not look like a DICOM file.
+    if (parser->GetErrorCode() == vtkErrorCode::UnrecognizedFileTypeError)
+      {
+      continue;
+      }
+
+    // Skip files that do not match the query.
+    if (!parser->GetQueryMatched())
+      {
+      continue;
+      }
+
     if (!parser->GetPixelDataFound())
       {
       if (!this->ErrorCode)
@@ -447,14 +631,14 @@ void vtkDICOMDirectory::SortFiles(vtkStringArray *input)
       }
     if (this->AbortExecute)
       {
-      return;
+      return false;
       }
 
     // Insert the file into the sorted list
     FileInfo fileInfo;
     fileInfo.InstanceNumber =
       meta->GetAttributeValue(DC::InstanceNumber).AsUnsignedInt();
-    fileInfo.FileName = fileName.c_str(); // stored in input StringArray
+    fileInfo.FileName = fileName.c_str(); // kept by FileNameArrays
 
     const vtkDICOMValue& patientNameValue =
       meta->GetAttributeValue(DC::PatientName);
@@ -482,7 +666,7 @@ void vtkDICOMDirectory::SortFiles(vtkStringArray *input)
     patientID = (patientID ? patientID : "");
 
     bool foundSeries = false;
-    for (li = sortedFiles.begin(); li != sortedFiles.end(); ++li)
+    for (li = sortedFiles->begin(); li != sortedFiles->end(); ++li)
       {
       // Compare patient, then study, then series.
       const char *patientName2 = li->PatientName.GetCharData();
@@ -534,6 +718,11 @@ void vtkDICOMDirectory::SortFiles(vtkStringArray *input)
       if (c == 0 && seriesUID != 0)
         {
         li->Files.push_back(fileInfo);
+        if (li->FileNameArrays.back().GetPointer() != input)
+          {
+          li->FileNameArrays.push_back(input);
+          }
+        li->Found = true;
         foundSeries = true;
         break;
         }
@@ -545,7 +734,7 @@ void vtkDICOMDirectory::SortFiles(vtkStringArray *input)
 
     if (!foundSeries)
       {
-      li = sortedFiles.insert(li, SeriesInfo());
+      li = sortedFiles->insert(li, SeriesInfo());
       li->PatientName = patientNameValue;
       li->PatientID = patientIDValue;
       li->StudyDate = studyDateValue;
@@ -553,12 +742,23 @@ void vtkDICOMDirectory::SortFiles(vtkStringArray *input)
       li->SeriesUID = seriesUIDValue;
       li->SeriesNumber = seriesNumber;
       li->Files.push_back(fileInfo);
+      li->FileNameArrays.push_back(input);
+      li->Depth = 0;
+      li->Found = true;
       this->FillPatientRecord(&li->PatientRecord, meta);
       this->FillStudyRecord(&li->StudyRecord, meta);
       this->FillSeriesRecord(&li->SeriesRecord, meta);
       }
     }
 
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMDirectory::AddSortedSeries(SeriesInfoList *sortedFiles)
+{
+  SeriesInfoList::iterator li;
+
   // Sort each series by InstanceNumber
   int patientCount = this->GetNumberOfPatients();
   int studyCount = this->GetNumberOfStudies();
@@ -566,7 +766,7 @@ void vtkDICOMDirectory::SortFiles(vtkStringArray *input)
   vtkDICOMValue lastStudyUID;
   vtkDICOMValue lastPatientID;
 
-  for (li = sortedFiles.begin(); li != sortedFiles.end(); ++li)
+  for (li = sortedFiles->begin(); li != sortedFiles->end(); ++li)
     {
     SeriesInfo &v = *li;
     std::stable_sort(v.Files.begin(), v.Files.end(), CompareInstance);
@@ -640,6 +840,8 @@ void vtkDICOMDirectory::ProcessDirectoryFile(
   std::vector<std::pair<unsigned int, std::string> > offsetStack;
   int patientIdx = this->GetNumberOfPatients();
   int studyIdx = this->GetNumberOfStudies();
+  int lastPatientIdx = -1;
+  int lastStudyIdx = -1;
   unsigned int patientItem = 0;
   unsigned int studyItem = 0;
   unsigned int seriesItem = 0;
@@ -736,9 +938,20 @@ void vtkDICOMDirectory::ProcessDirectoryFile(
           }
         else if (entryType == "SERIES")
           {
-          this->AddSeriesFileNames(
-            patientIdx, studyIdx, fileNames,
-            items[patientItem], items[studyItem], items[seriesItem]);
+          if (this->MatchesQuery(
+                items[patientItem], items[studyItem], items[seriesItem]))
+            {
+            // Renumber, in case the query excluded some studies.
+            int study = this->GetNumberOfStudies();
+            int patient = this->GetNumberOfPatients();
+            if (studyIdx == lastStudyIdx) { study--; }
+            if (patientIdx == lastPatientIdx) { patient--; }
+            lastStudyIdx = studyIdx;
+            lastPatientIdx = patientIdx;
+            this->AddSeriesFileNames(
+              patient, study, fileNames,
+              items[patientItem], items[studyItem], items[seriesItem]);
+            }
           fileNames = vtkSmartPointer<vtkStringArray>::New();
           }
         }
@@ -763,8 +976,9 @@ void vtkDICOMDirectory::ProcessDirectory(
   std::string dicomdir = vtksys::SystemTools::JoinPath(path);
   path.pop_back();
 
-  // Check to see if the DICOMDIR file exists.
-  if (vtksys::SystemTools::FileExists(dicomdir.c_str(), true))
+  // Check to see if the DICOMDIR file exists (ignored in watch mode).
+  if (this->Watch == 0 &&
+      vtksys::SystemTools::FileExists(dicomdir.c_str(), true))
     {
     vtkSmartPointer<vtkDICOMMetaData> meta =
       vtkSmartPointer<vtkDICOMMetaData>::New();
@@ -789,6 +1003,10 @@ void vtkDICOMDirectory::ProcessDirectory(
       {
       // Convert the DICOMDIR into a list of filenames.
       this->ProcessDirectoryFile(dirname, meta);
+      if (this->StreamList)
+        {
+        this->StreamOutput();
+        }
       return;
       }
     }
@@ -809,6 +1027,117 @@ void vtkDICOMDirectory::ProcessDirectory(
     return;
     }
 
+  // When streaming, each directory's files are parsed separately.
+  // The subdirectories are scanned after the files have been parsed, so
+  // that the series in this directory are known before the scan descends.
+  std::vector<std::string> subdirs;
+  vtkStringArray *dirFiles = files;
+  vtkSmartPointer<vtkStringArray> streamFiles;
+  if (this->StreamList)
+    {
+    streamFiles = vtkSmartPointer<vtkStringArray>::New();
+    dirFiles = streamFiles;
+    }
+
+#ifdef DICOM_USE_DIRENT
+  int fd = open(dirname, O_RDONLY | O_DIRECTORY);
+  DIR *dirp = (fd >= 0 ? fdopendir(fd) : 0);
+  struct stat ds;
+  if (dirp == 0 || fstat(fd, &ds) != 0)
+    {
+    if (dirp)
+      {
+      closedir(dirp);
+      }
+    else if (fd >= 0)
+      {
+      close(fd);
+      }
+    // Only fail at the initial depth.
+    if (depth == this->ScanDepth)
+      {
+      vtkErrorMacro(<< "Could not read directory " << dirname);
+      this->ErrorCode = vtkErrorCode::CannotOpenFileError;
+      }
+    return;
+    }
+
+  // Don't scan the same directory twice (e.g. because of symlinks), unless
+  // it is reached again with more depth remaining.  In that case, only the
+  // subdirectories are scanned again, since the files are already listed.
+  std::pair<std::map<std::pair<dev_t, ino_t>, int>::iterator, bool> visit =
+    this->Visited->Directories.insert(
+    std::make_pair(std::make_pair(ds.st_dev, ds.st_ino), depth));
+  bool rescan = !visit.second;
+  if (rescan)
+    {
+    if (visit.first->second >= depth)
+      {
+      closedir(dirp);
+      return;
+      }
+    visit.first->second = depth;
+    }
+
+  this->AddWatch(dirname, depth);
+
+  // The path buffer is reused for every entry in the directory.
+  std::string fileString = dirname;
+  if (fileString.length() > 0 && fileString[fileString.length()-1] != '/')
+    {
+    fileString.push_back('/');
+    }
+  size_t pathLength = fileString.length();
+
+  struct dirent *dp;
+  while ((dp = readdir(dirp)) != 0)
+    {
+    if (dp->d_name[0] == '.')
+      {
+      continue;
+      }
+
+    // Use d_type if possible, otherwise stat relative to the directory
+    // (following symbolic links).
+    struct stat fs;
+    bool haveStat = false;
+    bool isDir = (dp->d_type == DT_DIR);
+    bool isFile = (dp->d_type == DT_REG);
+    if (!isDir && !isFile)
+      {
+      if (fstatat(fd, dp->d_name, &fs, 0) != 0)
+        {
+        continue;
+        }
+      haveStat = true;
+      isDir = S_ISDIR(fs.st_mode);
+      isFile = S_ISREG(fs.st_mode);
+      }
+
+    fileString.resize(pathLength);
+    fileString += dp->d_name;
+
+    if (isDir)
+      {
+      if (depth > 1)
+        {
+        subdirs.push_back(fileString);
+        }
+      }
+    else if (isFile && !rescan)
+      {
+      // Don't list the same file twice (e.g. because of links).
+      if ((haveStat || fstatat(fd, dp->d_name, &fs, 0) == 0) &&
+          this->Visited->Files.insert(
+            std::make_pair(fs.st_dev, fs.st_ino)).second)
+        {
+        dirFiles->InsertNextValue(fileString);
+        }
+      }
+    }
+
+  closedir(dirp);
+#else
   vtksys::Directory d;
   if (!d.Load(dirname))
     {
@@ -821,6 +1150,8 @@ void vtkDICOMDirectory::ProcessDirectory(
       }
     }
 
+  this->AddWatch(dirname, depth);
+
   unsigned long n = d.GetNumberOfFiles();
   for (unsigned long i = 0; i < n; i++)
     {
@@ -833,15 +1164,100 @@ void vtkDICOMDirectory::ProcessDirectory(
         {
         if (depth > 1)
           {
-          this->ProcessDirectory(fileString.c_str(), depth-1, files);
+          subdirs.push_back(fileString);
           }
         }
       else
         {
-        files->InsertNextValue(fileString);
+        dirFiles->InsertNextValue(fileString);
         }
       }
     }
+#endif
+
+  if (this->StreamList)
+    {
+    this->StreamDirectory(dirFiles, depth);
+    }
+
+  for (size_t i = 0; i < subdirs.size(); i++)
+    {
+    this->ProcessDirectory(subdirs[i].c_str(), depth-1, files);
+    }
+
+  if (this->StreamList)
+    {
+    this->StreamFinished(depth);
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMDirectory::StreamDirectory(vtkStringArray *files, int depth)
+{
+  SeriesInfoList *streamList = this->StreamList;
+
+  if (files->GetNumberOfValues() > 0)
+    {
+    if (!this->ParseFiles(files, streamList))
+      {
+      return;
+      }
+    }
+
+  // A series that has files in this directory is held until the scan
+  // leaves the parent directory, so that the files in the subdirectories
+  // and in the sibling directories are added to the same series.
+  for (SeriesInfoList::iterator li = streamList->begin();
+       li != streamList->end(); ++li)
+    {
+    if (li->Found)
+      {
+      li->Found = false;
+      li->Depth = (li->Depth > depth + 1 ? li->Depth : depth + 1);
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMDirectory::StreamFinished(int depth)
+{
+  SeriesInfoList *streamList = this->StreamList;
+
+  // Report the series that are held only until the scan leaves this
+  // depth, or report all of the series when the scan is complete.
+  SeriesInfoList finished;
+  SeriesInfoList::iterator li = streamList->begin();
+  while (li != streamList->end())
+    {
+    if (li->Depth <= depth || depth >= this->ScanDepth)
+      {
+      finished.splice(finished.end(), *streamList, li++);
+      }
+    else
+      {
+      ++li;
+      }
+    }
+
+  if (!finished.empty())
+    {
+    this->AddSortedSeries(&finished);
+    this->StreamOutput();
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMDirectory::StreamOutput()
+{
+  int n = this->GetNumberOfSeries();
+  for (int i = 0; i < n && !this->AbortExecute; i++)
+    {
+    this->InvokeEvent(SeriesCompleteEvent, &i);
+    }
+
+  this->Series->clear();
+  this->Studies->clear();
+  this->Patients->clear();
 }
 
 //----------------------------------------------------------------------------
@@ -851,6 +1267,15 @@ void vtkDICOMDirectory::Execute()
   this->Series->clear();
   this->Studies->clear();
   this->Patients->clear();
+#ifdef DICOM_USE_DIRENT
+  this->Visited->clear();
+#endif
+  if (this->Watch)
+    {
+    this->Watch->KnownFiles.clear();
+    this->Watch->PendingFiles.clear();
+    this->Watch->SeriesList.clear();
+    }
   delete [] this->FileSetID;
   this->FileSetID = 0;
   this->ErrorCode = 0;
@@ -873,9 +1298,17 @@ void vtkDICOMDirectory::Execute()
     return;
     }
 
+  // Streaming is not used in watch mode, which must keep every series.
+  SeriesInfoList streamList;
+  if (this->StreamSeries && !this->Watch)
+    {
+    this->StreamList = &streamList;
+    }
+
   vtkSmartPointer<vtkStringArray> files =
     vtkSmartPointer<vtkStringArray>::New();
   this->ProcessDirectory(this->DirectoryName, this->ScanDepth, files);
+  this->StreamList = 0;
 
   // Check for abort.
   if (!this->AbortExecute)
@@ -893,6 +1326,289 @@ void vtkDICOMDirectory::Execute()
     }
 }
 
+//----------------------------------------------------------------------------
+void vtkDICOMDirectory::StartWatch()
+{
+  this->StopWatch();
+  this->Watch = new WatchInfo;
+
+#ifdef DICOM_USE_INOTIFY
+  if (!this->WatchUsePolling)
+    {
+    this->Watch->Descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+#endif
+
+  // Do the initial scan, which also adds the directories to the watch.
+  this->AbortExecute = 0;
+  this->Execute();
+  this->UpdateTime.Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMDirectory::StopWatch()
+{
+  if (this->Watch)
+    {
+#ifdef DICOM_USE_INOTIFY
+    if (this->Watch->Descriptor >= 0)
+      {
+      close(this->Watch->Descriptor);
+      }
+#endif
+    delete this->Watch;
+    this->Watch = 0;
+    }
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMDirectory::GetWatching()
+{
+  return (this->Watch != 0);
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMDirectory::AddWatch(const char *dirname, int depth)
+{
+#ifdef DICOM_USE_INOTIFY
+  if (this->Watch && this->Watch->Descriptor >= 0)
+    {
+    int wd = inotify_add_watch(this->Watch->Descriptor, dirname,
+      IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+    if (wd >= 0)
+      {
+      this->Watch->Directories[wd] = std::make_pair(dirname, depth);
+      }
+    else
+      {
+      // Probably out of watches, so switch to polling.
+      close(this->Watch->Descriptor);
+      this->Watch->Descriptor = -1;
+      this->Watch->Directories.clear();
+      }
+    }
+#else
+  (void)dirname;
+  (void)depth;
+#endif
+}
+
+//----------------------------------------------------------------------------
+int vtkDICOMDirectory::PollWatch()
+{
+  if (this->Watch == 0)
+    {
+    return 0;
+    }
+
+  WatchInfo *watch = this->Watch;
+  vtkSmartPointer<vtkStringArray> files =
+    vtkSmartPointer<vtkStringArray>::New();
+  vtkSmartPointer<vtkStringArray> scanned =
+    vtkSmartPointer<vtkStringArray>::New();
+  bool usePolling = true;
+
+#ifdef DICOM_USE_INOTIFY
+  if (watch->Descriptor >= 0)
+    {
+    usePolling = false;
+
+    // Read all pending events, the descriptor is non-blocking.
+    union { struct inotify_event e; char c[4096]; } buffer;
+    ssize_t n;
+    while ((n = read(watch->Descriptor, buffer.c, sizeof(buffer))) > 0)
+      {
+      const char *cp = buffer.c;
+      const char *ep = cp + n;
+      while (cp < ep)
+        {
+        const struct inotify_event *event =
+          reinterpret_cast<const struct inotify_event *>(cp);
+        cp += sizeof(struct inotify_event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW)
+          {
+          // Events were lost, so do a full scan this time.
+          usePolling = true;
+          continue;
+          }
+
+        std::map<int, std::pair<std::string, int> >::iterator iter =
+          watch->Directories.find(event->wd);
+        if (iter == watch->Directories.end() ||
+            event->len == 0 || event->name[0] == '.')
+          {
+          continue;
+          }
+
+        std::string path = iter->second.first;
+        if (path.length() > 0 && path[path.length()-1] != '/')
+          {
+          path.push_back('/');
+          }
+        path += event->name;
+
+        if (event->mask & IN_ISDIR)
+          {
+          // Watch the new subdirectory, and get files already in it,
+          // which might still be being written.
+          if ((event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+              iter->second.second > 1)
+            {
+            this->ProcessDirectory(
+              path.c_str(), iter->second.second - 1, scanned);
+            }
+          }
+        else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+          {
+          files->InsertNextValue(path);
+          }
+        }
+      }
+    }
+#endif
+
+  if (usePolling)
+    {
+    // Scan for all files (also done if inotify events were lost).
+#ifdef DICOM_USE_DIRENT
+    this->Visited->clear();
+#endif
+    this->ProcessDirectory(this->DirectoryName, this->ScanDepth, scanned);
+    }
+
+  // Read the pending files whose size has not changed since the last poll,
+  // this is done whether or not polling is used.
+  std::map<std::string, WatchInfo::PendingFile>::iterator iter =
+    watch->PendingFiles.begin();
+  while (iter != watch->PendingFiles.end())
+    {
+    struct stat fs;
+    if (stat(iter->first.c_str(), &fs) != 0)
+      {
+      // The file was removed before it could be read.
+      watch->PendingFiles.erase(iter++);
+      }
+    else if (iter->second.Size == fs.st_size &&
+             iter->second.ModifiedTime == fs.st_mtime)
+      {
+      files->InsertNextValue(iter->first);
+      watch->PendingFiles.erase(iter++);
+      }
+    else
+      {
+      iter->second.Size = fs.st_size;
+      iter->second.ModifiedTime = fs.st_mtime;
+      ++iter;
+      }
+    }
+
+  // Scanned files that haven't been seen yet become pending.
+  vtkIdType n = scanned->GetNumberOfValues();
+  for (vtkIdType i = 0; i < n; i++)
+    {
+    const std::string& fname = scanned->GetValue(i);
+    if (watch->KnownFiles.find(fname) != watch->KnownFiles.end() ||
+        watch->PendingFiles.find(fname) != watch->PendingFiles.end())
+      {
+      continue;
+      }
+    struct stat fs;
+    if (stat(fname.c_str(), &fs) == 0)
+      {
+      WatchInfo::PendingFile& pending = watch->PendingFiles[fname];
+      pending.Size = fs.st_size;
+      pending.ModifiedTime = fs.st_mtime;
+      }
+    }
+
+  // Only read files that haven't been seen yet.
+  vtkSmartPointer<vtkStringArray> newFiles =
+    vtkSmartPointer<vtkStringArray>::New();
+  vtkIdType m = files->GetNumberOfValues();
+  for (vtkIdType j = 0; j < m; j++)
+    {
+    const std::string& fname = files->GetValue(j);
+    watch->PendingFiles.erase(fname);
+    if (watch->KnownFiles.insert(fname).second)
+      {
+      newFiles->InsertNextValue(fname);
+      }
+    }
+
+  int numberOfNewFiles = static_cast<int>(newFiles->GetNumberOfValues());
+  if (numberOfNewFiles > 0)
+    {
+    this->AbortExecute = 0;
+    this->ParseFiles(newFiles, &watch->SeriesList);
+    }
+
+  this->UpdateWatchedSeries(numberOfNewFiles > 0, true);
+
+  return numberOfNewFiles;
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMDirectory::UpdateWatchedSeries(bool changed, bool notify)
+{
+  WatchInfo *watch = this->Watch;
+
+  if (changed)
+    {
+    // Rebuild the output, this is fast because no files are read.
+    this->Series->clear();
+    this->Studies->clear();
+    this->Patients->clear();
+    this->AddSortedSeries(&watch->SeriesList);
+    this->Modified();
+    this->UpdateTime.Modified();
+    }
+
+  time_t now = time(NULL);
+  int n = this->GetNumberOfSeries();
+  for (int i = 0; i < n; i++)
+    {
+    const SeriesItem& item = (*this->Series)[i];
+    std::string uid =
+      item.Record.GetAttributeValue(DC::SeriesInstanceUID).AsString();
+    vtkIdType m = item.Files->GetNumberOfValues();
+
+    std::map<std::string, WatchInfo::SeriesState>::iterator iter =
+      watch->SeriesStates.find(uid);
+    if (iter == watch->SeriesStates.end())
+      {
+      WatchInfo::SeriesState& state = watch->SeriesStates[uid];
+      state.NumberOfFiles = m;
+      state.LastChange = now;
+      state.Complete = false;
+      if (notify)
+        {
+        this->InvokeEvent(SeriesAddedEvent, &i);
+        }
+      }
+    else if (iter->second.NumberOfFiles != m)
+      {
+      iter->second.NumberOfFiles = m;
+      iter->second.LastChange = now;
+      iter->second.Complete = false;
+      if (notify)
+        {
+        this->InvokeEvent(SeriesModifiedEvent, &i);
+        }
+      }
+    else if (!iter->second.Complete &&
+             difftime(now, iter->second.LastChange) >=
+               this->SeriesCompleteDelay)
+      {
+      iter->second.Complete = true;
+      if (notify)
+        {
+        this->InvokeEvent(SeriesCompleteEvent, &i);
+        }
+      }
+    }
+}
+
 //----------------------------------------------------------------------------
 void vtkDICOMDirectory::Update(int)
 {
@@ -15,6 +15,7 @@
 #define __vtkDICOMDirectory_h
 
 #include <vtkAlgorithm.h>
+#include <vtkCommand.h>
 #include "vtkDICOMModule.h"
 
 class vtkStringArray;
@@ -36,6 +37,19 @@ public:
   void PrintSelf(ostream& os, vtkIndent indent);
   static vtkDICOMDirectory *New();
 
+  //! Events that are invoked in watch mode.
+  /*!
+   *  The call data for each of these events is a pointer to an int
+   *  that gives the index of the series.  The indices of existing
+   *  series might change when a new series is added.
+   */
+  enum EventIds
+  {
+    SeriesAddedEvent = vtkCommand::UserEvent + 301,
+    SeriesModifiedEvent,
+    SeriesCompleteEvent
+  };
+
   //! Set the input directory.
   /*!
    *  Set the input directory.  If it has a DICOMDIR file, then that
@@ -56,6 +70,18 @@ public:
   vtkSetMacro(ScanDepth, int);
   int GetScanDepth() { return this->ScanDepth; }
 
+  //! Set a query, so that only matching files will be returned.
+  /*!
+   *  The query is an item that contains the attributes to match, using
+   *  the rules described in vtkDICOMValue::Matches().  The query is
+   *  given to the parser, which stops reading any file that cannot
+   *  match.  If the directory has a DICOMDIR file, then the query is
+   *  checked against the patient, study, and series records, and any
+   *  query attributes that are not present in these records are ignored.
+   */
+  void SetFindQuery(const vtkDICOMItem& query);
+  const vtkDICOMItem& GetFindQuery() { return *this->Query; }
+
   //! Update the information about the files.
   /*!
    * This method causes the directory to be read.  It must be called before
@@ -64,6 +90,69 @@ public:
   virtual void Update() { this->Update(0); }
   virtual void Update(int);
 
+  //! Start watching the directory for new files.
+  /*!
+   *  This scans the directory, like Update(), and then begins to watch
+   *  the directory (and its subdirectories, to the ScanDepth) for new
+   *  files.  A DICOMDIR file, if present, is ignored in watch mode.
+   *  On Linux, inotify is used to watch for new files, and on other
+   *  systems (or if inotify is not available) the directory is polled.
+   */
+  void StartWatch();
+
+  //! Stop watching the directory.
+  void StopWatch();
+
+  //! Check whether the directory is being watched.
+  bool GetWatching();
+
+  //! Read any files that have arrived since the last check.
+  /*!
+   *  This should be called periodically, e.g. from a timer in the
+   *  application's event loop.  It reads only the new files, updates
+   *  the series, study, and patient information, and invokes a
+   *  SeriesAddedEvent or SeriesModifiedEvent for each series that has
+   *  changed.  It also invokes a SeriesCompleteEvent for each series
+   *  that has not received any new files for SeriesCompleteDelay
+   *  seconds.  The return value is the number of new files.
+   */
+  int PollWatch();
+
+  //! Set the time after which a series is considered to be complete.
+  /*!
+   *  The default is 10 seconds.
+   */
+  vtkSetMacro(SeriesCompleteDelay, double);
+  double GetSeriesCompleteDelay() { return this->SeriesCompleteDelay; }
+
+  //! Always use polling, instead of inotify, in watch mode.
+  /*!
+   *  Polling must be used for network filesystems, since inotify does
+   *  not report changes made by other hosts.  With polling, a new file
+   *  is not read until its size has stopped changing between polls.
+   */
+  vtkSetMacro(WatchUsePolling, int);
+  vtkBooleanMacro(WatchUsePolling, int);
+  int GetWatchUsePolling() { return this->WatchUsePolling; }
+
+  //! Report each series as soon as the scan is finished with it.
+  /*!
+   *  When this is on, Update() invokes a SeriesCompleteEvent for each
+   *  series as soon as the scan leaves the parent of the directories in
+   *  which the series was found, so that the series can be used while
+   *  the rest of the tree is still being scanned.  Each series is reported
+   *  once, with all of its files, if its files are in one directory, in
+   *  a directory and its subdirectories, or in sibling directories.  Only
+   *  a series whose files are farther apart in the tree is reported more
+   *  than once.  During the event, the output holds only the series that
+   *  are being reported, and the output is empty after Update() returns.
+   *  This bounds the memory used by the scan to the files in one directory
+   *  subtree.  This is ignored in watch mode.
+   */
+  vtkSetMacro(StreamSeries, int);
+  vtkBooleanMacro(StreamSeries, int);
+  int GetStreamSeries() { return this->StreamSeries; }
+
   //! Get the total number of series that were found.
   int GetNumberOfSeries();
 
@@ -127,6 +216,9 @@ protected:
   const char *DirectoryName;
   int RequirePixelData;
   int ScanDepth;
+  double SeriesCompleteDelay;
+  int WatchUsePolling;
+  int StreamSeries;
 
   vtkTimeStamp UpdateTime;
   char *InternalFileName;
@@ -159,6 +251,12 @@ protected:
     const vtkDICOMItem& studyRecord,
     const vtkDICOMItem& seriesRecord);
 
+  //! Check the query against the records from a DICOMDIR file.
+  bool MatchesQuery(
+    const vtkDICOMItem& patientRecord,
+    const vtkDICOMItem& studyRecord,
+    const vtkDICOMItem& seriesRecord);
+
   //! Convert parser errors into sorter errors.
   void RelayError(vtkObject *o, unsigned long e, void *data);
 
@@ -181,6 +279,34 @@ protected:
   void ProcessDirectory(
     const char *dirname, int depth, vtkStringArray *files);
 
+  //! Parse the files from one directory (for streaming).
+  /*!
+   *  This is called before the subdirectories are scanned.  Each series
+   *  that has files in the directory will be held until the scan leaves
+   *  the parent directory.
+   */
+  void StreamDirectory(vtkStringArray *files, int depth);
+
+  //! Report the series that are complete when leaving a directory.
+  /*!
+   *  This reports and removes all of the series that were held until
+   *  the scan left the given depth, or all series at the top level.
+   */
+  void StreamFinished(int depth);
+
+  //! Invoke SeriesCompleteEvent for each series, then clear the output.
+  void StreamOutput();
+
+  //! Add a directory to the watch list (for watch mode).
+  void AddWatch(const char *dirname, int depth);
+
+  //! Rebuild the series from the files that are being watched.
+  /*!
+   *  If "notify" is set, then this also invokes the watch events for
+   *  series that are new, modified, or complete.
+   */
+  void UpdateWatchedSeries(bool changed, bool notify);
+
 private:
   vtkDICOMDirectory(const vtkDICOMDirectory&);  // Not implemented.
   void operator=(const vtkDICOMDirectory&);  // Not implemented.
@@ -194,12 +320,24 @@ private:
   struct FileInfo;
   struct SeriesInfo;
   class SeriesInfoList;
+  class VisitedSet;
+  class WatchInfo;
 
   SeriesVector *Series;
   StudyVector *Studies;
   PatientVector *Patients;
+  VisitedSet *Visited;
+  WatchInfo *Watch;
+  SeriesInfoList *StreamList;
+  vtkDICOMItem *Query;
   char *FileSetID;
 
+  //! Parse the files and insert them into a sorted list of series.
+  bool ParseFiles(vtkStringArray *input, SeriesInfoList *sortedFiles);
+
+  //! Add the sorted list of series to the output.
+  void AddSortedSeries(SeriesInfoList *sortedFiles);
+
   //! Compare FileInfo entries by instance number
   static bool CompareInstance(const FileInfo &fi1, const FileInfo &fi2);
 };
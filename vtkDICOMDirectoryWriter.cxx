@@ -0,0 +1,541 @@
+/*=========================================================================
+
+  Program: DICOM for VTK
+
+  Copyright (c) 2012-2014 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+#include "vtkDICOMDirectoryWriter.h"
+#include "vtkDICOMDirectory.h"
+#include "vtkDICOMCompiler.h"
+#include "vtkDICOMParser.h"
+#include "vtkDICOMMetaData.h"
+#include "vtkDICOMDictionary.h"
+#include "vtkDICOMSequence.h"
+#include "vtkDICOMItem.h"
+#include "vtkDICOMUtilities.h"
+
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkStringArray.h>
+#include <vtkErrorCode.h>
+#include <vtkUnsignedShortArray.h>
+
+#include <vtksys/SystemTools.hxx>
+
+vtkStandardNewMacro(vtkDICOMDirectoryWriter);
+
+//----------------------------------------------------------------------------
+// A record in the DICOMDIR, with links to other records.
+
+struct vtkDICOMDirectoryWriter::RecordInfo
+{
+  vtkDICOMItem Item;
+  int Next;
+  int Child;
+};
+
+//----------------------------------------------------------------------------
+// A vector of records, in the order that they will be written.
+
+class vtkDICOMDirectoryWriter::RecordVector
+  : public std::vector<vtkDICOMDirectoryWriter::RecordInfo>
+{
+public:
+  // The most recent record at each depth.
+  std::vector<int> LastAtDepth;
+};
+
+//----------------------------------------------------------------------------
+namespace {
+
+// The keys that must be present in each type of record.
+const DC::EnumType PatientKeys[] = {
+  DC::PatientName,
+  DC::PatientID,
+  DC::ItemDelimitationItem
+};
+
+const DC::EnumType StudyKeys[] = {
+  DC::StudyDate,
+  DC::StudyTime,
+  DC::AccessionNumber,
+  DC::StudyDescription,
+  DC::StudyInstanceUID,
+  DC::StudyID,
+  DC::ItemDelimitationItem
+};
+
+const DC::EnumType SeriesKeys[] = {
+  DC::Modality,
+  DC::SeriesInstanceUID,
+  DC::SeriesNumber,
+  DC::ItemDelimitationItem
+};
+
+// Copy the keys from a directory record, add empty values for any
+// required keys that are missing.
+void vtkDICOMDirectoryWriterCopyKeys(
+  vtkDICOMItem *item, const vtkDICOMItem& record, const DC::EnumType *tag)
+{
+  vtkDICOMDataElementIterator iter = record.Begin();
+  vtkDICOMDataElementIterator iterEnd = record.End();
+  while (iter != iterEnd)
+    {
+    // skip the links from the original DICOMDIR, if present
+    if (iter->GetTag().GetGroup() != 0x0004 && iter->GetValue().IsValid())
+      {
+      item->SetAttributeValue(iter->GetTag(), iter->GetValue());
+      }
+    ++iter;
+    }
+
+  while (*tag != DC::ItemDelimitationItem)
+    {
+    if (!item->GetAttributeValue(*tag).IsValid())
+      {
+      vtkDICOMVR vr = vtkDICOMDictionary::FindDictEntry(*tag).GetVR();
+      item->SetAttributeValue(*tag, vtkDICOMValue(vr));
+      }
+    tag++;
+    }
+}
+
+// Check that a component of a File ID uses only the characters and
+// the length that are permitted by the DICOM standard.
+bool vtkDICOMDirectoryWriterIsConforming(const std::string& s)
+{
+  size_t n = s.length();
+  if (n == 0 || n > 8)
+    {
+    return false;
+    }
+  for (size_t i = 0; i < n; i++)
+    {
+    char c = s[i];
+    if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+} // end anonymous namespace
+
+//----------------------------------------------------------------------------
+vtkDICOMDirectoryWriter::vtkDICOMDirectoryWriter()
+{
+  this->Directory = 0;
+  this->FileName = 0;
+  this->FileSetID = 0;
+  this->ErrorCode = 0;
+  this->Records = new RecordVector;
+  this->NonConformingFileIDs = false;
+}
+
+//----------------------------------------------------------------------------
+vtkDICOMDirectoryWriter::~vtkDICOMDirectoryWriter()
+{
+  if (this->Directory)
+    {
+    this->Directory->Delete();
+    }
+
+  delete [] this->FileName;
+  delete [] this->FileSetID;
+  delete this->Records;
+}
+
+//----------------------------------------------------------------------------
+vtkCxxSetObjectMacro(vtkDICOMDirectoryWriter, Directory, vtkDICOMDirectory);
+
+//----------------------------------------------------------------------------
+void vtkDICOMDirectoryWriter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "Directory: " << this->Directory << "\n";
+  os << indent << "FileName: "
+     << (this->FileName ? this->FileName : "(NULL)") << "\n";
+  os << indent << "FileSetID: "
+     << (this->FileSetID ? this->FileSetID : "(NULL)") << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMDirectoryWriter::AddRecord(
+  const char *recordType, const vtkDICOMItem& keys, int depth)
+{
+  RecordVector *records = this->Records;
+  int idx = static_cast<int>(records->size());
+
+  RecordInfo record;
+  record.Item = keys;
+  record.Item.SetAttributeValue(
+    DC::DirectoryRecordType, vtkDICOMValue(vtkDICOMVR::CS, recordType));
+  record.Next = -1;
+  record.Child = -1;
+  records->push_back(record);
+
+  // Adding a record at a given depth ends the lists at deeper levels,
+  // so if there is a record at this depth, it has the same parent.
+  std::vector<int>& lastAtDepth = records->LastAtDepth;
+  lastAtDepth.resize(depth + 1, -1);
+  if (lastAtDepth[depth] >= 0)
+    {
+    (*records)[lastAtDepth[depth]].Next = idx;
+    }
+  else if (depth > 0 && lastAtDepth[depth - 1] >= 0)
+    {
+    (*records)[lastAtDepth[depth - 1]].Child = idx;
+    }
+  lastAtDepth[depth] = idx;
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMDirectoryWriter::AddImageRecords(
+  vtkStringArray *files, const std::vector<std::string>& dirpath)
+{
+  vtkSmartPointer<vtkDICOMParser> parser =
+    vtkSmartPointer<vtkDICOMParser>::New();
+  vtkSmartPointer<vtkDICOMMetaData> meta =
+    vtkSmartPointer<vtkDICOMMetaData>::New();
+  vtkSmartPointer<vtkUnsignedShortArray> groups =
+    vtkSmartPointer<vtkUnsignedShortArray>::New();
+
+  // Group 0x0002 is always read, it has the UIDs for the file.
+  groups->InsertNextValue(0x0008); // For the SOP Class and Instance.
+  groups->InsertNextValue(0x0020); // For the InstanceNumber.
+  parser->SetMetaData(meta);
+  parser->SetGroups(groups);
+
+  vtkIdType n = files->GetNumberOfValues();
+  for (vtkIdType i = 0; i < n; i++)
+    {
+    const std::string& fileName = files->GetValue(i);
+
+    // The File ID is the path relative to the DICOMDIR.
+    std::vector<std::string> path;
+    vtksys::SystemTools::SplitPath(
+      vtksys::SystemTools::CollapseFullPath(fileName), path);
+    size_t m = dirpath.size();
+    bool inDirectory = (path.size() > m);
+    for (size_t j = 0; j < m && inDirectory; j++)
+      {
+      inDirectory = (path[j] == dirpath[j]);
+      }
+    if (!inDirectory)
+      {
+      this->SetErrorCode(vtkErrorCode::FileFormatError);
+      vtkErrorMacro("The file " << fileName << " is not in the directory"
+                    " that contains the DICOMDIR, it was not added.");
+      continue;
+      }
+
+    std::string fileID;
+    bool validID = true;
+    this->NonConformingFileIDs |= (path.size() - m > 8);
+    for (size_t k = m; k < path.size(); k++)
+      {
+      // A backslash would split the component into two values.
+      validID &= (path[k].find('\\') == std::string::npos);
+      this->NonConformingFileIDs |=
+        !vtkDICOMDirectoryWriterIsConforming(path[k]);
+      if (k != m)
+        {
+        fileID += "\\";
+        }
+      fileID += path[k];
+      }
+    if (!validID)
+      {
+      this->SetErrorCode(vtkErrorCode::FileFormatError);
+      vtkErrorMacro("The file name " << fileName << " contains a"
+                    " backslash, it was not added to the DICOMDIR.");
+      continue;
+      }
+
+    // Read the UIDs and the InstanceNumber from the file.
+    meta->Initialize();
+    parser->SetFileName(fileName.c_str());
+    parser->Update();
+    if (parser->GetErrorCode())
+      {
+      this->SetErrorCode(parser->GetErrorCode());
+      continue;
+      }
+
+    std::string classUID =
+      meta->GetAttributeValue(DC::MediaStorageSOPClassUID).AsString();
+    if (classUID == "")
+      {
+      classUID = meta->GetAttributeValue(DC::SOPClassUID).AsString();
+      }
+    std::string instanceUID =
+      meta->GetAttributeValue(DC::MediaStorageSOPInstanceUID).AsString();
+    if (instanceUID == "")
+      {
+      instanceUID = meta->GetAttributeValue(DC::SOPInstanceUID).AsString();
+      }
+    std::string syntaxUID =
+      meta->GetAttributeValue(DC::TransferSyntaxUID).AsString();
+    if (syntaxUID == "")
+      {
+      syntaxUID = "1.2.840.10008.1.2";
+      }
+
+    vtkDICOMItem keys;
+    keys.SetAttributeValue(
+      DC::ReferencedFileID, vtkDICOMValue(vtkDICOMVR::CS, fileID));
+    keys.SetAttributeValue(
+      DC::ReferencedSOPClassUIDInFile,
+      vtkDICOMValue(vtkDICOMVR::UI, classUID));
+    keys.SetAttributeValue(
+      DC::ReferencedSOPInstanceUIDInFile,
+      vtkDICOMValue(vtkDICOMVR::UI, instanceUID));
+    keys.SetAttributeValue(
+      DC::ReferencedTransferSyntaxUIDInFile,
+      vtkDICOMValue(vtkDICOMVR::UI, syntaxUID));
+    keys.SetAttributeValue(
+      DC::InstanceNumber,
+      vtkDICOMValue(vtkDICOMVR::IS,
+        meta->GetAttributeValue(DC::InstanceNumber).AsString()));
+
+    this->AddRecord("IMAGE", keys, 3);
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMDirectoryWriter::BuildRecords(
+  const std::vector<std::string>& dirpath)
+{
+  vtkDICOMDirectory *d = this->Directory;
+
+  int numberOfPatients = d->GetNumberOfPatients();
+  for (int patient = 0; patient < numberOfPatients; patient++)
+    {
+    vtkDICOMItem patientKeys;
+    vtkDICOMDirectoryWriterCopyKeys(
+      &patientKeys, d->GetPatientRecord(patient), PatientKeys);
+    this->AddRecord("PATIENT", patientKeys, 0);
+
+    int firstStudy = d->GetFirstStudyForPatient(patient);
+    int lastStudy = d->GetLastStudyForPatient(patient);
+    for (int study = firstStudy; study <= lastStudy; study++)
+      {
+      vtkDICOMItem studyKeys;
+      vtkDICOMDirectoryWriterCopyKeys(
+        &studyKeys, d->GetStudyRecord(study), StudyKeys);
+      this->AddRecord("STUDY", studyKeys, 1);
+
+      int firstSeries = d->GetFirstSeriesForStudy(study);
+      int lastSeries = d->GetLastSeriesForStudy(study);
+      for (int series = firstSeries; series <= lastSeries; series++)
+        {
+        vtkDICOMItem seriesKeys;
+        vtkDICOMDirectoryWriterCopyKeys(
+          &seriesKeys, d->GetSeriesRecord(series), SeriesKeys);
+        this->AddRecord("SERIES", seriesKeys, 2);
+
+        this->AddImageRecords(d->GetFileNamesForSeries(series), dirpath);
+        }
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMDirectoryWriter::WriteDirectoryFile(
+  const char *fname, const char *instanceUID,
+  const std::vector<unsigned int>& offsets)
+{
+  RecordVector *records = this->Records;
+  unsigned int n = static_cast<unsigned int>(records->size());
+
+  vtkSmartPointer<vtkDICOMMetaData> meta =
+    vtkSmartPointer<vtkDICOMMetaData>::New();
+
+  // The Media Storage Directory Storage SOP Class.
+  meta->SetAttributeValue(
+    DC::MediaStorageSOPClassUID, "1.2.840.10008.1.3.10");
+  meta->SetAttributeValue(
+    DC::FileSetID,
+    vtkDICOMValue(vtkDICOMVR::CS, (this->FileSetID ? this->FileSetID : "")));
+
+  unsigned int firstOffset = 0;
+  unsigned int lastOffset = 0;
+  if (n > 0)
+    {
+    firstOffset = offsets[0];
+    lastOffset = offsets[records->LastAtDepth[0]];
+    }
+  meta->SetAttributeValue(
+    DC::OffsetOfTheFirstDirectoryRecordOfTheRootDirectoryEntity,
+    vtkDICOMValue(vtkDICOMVR::UL, firstOffset));
+  meta->SetAttributeValue(
+    DC::OffsetOfTheLastDirectoryRecordOfTheRootDirectoryEntity,
+    vtkDICOMValue(vtkDICOMVR::UL, lastOffset));
+  meta->SetAttributeValue(
+    DC::FileSetConsistencyFlag, vtkDICOMValue(vtkDICOMVR::US, 0));
+
+  vtkDICOMSequence seq(n);
+  for (unsigned int i = 0; i < n; i++)
+    {
+    const RecordInfo& record = (*records)[i];
+    unsigned int nextOffset = 0;
+    unsigned int childOffset = 0;
+    if (record.Next >= 0)
+      {
+      nextOffset = offsets[record.Next];
+      }
+    if (record.Child >= 0)
+      {
+      childOffset = offsets[record.Child];
+      }
+
+    vtkDICOMItem item;
+    item.SetAttributeValue(
+      DC::OffsetOfTheNextDirectoryRecord,
+      vtkDICOMValue(vtkDICOMVR::UL, nextOffset));
+    item.SetAttributeValue(
+      DC::RecordInUseFlag, vtkDICOMValue(vtkDICOMVR::US, 0xFFFF));
+    item.SetAttributeValue(
+      DC::OffsetOfReferencedLowerLevelDirectoryEntity,
+      vtkDICOMValue(vtkDICOMVR::UL, childOffset));
+
+    vtkDICOMDataElementIterator iter = record.Item.Begin();
+    vtkDICOMDataElementIterator iterEnd = record.Item.End();
+    while (iter != iterEnd)
+      {
+      item.SetAttributeValue(iter->GetTag(), iter->GetValue());
+      ++iter;
+      }
+
+    seq.SetItem(i, item);
+    }
+  meta->SetAttributeValue(DC::DirectoryRecordSequence, seq);
+
+  vtkSmartPointer<vtkDICOMCompiler> compiler =
+    vtkSmartPointer<vtkDICOMCompiler>::New();
+  compiler->SetFileName(fname);
+  compiler->SetSOPInstanceUID(instanceUID);
+  compiler->SetMetaData(meta);
+  compiler->WriteHeader();
+  compiler->Close();
+
+  if (compiler->GetErrorCode())
+    {
+    this->SetErrorCode(compiler->GetErrorCode());
+    return false;
+    }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMDirectoryWriter::Write()
+{
+  this->SetErrorCode(vtkErrorCode::NoError);
+  this->Records->clear();
+  this->Records->LastAtDepth.clear();
+  this->NonConformingFileIDs = false;
+
+  if (this->Directory == 0)
+    {
+    this->SetErrorCode(vtkErrorCode::UnknownError);
+    vtkErrorMacro("Write: No directory has been set.");
+    return;
+    }
+
+  std::string fname;
+  if (this->FileName)
+    {
+    fname = this->FileName;
+    }
+  else if (this->Directory->GetDirectoryName())
+    {
+    std::vector<std::string> path;
+    vtksys::SystemTools::SplitPath(
+      this->Directory->GetDirectoryName(), path);
+    if (path.size() > 0 && path.back() == "")
+      {
+      path.pop_back();
+      }
+    path.push_back("DICOMDIR");
+    fname = vtksys::SystemTools::JoinPath(path);
+    }
+  else
+    {
+    this->SetErrorCode(vtkErrorCode::NoFileNameError);
+    vtkErrorMacro("Write: No file name has been set.");
+    return;
+    }
+
+  // The directory that contains the DICOMDIR is the root of the file set.
+  std::vector<std::string> dirpath;
+  vtksys::SystemTools::SplitPath(
+    vtksys::SystemTools::GetFilenamePath(
+      vtksys::SystemTools::CollapseFullPath(fname)), dirpath);
+  if (dirpath.size() > 0 && dirpath.back() == "")
+    {
+    dirpath.pop_back();
+    }
+
+  this->BuildRecords(dirpath);
+
+  // Write the file with zero offsets, and then read the offsets back.
+  std::string instanceUID =
+    vtkDICOMUtilities::GenerateUID(DC::MediaStorageSOPInstanceUID);
+  std::vector<unsigned int> offsets(this->Records->size(), 0);
+  if (!this->WriteDirectoryFile(fname.c_str(), instanceUID.c_str(), offsets))
+    {
+    return;
+    }
+
+  vtkSmartPointer<vtkDICOMParser> parser =
+    vtkSmartPointer<vtkDICOMParser>::New();
+  vtkSmartPointer<vtkDICOMMetaData> meta =
+    vtkSmartPointer<vtkDICOMMetaData>::New();
+  parser->SetMetaData(meta);
+  parser->SetFileName(fname.c_str());
+  parser->Update();
+  if (parser->GetErrorCode())
+    {
+    this->SetErrorCode(parser->GetErrorCode());
+    return;
+    }
+
+  const vtkDICOMValue& seq =
+    meta->GetAttributeValue(DC::DirectoryRecordSequence);
+  const vtkDICOMItem *items = seq.GetSequenceData();
+  size_t n = seq.GetNumberOfValues();
+  if (n != offsets.size())
+    {
+    this->SetErrorCode(vtkErrorCode::FileFormatError);
+    vtkErrorMacro("Write: The records in " << fname
+                  << " could not be read back.");
+    return;
+    }
+  for (size_t i = 0; i < n; i++)
+    {
+    offsets[i] = items[i].GetByteOffset();
+    }
+
+  if (!this->WriteDirectoryFile(fname.c_str(), instanceUID.c_str(), offsets))
+    {
+    return;
+    }
+
+  if (this->NonConformingFileIDs)
+    {
+    vtkWarningMacro("Some of the file names in " << fname << " do not"
+                    " conform to DICOM, which requires up to eight levels"
+                    " of names with up to eight characters, and permits"
+                    " only upper case letters, digits, and underscores.");
+    }
+}
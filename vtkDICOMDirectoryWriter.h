@@ -0,0 +1,131 @@
+/*=========================================================================
+
+  Program: DICOM for VTK
+
+  Copyright (c) 2012-2014 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+#ifndef __vtkDICOMDirectoryWriter_h
+#define __vtkDICOMDirectoryWriter_h
+
+#include <vtkObject.h>
+#include "vtkDICOMModule.h"
+
+#include <string>
+#include <vector>
+
+class vtkStringArray;
+class vtkDICOMDirectory;
+class vtkDICOMItem;
+
+//! Write a DICOMDIR file for a directory of DICOM files.
+/*!
+ *  Given a vtkDICOMDirectory that has already been updated, this class
+ *  writes a DICOMDIR file that lists all of the patients, studies, series,
+ *  and images that were found.  When the directory is scanned again, the
+ *  DICOMDIR file will be read instead of the individual DICOM files, which
+ *  is much faster.  The DICOMDIR can only reference files that are in the
+ *  same directory as the DICOMDIR file, or in its subdirectories.
+ */
+class VTK_DICOM_EXPORT vtkDICOMDirectoryWriter : public vtkObject
+{
+public:
+  //! Create a new vtkDICOMDirectoryWriter instance.
+  static vtkDICOMDirectoryWriter *New();
+
+  //! VTK dynamic type information macro.
+  vtkTypeMacro(vtkDICOMDirectoryWriter, vtkObject);
+
+  //! Print a summary of the contents of this object.
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  //! Set the directory object that provides the series to write.
+  /*!
+   *  The Update() method of the directory must be called before the
+   *  DICOMDIR file is written.
+   */
+  void SetDirectory(vtkDICOMDirectory *directory);
+  vtkDICOMDirectory *GetDirectory() { return this->Directory; }
+
+  //! Set the name of the DICOMDIR file to write.
+  /*!
+   *  If this is not set, then a file named DICOMDIR will be written
+   *  to the DirectoryName of the directory object.
+   */
+  vtkSetStringMacro(FileName);
+  vtkGetStringMacro(FileName);
+
+  //! Set the File-set ID, which is an optional name for the file set.
+  /*!
+   *  The name can be up to 16 characters long, and should contain only
+   *  upper case letters, digits, the underscore, and the space.
+   */
+  vtkSetStringMacro(FileSetID);
+  vtkGetStringMacro(FileSetID);
+
+  //! Write the DICOMDIR file.
+  virtual void Write();
+
+  //! Get the IO error code.
+  unsigned long GetErrorCode() { return this->ErrorCode; }
+
+protected:
+  vtkDICOMDirectoryWriter();
+  ~vtkDICOMDirectoryWriter();
+
+  //! Set the error code.
+  void SetErrorCode(unsigned long e) { this->ErrorCode = e; }
+
+  //! Add the records for all of the patients in the directory.
+  /*!
+   *  The records are added to the list in the order in which they
+   *  will appear in the file, and the links between the records are
+   *  stored so that the byte offsets can be set after the records
+   *  have been written.
+   */
+  void BuildRecords(const std::vector<std::string>& dirpath);
+
+  //! Add the image records for the files in one series.
+  void AddImageRecords(
+    vtkStringArray *files, const std::vector<std::string>& dirpath);
+
+  //! Add one record, and link it to its parent or its previous sibling.
+  void AddRecord(const char *recordType, const vtkDICOMItem& keys,
+                 int depth);
+
+  //! Write the DICOMDIR, using the byte offsets that are provided.
+  /*!
+   *  The offsets are the positions of the records within the file, as
+   *  measured from the beginning of the file.  Since the offsets are not
+   *  known until the file has been written once, the file is written with
+   *  all offsets set to zero and then read back to get the offsets, and
+   *  is then written again.  The size of each record does not depend on
+   *  the values of its offsets, so the second write does not move them.
+   */
+  bool WriteDirectoryFile(
+    const char *fname, const char *instanceUID,
+    const std::vector<unsigned int>& offsets);
+
+  vtkDICOMDirectory *Directory;
+  char *FileName;
+  char *FileSetID;
+  unsigned long ErrorCode;
+
+private:
+  vtkDICOMDirectoryWriter(const vtkDICOMDirectoryWriter&);  // Not implemented.
+  void operator=(const vtkDICOMDirectoryWriter&);  // Not implemented.
+
+  struct RecordInfo;
+  class RecordVector;
+
+  RecordVector *Records;
+  bool NonConformingFileIDs;
+};
+
+#endif /* __vtkDICOMDirectoryWriter_h */
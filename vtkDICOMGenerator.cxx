@@ -28,10 +28,16 @@
 #include "vtkStreamingDemandDrivenPipeline.h"
 #include "vtkDataSetAttributes.h"
 #include "vtkSmartPointer.h"
+#include "vtkMultiThreader.h"
+#include "vtkTemplateAliasMacro.h"
+#include "vtkTypeTraits.h"
 
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#include <vector>
+
 vtkCxxSetObjectMacro(vtkDICOMGenerator,PatientMatrix,vtkMatrix4x4);
 vtkCxxSetObjectMacro(vtkDICOMGenerator,MetaData,vtkDICOMMetaData);
 
@@ -51,6 +57,7 @@ vtkDICOMGenerator::vtkDICOMGenerator()
   this->TimeSpacing = 1.0;
   this->RescaleIntercept = 0.0;
   this->RescaleSlope = 1.0;
+  this->NumberOfThreads = 1;
   this->PatientMatrix = 0;
   this->SliceIndexArray = vtkIntArray::New();
   this->ComponentIndexArray = vtkIntArray::New();
@@ -144,6 +151,7 @@ void vtkDICOMGenerator::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "TimeSpacing: " << this->TimeSpacing << "\n";
   os << indent << "RescaleIntercept: " << this->RescaleIntercept << "\n";
   os << indent << "RescaleSlope: " << this->RescaleSlope << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
 
   os << indent << "PatientMatrix:";
   if (this->PatientMatrix)
@@ -372,7 +380,7 @@ void vtkDICOMGenerator::ComputeDimensions(
 }
 
 //----------------------------------------------------------------------------
-void vtkDICOMGenerator::MatchInstances(vtkDICOMMetaData *meta)
+void vtkDICOMGenerator::MatchInstances(vtkDICOMMetaData *vtkNotUsed(meta))
 {
   if (this->SourceInstanceArray)
     {
@@ -421,9 +429,14 @@ void vtkDICOMGenerator::MatchInstances(vtkDICOMMetaData *meta)
     return;
     }
 
+  // match every frame, whether it is in its own file or in a multi-frame
+  // file, so that the array has one entry per frame
+  int n = static_cast<int>(this->SliceIndexArray->GetNumberOfTuples()*
+                           this->SliceIndexArray->GetNumberOfComponents());
+
   this->SourceInstanceArray = vtkIntArray::New();
   this->SourceInstanceArray->SetNumberOfComponents(1);
-  this->SourceInstanceArray->SetNumberOfTuples(meta->GetNumberOfInstances());
+  this->SourceInstanceArray->SetNumberOfTuples(n);
 
   int timeSlices = 1;
   if (!this->TimeAsVector && this->Dimensions[3] > 0)
@@ -438,11 +451,10 @@ void vtkDICOMGenerator::MatchInstances(vtkDICOMMetaData *meta)
     usedInstances[j] = false;
     }
 
-  int n = meta->GetNumberOfInstances();
   double zorigin = origin[2];
   for (int i = 0; i < n && !mismatch; i++)
     {
-    int sliceIdx = this->SliceIndexArray->GetComponent(i, 0);
+    int sliceIdx = this->SliceIndexArray->GetValue(i);
     // remove the time from the slice index
     sliceIdx /= timeSlices;
     origin[2] = zorigin + sliceIdx*spacing[2];
@@ -534,29 +546,204 @@ void vtkDICOMGeneratorComputeHistogram(
     }
 }
 
+// Compute the min/max over the values, the loops are kept simple so
+// that the compiler can vectorize them.
+template<class T>
+void vtkDICOMGeneratorComputeRange(
+  const T *ptr, vtkIdType n, int nComponents, int totalComponents,
+  double range[2])
+{
+  T minVal = vtkTypeTraits<T>::Max();
+  T maxVal = vtkTypeTraits<T>::Min();
+  if (nComponents == totalComponents)
+    {
+    for (vtkIdType i = 0; i < n; i++)
+      {
+      T v = ptr[i];
+      minVal = (v < minVal ? v : minVal);
+      maxVal = (v > maxVal ? v : maxVal);
+      }
+    }
+  else
+    {
+    for (vtkIdType i = 0; i < n; i += totalComponents)
+      {
+      for (int j = 0; j < nComponents; j++)
+        {
+        T v = ptr[i + j];
+        minVal = (v < minVal ? v : minVal);
+        maxVal = (v > maxVal ? v : maxVal);
+        }
+      }
+    }
+
+  if (minVal <= maxVal)
+    {
+    range[0] = (minVal < range[0] ? minVal : range[0]);
+    range[1] = (maxVal > range[1] ? maxVal : range[1]);
+    }
+}
+
+// Compute the min/max and window for one frame, the frame range is
+// computed first so that the histogram only covers the frame's values
+template<class T>
+void vtkDICOMGeneratorComputeFrameRange(
+  const T *ptr, vtkIdType n, int nComponents, int totalComponents,
+  std::vector<vtkIdType> *histogramBuffer, int tp[4])
+{
+  double range[2] = { VTK_DOUBLE_MAX, VTK_DOUBLE_MIN };
+  vtkDICOMGeneratorComputeRange(ptr, n, nComponents, totalComponents, range);
+  if (range[0] > range[1])
+    {
+    // the frame is empty
+    tp[0] = tp[1] = tp[2] = tp[3] = 0;
+    return;
+    }
+
+  int minVal = static_cast<int>(range[0]);
+  int maxVal = static_cast<int>(range[1]);
+  histogramBuffer->assign(maxVal - minVal + 1, 0);
+  vtkIdType *histogram = &(*histogramBuffer)[0] - minVal;
+  vtkDICOMGeneratorComputeHistogram(
+    ptr, n, nComponents, totalComponents, histogram);
+
+  // try to compute window/level as 99th percentile
+  vtkIdType sum = 0;
+  vtkIdType totalSum = (n/totalComponents)*nComponents;
+  vtkIdType lowSum = static_cast<vtkIdType>(totalSum*0.01);
+  vtkIdType highSum = static_cast<vtkIdType>(totalSum*0.99);
+  int lowVal = minVal;
+  int highVal = maxVal;
+  for (int hi = minVal; hi <= maxVal; hi++)
+    {
+    sum += histogram[hi];
+    if (sum <= lowSum)
+      {
+      lowVal = hi;
+      }
+    if (sum >= highSum)
+      {
+      highVal = hi;
+      break;
+      }
+    }
+
+  // expand the window slightly, but keep it within the frame's range
+  int expansion = static_cast<int>((highVal - lowVal)*0.1);
+  lowVal -= expansion;
+  highVal += expansion;
+
+  tp[0] = minVal;
+  tp[1] = maxVal;
+  tp[2] = (lowVal > minVal ? lowVal : minVal);
+  tp[3] = (highVal < maxVal ? highVal : maxVal);
+}
+
+// the information that is shared by the threads that compute the range
+struct vtkDICOMGeneratorRangeStruct
+{
+  const char *Data;
+  int ScalarType;
+  int ScalarSize;
+  vtkIdType NumberOfValues;
+  vtkIdType SliceSize;
+  int FrameComponents;
+  int TotalComponents;
+  int NumberOfFrames;
+  const vtkIdType *FrameOffsets;
+  int *FrameRanges;
+  double *ThreadRanges;
+};
+
+// compute the range for the portion of the data assigned to a thread
+void vtkDICOMGeneratorComputeRanges(
+  vtkDICOMGeneratorRangeStruct *rs, int threadId, int numThreads)
+{
+  double *range = &rs->ThreadRanges[2*threadId];
+
+  if (rs->FrameRanges == 0)
+    {
+    // only the total range is needed, so split the values into blocks
+    vtkIdType begin = rs->NumberOfValues*threadId/numThreads;
+    vtkIdType end = rs->NumberOfValues*(threadId + 1)/numThreads;
+    const void *ptr = rs->Data + begin*rs->ScalarSize;
+    switch (rs->ScalarType)
+      {
+      vtkTemplateAliasMacro(
+        vtkDICOMGeneratorComputeRange(
+          static_cast<const VTK_TT *>(ptr), end - begin, 1, 1, range));
+      }
+    return;
+    }
+
+  // split the frames into blocks, each frame is done in a single
+  // sweep so that its values are still in the cache for the histogram
+  std::vector<vtkIdType> histogramBuffer;
+  int begin = rs->NumberOfFrames*threadId/numThreads;
+  int end = rs->NumberOfFrames*(threadId + 1)/numThreads;
+  for (int k = begin; k < end; k++)
+    {
+    const void *ptr = rs->Data + rs->FrameOffsets[k]*rs->ScalarSize;
+    int *tp = &rs->FrameRanges[4*k];
+    switch (rs->ScalarType)
+      {
+      case VTK_UNSIGNED_SHORT:
+        vtkDICOMGeneratorComputeFrameRange(
+          static_cast<const unsigned short *>(ptr), rs->SliceSize,
+          rs->FrameComponents, rs->TotalComponents, &histogramBuffer, tp);
+        break;
+      case VTK_SHORT:
+        vtkDICOMGeneratorComputeFrameRange(
+          static_cast<const short *>(ptr), rs->SliceSize,
+          rs->FrameComponents, rs->TotalComponents, &histogramBuffer, tp);
+        break;
+      case VTK_UNSIGNED_CHAR:
+        vtkDICOMGeneratorComputeFrameRange(
+          static_cast<const unsigned char *>(ptr), rs->SliceSize,
+          rs->FrameComponents, rs->TotalComponents, &histogramBuffer, tp);
+        break;
+      case VTK_SIGNED_CHAR:
+        vtkDICOMGeneratorComputeFrameRange(
+          static_cast<const signed char *>(ptr), rs->SliceSize,
+          rs->FrameComponents, rs->TotalComponents, &histogramBuffer, tp);
+        break;
+      }
+
+    if (tp[0] < range[0])
+      {
+      range[0] = tp[0];
+      }
+    if (tp[1] > range[1])
+      {
+      range[1] = tp[1];
+      }
+    }
+}
+
+// the thread entry point for vtkMultiThreader
+VTK_THREAD_RETURN_TYPE vtkDICOMGeneratorThreadedComputeRanges(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *info =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkDICOMGeneratorRangeStruct *rs =
+    static_cast<vtkDICOMGeneratorRangeStruct *>(info->UserData);
+
+  vtkDICOMGeneratorComputeRanges(rs, info->ThreadID, info->NumberOfThreads);
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
 } // end anonymous namespace
 
 //----------------------------------------------------------------------------
 void vtkDICOMGenerator::ComputePixelValueRange(
   vtkInformation *info, int seriesRange[2])
 {
-  // get the data and compute the range, this is tricky because the
-  // vtkDataArray::GetRange() method computes the min/max for just
-  // one component, but we need min/max over all components
-  double range[2];
+  // get the data, the range must cover all components, while the
+  // range (and window) of each frame covers only that frame's values
   vtkImageData *data =
     vtkImageData::SafeDownCast(info->Get(vtkDataObject::DATA_OBJECT()));
-  vtkDataArray *a = data->GetPointData()->GetScalars();
-  vtkIdType nt = a->GetNumberOfTuples();
-  vtkIdType nc = a->GetNumberOfComponents();
-  vtkDataArray *newArray = a->NewInstance();
-  newArray->SetNumberOfTuples(nt*nc);
-  newArray->SetVoidArray(a->GetVoidPointer(0), nt*nc, true);
-  newArray->GetRange(range);
-  newArray->Delete();
-
-  seriesRange[0] = static_cast<int>(range[0]);
-  seriesRange[1] = static_cast<int>(range[1]);
+  vtkDataArray *a = (data ? data->GetPointData()->GetScalars() : 0);
 
   if (this->RangeArray)
     {
@@ -564,13 +751,42 @@ void vtkDICOMGenerator::ComputePixelValueRange(
     this->RangeArray = 0;
     }
 
+  if (a == 0)
+    {
+    // if the writer is streaming, the data is not available until
+    // after the meta data has been written, so use the full range
+    double typeMin = vtkDataArray::GetDataTypeMin(this->ScalarType);
+    double typeMax = vtkDataArray::GetDataTypeMax(this->ScalarType);
+    seriesRange[0] = static_cast<int>(
+      typeMin > VTK_INT_MIN ? typeMin : VTK_INT_MIN);
+    seriesRange[1] = static_cast<int>(
+      typeMax < VTK_INT_MAX ? typeMax : VTK_INT_MAX);
+    return;
+    }
+
+  vtkIdType nt = a->GetNumberOfTuples();
+  vtkIdType nc = a->GetNumberOfComponents();
+
+  vtkDICOMGeneratorRangeStruct rs;
+  rs.Data = static_cast<const char *>(a->GetVoidPointer(0));
+  rs.ScalarType = a->GetDataType();
+  rs.ScalarSize = a->GetDataTypeSize();
+  rs.NumberOfValues = nt*nc;
+  rs.SliceSize = 0;
+  rs.FrameComponents = 0;
+  rs.TotalComponents = static_cast<int>(nc);
+  rs.NumberOfFrames = 0;
+  rs.FrameOffsets = 0;
+  rs.FrameRanges = 0;
+  rs.ThreadRanges = 0;
+
+  // the offset to the first value of each frame
+  std::vector<vtkIdType> frameOffsets;
+
   if (this->ScalarType == VTK_UNSIGNED_SHORT ||
       this->ScalarType == VTK_SHORT || this->ScalarType == VTK_SIGNED_CHAR ||
       this->ScalarType == VTK_UNSIGNED_CHAR)
     {
-    vtkIdType *h = new vtkIdType[seriesRange[1] - seriesRange[0] + 1];
-    vtkIdType *histogram = h - seriesRange[0];
-
     int npixels = nt*nc;
     int npositions = (this->Dimensions[2] > 0 ? this->Dimensions[2] : 1);
     int ntimes = (this->Dimensions[3] > 0 ? this->Dimensions[3] : 1);
@@ -585,96 +801,104 @@ void vtkDICOMGenerator::ComputePixelValueRange(
     int ninstances = this->SliceIndexArray->GetNumberOfTuples();
     int ntotal = nframes*ninstances;
 
-    this->RangeArray = vtkIntArray::New();
-    this->RangeArray->SetNumberOfComponents(4);
-    this->RangeArray->SetNumberOfTuples(ntotal);
+    int n = nc/nvector; // ntimes*samplesPerPixel
+    if (this->TimeAsVector)
+      {
+      n /= ntimes; // samplesPerPixel
+      }
 
+    frameOffsets.resize(ntotal);
     for (int i = 0; i < ninstances; i++)
       {
       for (int j = 0; j < nframes; j++)
         {
         int k = i*nframes + j;
-        int idx = 0;
+        vtkIdType idx = 0;
         int s = this->SliceIndexArray->GetComponent(i, j);
         int v = this->ComponentIndexArray->GetComponent(i, j);
-        int n = nc/nvector; // ntimes*samplesPerPixel
-        idx += s*sliceSize;
+        idx += s*static_cast<vtkIdType>(sliceSize);
         if (this->TimeAsVector)
           {
-          n /= ntimes; // samplesPerPixel
           int t = v/nvector;
           v = v % nvector;
           idx += t*nvector*n;
           }
         idx += v*n;
+        frameOffsets[k] = idx;
+        }
+      }
 
-        void *ptr = a->GetVoidPointer(idx);
-        for (int hi = seriesRange[0]; hi <= seriesRange[1]; hi++)
-          {
-          histogram[hi] = 0;
-          }
+    this->RangeArray = vtkIntArray::New();
+    this->RangeArray->SetNumberOfComponents(4);
+    this->RangeArray->SetNumberOfTuples(ntotal);
 
-        switch (this->ScalarType)
-          {
-          case VTK_UNSIGNED_SHORT:
-            vtkDICOMGeneratorComputeHistogram(
-              static_cast<unsigned short *>(ptr), sliceSize, n, nc, histogram);
-            break;
-          case VTK_SHORT:
-            vtkDICOMGeneratorComputeHistogram(
-              static_cast<short *>(ptr), sliceSize, n, nc, histogram);
-            break;
-          case VTK_UNSIGNED_CHAR:
-            vtkDICOMGeneratorComputeHistogram(
-              static_cast<unsigned char *>(ptr), sliceSize, n, nc, histogram);
-            break;
-          case VTK_SIGNED_CHAR:
-            vtkDICOMGeneratorComputeHistogram(
-              static_cast<signed char *>(ptr), sliceSize, n, nc, histogram);
-            break;
-          }
+    rs.SliceSize = sliceSize;
+    rs.FrameComponents = n;
+    rs.NumberOfFrames = ntotal;
+    rs.FrameOffsets = (ntotal > 0 ? &frameOffsets[0] : 0);
+    rs.FrameRanges = this->RangeArray->GetPointer(0);
+    }
 
-        // compute the min/max from the histogram,
-        // also try to compute window/level as 99th percentile
-        vtkIdType sum = 0;
-        vtkIdType totalSum = (sliceSize/nc)*n;
-        vtkIdType lowSum = static_cast<int>(totalSum*0.01);
-        vtkIdType highSum = static_cast<int>(totalSum*0.99);
-        int lowVal = seriesRange[0];
-        int highVal = seriesRange[0];
-        int minVal = seriesRange[0] - 1;
-        int maxVal = seriesRange[0];
-        for (int hi = seriesRange[0]; hi <= seriesRange[1]; hi++)
-          {
-          vtkIdType b = histogram[hi];
-          sum += b;
-          lowVal = (sum > lowSum ? lowVal : hi);
-          highVal = (sum > highSum ? highVal : hi);
-          minVal = (sum > 0 ? minVal : hi);
-          maxVal = (b == 0 ? maxVal : hi);
-          }
-        if (minVal < maxVal)
-          {
-          minVal++;
-          }
-        // expand the window slightly, but keep within total range
-        int lowExpansion = static_cast<int>((highVal - lowVal)*0.1);
-        int highExpansion = static_cast<int>((highVal - lowVal)*0.1);
-        lowVal -= lowExpansion;
-        highVal += highExpansion;
-        lowVal = (lowVal >= seriesRange[0] ? lowVal : seriesRange[0]);
-        highVal = (highVal <= seriesRange[1] ? highVal : seriesRange[1]);
-
-        int tp[4];
-        tp[0] = minVal;
-        tp[1] = maxVal;
-        tp[2] = lowVal;
-        tp[3] = highVal;
-        this->RangeArray->SetTupleValue(k, tp);
-        }
+  // each thread computes the range of its own portion of the data
+  int numThreads = this->NumberOfThreads;
+  if (this->RangeArray && numThreads > rs.NumberOfFrames)
+    {
+    numThreads = rs.NumberOfFrames;
+    }
+  if (numThreads < 1)
+    {
+    numThreads = 1;
+    }
+
+  std::vector<double> threadRanges(2*numThreads);
+  for (int threadId = 0; threadId < numThreads; threadId++)
+    {
+    threadRanges[2*threadId] = VTK_DOUBLE_MAX;
+    threadRanges[2*threadId + 1] = VTK_DOUBLE_MIN;
+    }
+  rs.ThreadRanges = &threadRanges[0];
+
+  if (numThreads == 1)
+    {
+    vtkDICOMGeneratorComputeRanges(&rs, 0, 1);
+    }
+  else
+    {
+    vtkSmartPointer<vtkMultiThreader> threader =
+      vtkSmartPointer<vtkMultiThreader>::New();
+    threader->SetNumberOfThreads(numThreads);
+    threader->SetSingleMethod(vtkDICOMGeneratorThreadedComputeRanges, &rs);
+    threader->SingleMethodExecute();
+    }
+
+  double range[2] = { VTK_DOUBLE_MAX, VTK_DOUBLE_MIN };
+  for (int threadId = 0; threadId < numThreads; threadId++)
+    {
+    if (threadRanges[2*threadId] < range[0])
+      {
+      range[0] = threadRanges[2*threadId];
+      }
+    if (threadRanges[2*threadId + 1] > range[1])
+      {
+      range[1] = threadRanges[2*threadId + 1];
       }
+    }
+  if (range[0] > range[1])
+    {
+    // there were no values
+    range[0] = 0.0;
+    range[1] = 0.0;
+    }
+
+  seriesRange[0] = static_cast<int>(range[0]);
+  seriesRange[1] = static_cast<int>(range[1]);
 
-    delete [] h;
+  // keep the expanded window of each frame within the total range
+  for (int k = 0; k < rs.NumberOfFrames; k++)
+    {
+    int *tp = &rs.FrameRanges[4*k];
+    tp[2] = (tp[2] >= seriesRange[0] ? tp[2] : seriesRange[0]);
+    tp[3] = (tp[3] <= seriesRange[1] ? tp[3] : seriesRange[1]);
     }
 }
 
@@ -1092,8 +1316,8 @@ bool vtkDICOMGenerator::GenerateGeneralSeriesModule(vtkDICOMMetaData *meta)
     }
   meta->SetAttributeValue(DC::Modality, m);
 
-  // Set pixel min/max information
-  if (this->ScalarType != VTK_INT && this->ScalarType != VTK_UNSIGNED_INT)
+  // Set pixel min/max information, if it was computed from the data
+  if (this->RangeArray)
     {
     // Get the pixel VR
     vtkDICOMVR pixelVR = vtkDICOMVR::US;
@@ -1592,6 +1816,339 @@ bool vtkDICOMGenerator::GenerateMultiFrameModule(vtkDICOMMetaData *meta)
   return true;
 }
 
+//----------------------------------------------------------------------------
+namespace {
+
+// Compute a window from the low and high pixel values of a frame
+void vtkDICOMGeneratorComputeWindow(
+  int lowVal, int highVal, double *center, double *width)
+{
+  // set a limit on how tight the window can be
+  if (highVal - lowVal < 20)
+    {
+    highVal = lowVal + 20;
+    }
+  // make sure that WindowCenter will be an integer
+  if ((highVal - lowVal) % 2 != 0)
+    {
+    if (lowVal > 0)
+      {
+      lowVal--;
+      }
+    else
+      {
+      highVal--;
+      }
+    }
+  *center = 0.5*(highVal + lowVal);
+  *width = 1.0*(highVal - lowVal);
+}
+
+// Create a sequence that holds a single item
+vtkDICOMSequence vtkDICOMGeneratorSequence(const vtkDICOMItem& item)
+{
+  vtkDICOMSequence seq(1);
+  seq.SetItem(0, item);
+  return seq;
+}
+
+} // end anonymous namespace
+
+//----------------------------------------------------------------------------
+bool vtkDICOMGenerator::GenerateMultiFrameFunctionalGroupsModule(
+  vtkDICOMMetaData *meta)
+{
+  double spacing[3], origin[3];
+  double matrix[16];
+  this->ComputeAdjustedMatrix(matrix, origin, spacing);
+
+  int nframes = this->NumberOfFrames;
+  int numSlices = (this->Dimensions[2] > 0 ? this->Dimensions[2] : 1);
+  int numTimeSlots = (this->Dimensions[3] > 0 ? this->Dimensions[3] : 1);
+  int numVectors = nframes/(numSlices*numTimeSlots);
+  if (numVectors < 1)
+    {
+    numVectors = 1;
+    }
+  bool hasTime = (this->Dimensions[3] > 0);
+
+  // there is only one instance, the frames are within it
+  meta->SetAttributeValue(DC::InstanceNumber, 1);
+  meta->SetAttributeValue(DC::NumberOfFrames, nframes);
+
+  // ContentDate and ContentTime are mandatory, use the creation time
+  // if the original values are not available
+  std::string contentDate;
+  std::string contentTime;
+  if (this->MetaData)
+    {
+    contentDate = this->MetaData->GetAttributeValue(
+      DC::ContentDate).AsString();
+    contentTime = this->MetaData->GetAttributeValue(
+      DC::ContentTime).AsString();
+    }
+  if (contentDate == "")
+    {
+    contentDate = meta->GetAttributeValue(
+      DC::InstanceCreationDate).AsString();
+    contentTime = meta->GetAttributeValue(
+      DC::InstanceCreationTime).AsString();
+    }
+  meta->SetAttributeValue(DC::ContentDate, contentDate);
+  meta->SetAttributeValue(DC::ContentTime, contentTime);
+
+  // the original SliceThickness should be used if it is still valid,
+  // i.e. if the slices are original slices rather than reformatted.
+  double thickness = 0;
+  if (this->SourceInstanceArray && this->MetaData)
+    {
+    thickness = this->MetaData->GetAttributeValue(
+      DC::SliceThickness).AsDouble();
+    }
+  if (thickness <= 0)
+    {
+    thickness = fabs(spacing[2]);
+    }
+
+  // the geometry of the slices is shared by all frames
+  vtkDICOMItem pixelMeasures;
+  pixelMeasures.SetAttributeValue(
+    DC::PixelSpacing,
+    vtkDICOMValue(vtkDICOMVR::DS, spacing, spacing+2));
+  pixelMeasures.SetAttributeValue(DC::SliceThickness, thickness);
+  pixelMeasures.SetAttributeValue(
+    DC::SpacingBetweenSlices, fabs(spacing[2]));
+
+  double position[3], orientation[6];
+  vtkDICOMGenerator::ComputePositionAndOrientation(
+    origin, matrix, position, orientation);
+
+  vtkDICOMItem planeOrientation;
+  planeOrientation.SetAttributeValue(
+    DC::ImageOrientationPatient,
+    vtkDICOMValue(vtkDICOMVR::DS, orientation, orientation+6));
+
+  vtkDICOMItem shared;
+  shared.SetAttributeValue(
+    DC::PixelMeasuresSequence, vtkDICOMGeneratorSequence(pixelMeasures));
+  shared.SetAttributeValue(
+    DC::PlaneOrientationSequence,
+    vtkDICOMGeneratorSequence(planeOrientation));
+
+  // the rescaling is shared by all frames
+  bool hasRescale = (this->RescaleSlope != 1.0 ||
+                     this->RescaleIntercept != 0.0);
+  if (hasRescale)
+    {
+    vtkDICOMItem pixelValueTransformation;
+    pixelValueTransformation.SetAttributeValue(
+      DC::RescaleIntercept, this->RescaleIntercept);
+    pixelValueTransformation.SetAttributeValue(
+      DC::RescaleSlope, this->RescaleSlope);
+    pixelValueTransformation.SetAttributeValue(DC::RescaleType, "US");
+    shared.SetAttributeValue(
+      DC::PixelValueTransformationSequence,
+      vtkDICOMGeneratorSequence(pixelValueTransformation));
+    }
+
+  // use the original window if there is one, otherwise compute a
+  // window for each frame from its range of pixel values
+  bool computeWindow = false;
+  if (this->MetaData &&
+      this->MetaData->HasAttribute(DC::WindowCenter) &&
+      this->MetaData->HasAttribute(DC::WindowWidth))
+    {
+    vtkDICOMItem frameVOILUT;
+    frameVOILUT.SetAttributeValue(
+      DC::WindowCenter,
+      this->MetaData->GetAttributeValue(DC::WindowCenter));
+    frameVOILUT.SetAttributeValue(
+      DC::WindowWidth,
+      this->MetaData->GetAttributeValue(DC::WindowWidth));
+    shared.SetAttributeValue(
+      DC::FrameVOILUTSequence, vtkDICOMGeneratorSequence(frameVOILUT));
+    }
+  else if (this->RangeArray &&
+           this->RangeArray->GetNumberOfTuples() >= nframes &&
+           (this->ScalarType == VTK_SHORT ||
+            this->ScalarType == VTK_UNSIGNED_SHORT))
+    {
+    computeWindow = true;
+    }
+
+  meta->SetAttributeValue(
+    DC::SharedFunctionalGroupsSequence, vtkDICOMGeneratorSequence(shared));
+
+  // the position and the frame content are different for every frame
+  vtkDICOMSequence perFrame(nframes);
+  double zorigin = origin[2];
+  for (int i = 0; i < nframes; i++)
+    {
+    int sliceIdx = this->SliceIndexArray->GetValue(i);
+    int componentIdx = this->ComponentIndexArray->GetValue(i);
+    // separate the time from the slice index
+    int timeIdx = 0;
+    int vectorIdx = componentIdx;
+    if (this->TimeAsVector)
+      {
+      timeIdx = componentIdx/numVectors;
+      vectorIdx = componentIdx % numVectors;
+      }
+    else
+      {
+      timeIdx = sliceIdx % numTimeSlots;
+      sliceIdx /= numTimeSlots;
+      }
+    origin[2] = zorigin + sliceIdx*spacing[2];
+
+    vtkDICOMGenerator::ComputePositionAndOrientation(
+      origin, matrix, position, orientation);
+
+    vtkDICOMItem planePosition;
+    planePosition.SetAttributeValue(
+      DC::ImagePositionPatient,
+      vtkDICOMValue(vtkDICOMVR::DS, position, position+3));
+
+    // the index values must match the Multi-frame Dimension Module,
+    // each vector component (other than time) is stored as its own
+    // stack so that every frame has a unique set of index values
+    unsigned int indexValues[3];
+    indexValues[0] = vectorIdx + 1;
+    indexValues[1] = sliceIdx + 1;
+    indexValues[2] = timeIdx + 1;
+
+    char stackID[16];
+    sprintf(stackID, "%d", vectorIdx + 1);
+
+    vtkDICOMItem frameContent;
+    frameContent.SetAttributeValue(DC::StackID, stackID);
+    frameContent.SetAttributeValue(DC::InStackPositionNumber, sliceIdx + 1);
+    if (hasTime)
+      {
+      frameContent.SetAttributeValue(DC::TemporalPositionIndex, timeIdx + 1);
+      }
+    frameContent.SetAttributeValue(
+      DC::DimensionIndexValues,
+      vtkDICOMValue(vtkDICOMVR::UL,
+                    indexValues, indexValues + (hasTime ? 3 : 2)));
+
+    vtkDICOMItem item;
+    item.SetAttributeValue(
+      DC::FrameContentSequence, vtkDICOMGeneratorSequence(frameContent));
+    item.SetAttributeValue(
+      DC::PlanePositionSequence, vtkDICOMGeneratorSequence(planePosition));
+
+    if (computeWindow)
+      {
+      double center, width;
+      vtkDICOMGeneratorComputeWindow(
+        static_cast<int>(this->RangeArray->GetComponent(i, 2)),
+        static_cast<int>(this->RangeArray->GetComponent(i, 3)),
+        &center, &width);
+      // the window is applied after the rescaling
+      vtkDICOMItem frameVOILUT;
+      frameVOILUT.SetAttributeValue(
+        DC::WindowCenter,
+        center*this->RescaleSlope + this->RescaleIntercept);
+      frameVOILUT.SetAttributeValue(
+        DC::WindowWidth, width*fabs(this->RescaleSlope));
+      item.SetAttributeValue(
+        DC::FrameVOILUTSequence, vtkDICOMGeneratorSequence(frameVOILUT));
+      }
+
+    perFrame.SetItem(i, item);
+    }
+
+  meta->SetAttributeValue(DC::PerFrameFunctionalGroupsSequence, perFrame);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMGenerator::GenerateMultiFrameDimensionModule(
+  vtkDICOMMetaData *meta)
+{
+  std::string uid =
+    vtkDICOMUtilities::GenerateUID(DC::DimensionOrganizationUID);
+
+  vtkDICOMItem organization;
+  organization.SetAttributeValue(DC::DimensionOrganizationUID, uid);
+  meta->SetAttributeValue(
+    DC::DimensionOrganizationSequence,
+    vtkDICOMGeneratorSequence(organization));
+
+  // the dimensions, in the same order as the DimensionIndexValues
+  static const DC::EnumType indexTags[] = {
+    DC::StackID,
+    DC::InStackPositionNumber,
+    DC::TemporalPositionIndex
+  };
+  static const char *indexLabels[] = {
+    "Stack ID",
+    "In-Stack Position Number",
+    "Temporal Position Index"
+  };
+
+  bool hasTime = (this->Dimensions[3] > 0);
+  int n = (hasTime ? 3 : 2);
+  meta->SetAttributeValue(
+    DC::DimensionOrganizationType, (hasTime ? "3D_TEMPORAL" : "3D"));
+
+  vtkDICOMSequence seq(n);
+  for (int i = 0; i < n; i++)
+    {
+    vtkDICOMItem item;
+    item.SetAttributeValue(DC::DimensionOrganizationUID, uid);
+    item.SetAttributeValue(
+      DC::DimensionIndexPointer,
+      vtkDICOMValue(vtkDICOMVR::AT, vtkDICOMTag(indexTags[i])));
+    item.SetAttributeValue(
+      DC::FunctionalGroupPointer,
+      vtkDICOMValue(vtkDICOMVR::AT, vtkDICOMTag(DC::FrameContentSequence)));
+    item.SetAttributeValue(DC::DimensionDescriptionLabel, indexLabels[i]);
+    seq.SetItem(i, item);
+    }
+  meta->SetAttributeValue(DC::DimensionIndexSequence, seq);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMGenerator::GenerateEnhancedGeneralEquipmentModule(
+  vtkDICOMMetaData *meta)
+{
+  // required items: use simple read/write validation
+  static const DC::EnumType required[] = {
+    DC::Manufacturer,
+    DC::ManufacturerModelName,
+    DC::DeviceSerialNumber,
+    DC::SoftwareVersions,
+    DC::ItemDelimitationItem
+  };
+
+  return this->CopyRequiredAttributes(required, meta);
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMGenerator::GenerateAcquisitionContextModule(
+  vtkDICOMMetaData *meta)
+{
+  // required items: use simple read/write validation
+  static const DC::EnumType required[] = {
+    DC::AcquisitionContextSequence, // 2
+    DC::ItemDelimitationItem
+  };
+
+  // optional and conditional: direct copy of values with no checks
+  static const DC::EnumType optional[] = {
+    DC::AcquisitionContextDescription,
+    DC::ItemDelimitationItem
+  };
+
+  return (this->CopyRequiredAttributes(required, meta) &&
+          this->CopyOptionalAttributes(optional, meta));
+}
+
 //----------------------------------------------------------------------------
 bool vtkDICOMGenerator::GenerateDeviceModule(vtkDICOMMetaData *meta)
 {
@@ -1680,27 +2237,13 @@ bool vtkDICOMGenerator::GenerateVOILUTModule(vtkDICOMMetaData *meta)
     int m = static_cast<int>(this->RangeArray->GetNumberOfTuples()/n);
     for (int i = 0; i < n; i++)
       {
-      int lowVal = this->RangeArray->GetComponent(i*m, 2);
-      int highVal = this->RangeArray->GetComponent(i*m, 3);
-      // set a limit on how tight the window can be
-      if (highVal - lowVal < 20)
-        {
-        highVal = lowVal + 20;
-        }
-      // make sure that WindowCenter will be an integer
-      if ((highVal - lowVal) % 2 != 0)
-        {
-        if (lowVal > 0)
-          {
-          lowVal--;
-          }
-        else
-          {
-          highVal--;
-          }
-        }
-      meta->SetAttributeValue(i, DC::WindowCenter, 0.5*(highVal + lowVal));
-      meta->SetAttributeValue(i, DC::WindowWidth, 1.0*(highVal - lowVal));
+      double center, width;
+      vtkDICOMGeneratorComputeWindow(
+        static_cast<int>(this->RangeArray->GetComponent(i*m, 2)),
+        static_cast<int>(this->RangeArray->GetComponent(i*m, 3)),
+        &center, &width);
+      meta->SetAttributeValue(i, DC::WindowCenter, center);
+      meta->SetAttributeValue(i, DC::WindowWidth, width);
       }
 
     return true;
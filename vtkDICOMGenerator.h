@@ -61,6 +61,8 @@ public:
    *  If this is on, the one multi-frame data set will be created.  If
    *  this is off, then each slice will be put into a different data set.
    *  The latter is more likely to be compatible with older software.
+   *  For modalities that have an enhanced IOD, such as CT and MR, the
+   *  multi-frame data set will use the enhanced IOD.
    */
   vtkSetMacro(MultiFrame, int);
   vtkBooleanMacro(MultiFrame, int);
@@ -100,6 +102,16 @@ public:
   vtkSetMacro(RescaleSlope, double);
   vtkGetMacro(RescaleSlope, double);
 
+  //! Set the number of threads to use when scanning the image data.
+  /*!
+   *  The generator must find the range of the pixel values, and the
+   *  range and window for each frame, before the meta data can be
+   *  generated.  With more than one thread, each thread scans a
+   *  different set of frames.  The default is 1.
+   */
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
   //! Set the matrix that places the image in DICOM patient coords.
   /*!
    *  The 3x3 portion of the matrix must be orthonormal, and the
@@ -216,6 +228,32 @@ protected:
   //! Generate The DICOM Multi-frame Module.
   virtual bool GenerateMultiFrameModule(vtkDICOMMetaData *meta);
 
+  //! Generate the DICOM Multi-frame Functional Groups Module.
+  /*!
+   *  This is used instead of the Image Plane Module for enhanced objects.
+   *  The pixel measures and plane orientation are put into the shared
+   *  functional groups, while the frame content and plane position are
+   *  put into the per-frame functional groups.  Subclasses can add their
+   *  own functional groups after calling this method.
+   */
+  virtual bool GenerateMultiFrameFunctionalGroupsModule(
+    vtkDICOMMetaData *meta);
+
+  //! Generate the DICOM Multi-frame Dimension Module.
+  /*!
+   *  The dimensions are the stack position and, if the data has a time
+   *  dimension, the temporal position, which match the DimensionIndexValues
+   *  that were set by GenerateMultiFrameFunctionalGroupsModule().
+   */
+  virtual bool GenerateMultiFrameDimensionModule(vtkDICOMMetaData *meta);
+
+  //! Generate the DICOM Enhanced General Equipment Module.
+  virtual bool GenerateEnhancedGeneralEquipmentModule(
+    vtkDICOMMetaData *meta);
+
+  //! Generate the DICOM Acquisition Context Module.
+  virtual bool GenerateAcquisitionContextModule(vtkDICOMMetaData *meta);
+
   //! Generate The DICOM Device Module.
   virtual bool GenerateDeviceModule(vtkDICOMMetaData *meta);
 
@@ -273,7 +311,9 @@ protected:
   //! Compute the range of the data.
   /*!
    *  If the image data is present, compute the range of all frames as
-   *  well as a suitable window/level for each frame.
+   *  well as a suitable window/level for each frame.  If the data is
+   *  not present (e.g. if the writer is streaming), then the range of
+   *  the scalar type is used instead, and no window/level is computed.
    */
   virtual void ComputePixelValueRange(
     vtkInformation *info, int seriesRange[2]);
@@ -309,6 +349,9 @@ protected:
   double RescaleIntercept;
   double RescaleSlope;
 
+  //! The number of threads to use for ComputePixelValueRange().
+  int NumberOfThreads;
+
   //! The VTK scalar type of the data, set by InitializeMetaData().
   int ScalarType;
 
@@ -362,7 +405,7 @@ protected:
   vtkIntArray *SliceIndexArray;
   vtkIntArray *ComponentIndexArray;
 
-  //! Map from output files to input files.
+  //! Map from output frames to input files.
   vtkIntArray *SourceInstanceArray;
 
   //! Map from frame to image min/max.
@@ -84,8 +84,11 @@ void vtkDICOMItem::CopyList(const List *o, List *t)
 {
   t->ByteOffset = o->ByteOffset;
   t->Delimited = o->Delimited;
+  t->Head.Next = &t->Tail;
+  t->Tail.Prev = &t->Head;
 
   int n = o->NumberOfDataElements;
+  t->NumberOfDataElements = n;
   if (n > 0)
     {
     // round up to power of two
@@ -193,6 +193,148 @@ bool vtkDICOMMRGenerator::GenerateMRImageModule(vtkDICOMMetaData *meta)
           this->CopyOptionalAttributes(optional, meta));
 }
 
+//----------------------------------------------------------------------------
+bool vtkDICOMMRGenerator::GenerateEnhancedMRImageModule(
+  vtkDICOMMetaData *meta)
+{
+  // ImageType has four values for enhanced images, the third is
+  // the image flavor and the fourth gives the derivation (NONE if
+  // not derived in a special way)
+  std::string it;
+  if (this->MetaData)
+    {
+    it = this->MetaData->GetAttributeValue(DC::ImageType).AsString();
+    }
+  if (it == "")
+    {
+    it = "DERIVED\\SECONDARY\\OTHER";
+    }
+  int nvalues = 1;
+  for (size_t i = 0; i < it.length(); i++)
+    {
+    nvalues += (it[i] == '\\');
+    }
+  if (nvalues == 3)
+    {
+    it += "\\NONE";
+    }
+  meta->SetAttributeValue(DC::ImageType, it);
+
+  // ComplexImageComponent and AcquisitionContrast are mandatory
+  std::string cic;
+  std::string ac;
+  if (this->MetaData)
+    {
+    cic = this->MetaData->GetAttributeValue(
+      DC::ComplexImageComponent).AsString();
+    ac = this->MetaData->GetAttributeValue(
+      DC::AcquisitionContrast).AsString();
+    }
+  if (cic == "")
+    {
+    cic = "MAGNITUDE";
+    }
+  if (ac == "")
+    {
+    ac = "UNKNOWN";
+    }
+
+  // These are mandatory, and are repeated in the frame type
+  meta->SetAttributeValue(DC::PixelPresentation, "MONOCHROME");
+  meta->SetAttributeValue(DC::VolumetricProperties, "VOLUME");
+  meta->SetAttributeValue(DC::VolumeBasedCalculationTechnique, "NONE");
+  meta->SetAttributeValue(DC::ComplexImageComponent, cic);
+  meta->SetAttributeValue(DC::AcquisitionContrast, ac);
+
+  vtkDICOMItem frameType;
+  frameType.SetAttributeValue(DC::FrameType, it);
+  frameType.SetAttributeValue(DC::PixelPresentation, "MONOCHROME");
+  frameType.SetAttributeValue(DC::VolumetricProperties, "VOLUME");
+  frameType.SetAttributeValue(DC::VolumeBasedCalculationTechnique, "NONE");
+  frameType.SetAttributeValue(DC::ComplexImageComponent, cic);
+  frameType.SetAttributeValue(DC::AcquisitionContrast, ac);
+  vtkDICOMSequence frameTypeSeq(1);
+  frameTypeSeq.SetItem(0, frameType);
+  meta->SetAttributeValue(
+    vtkDICOMTagPath(DC::SharedFunctionalGroupsSequence, 0,
+                    DC::MRImageFrameTypeSequence),
+    frameTypeSeq);
+
+  // ContentQualification is mandatory
+  std::string cq;
+  if (this->MetaData)
+    {
+    cq = this->MetaData->GetAttributeValue(
+      DC::ContentQualification).AsString();
+    }
+  if (cq == "")
+    {
+    cq = "PRODUCT";
+    }
+  meta->SetAttributeValue(DC::ContentQualification, cq);
+
+  // optional and conditional: direct copy of values with no checks
+  static const DC::EnumType optional[] = {
+    DC::AcquisitionNumber,
+    DC::AcquisitionDateTime, // 1C, required if ORIGINAL
+    DC::AcquisitionDuration, // 2C, required if ORIGINAL
+    DC::ReferencedImageSequence,
+    DC::DerivationDescription,
+    DC::DerivationCodeSequence,
+    DC::SourceImageSequence,
+    DC::ResonantNucleus, // 1C, required if ORIGINAL
+    DC::MagneticFieldStrength, // 1C, required if ORIGINAL
+    DC::ImageComments,
+    DC::BurnedInAnnotation,
+    DC::RecognizableVisualFeatures,
+    DC::LossyImageCompression,
+    DC::LossyImageCompressionRatio,
+    DC::LossyImageCompressionMethod,
+    DC::PresentationLUTShape,
+    DC::ItemDelimitationItem
+  };
+
+  return this->CopyOptionalAttributes(optional, meta);
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMMRGenerator::GenerateEnhancedMRInstance(
+  vtkInformation *info, vtkDICOMMetaData *meta)
+{
+  this->SetPixelRestrictions(
+    RepresentationSigned | RepresentationUnsigned,
+    BitsStored12 | BitsStored16,
+    1);
+
+  const char *SOPClass = "1.2.840.10008.5.1.4.1.1.4.1";
+  this->InitializeMetaData(info, meta);
+
+  if (!this->GenerateSOPCommonModule(meta, SOPClass) ||
+      !this->GeneratePatientModule(meta) ||
+      !this->GenerateClinicalTrialSubjectModule(meta) ||
+      !this->GenerateGeneralStudyModule(meta) ||
+      !this->GeneratePatientStudyModule(meta) ||
+      !this->GenerateClinicalTrialStudyModule(meta) ||
+      !this->GenerateGeneralSeriesModule(meta) ||
+      !this->GenerateClinicalTrialSeriesModule(meta) ||
+      !this->GenerateMRSeriesModule(meta) ||
+      !this->GenerateFrameOfReferenceModule(meta) ||
+      !this->GenerateGeneralEquipmentModule(meta) ||
+      !this->GenerateEnhancedGeneralEquipmentModule(meta) ||
+      !this->GenerateImagePixelModule(meta) ||
+      !this->GenerateMultiFrameFunctionalGroupsModule(meta) ||
+      !this->GenerateMultiFrameDimensionModule(meta) ||
+      !this->GenerateAcquisitionContextModule(meta) ||
+      !this->GenerateDeviceModule(meta) ||
+      !this->GenerateSpecimenModule(meta) ||
+      !this->GenerateEnhancedMRImageModule(meta))
+    {
+    return false;
+    }
+
+  return true;
+}
+
 //----------------------------------------------------------------------------
 bool vtkDICOMMRGenerator::GenerateMRInstance(
   vtkInformation *info, vtkDICOMMetaData *meta)
@@ -238,8 +380,7 @@ bool vtkDICOMMRGenerator::GenerateInstance(
 {
   if (this->MultiFrame)
     {
-    vtkErrorMacro("Enhanced Multi-Frame MR is not yet supported.");
-    return false;
+    return this->GenerateEnhancedMRInstance(info, meta);
     }
 
   return this->GenerateMRInstance(info, meta);
@@ -24,6 +24,7 @@
  *  are being written out as derived images after being processed.
  *  The specific IOD classes supported are as follows:
  *  - MR Image, 1.2.840.10008.5.1.4.1.1.4
+ *  - Enhanced MR Image, 1.2.840.10008.5.1.4.1.1.4.1 (if MultiFrame is On)
  */
 class VTK_DICOM_EXPORT vtkDICOMMRGenerator : public vtkDICOMGenerator
 {
@@ -54,10 +55,17 @@ protected:
   //! Generate the Image Module.
   virtual bool GenerateMRImageModule(vtkDICOMMetaData *meta);
 
+  //! Generate the Enhanced MR Image Module.
+  virtual bool GenerateEnhancedMRImageModule(vtkDICOMMetaData *meta);
+
   //! Instantiate a DICOM Secondary Capture Image object.
   virtual bool GenerateMRInstance(
     vtkInformation *info, vtkDICOMMetaData *meta);
 
+  //! Instantiate a DICOM Enhanced MR Image object.
+  virtual bool GenerateEnhancedMRInstance(
+    vtkInformation *info, vtkDICOMMetaData *meta);
+
 private:
   vtkDICOMMRGenerator(const vtkDICOMMRGenerator&);  // Not implemented.
   void operator=(const vtkDICOMMRGenerator&);  // Not implemented.
@@ -16,11 +16,19 @@
 #include "vtkDICOMMetaData.h"
 #include "vtkDICOMSequence.h"
 #include "vtkDICOMItem.h"
+#include "vtkDICOMUtilities.h"
 
 #include <vtkObjectFactory.h>
 #include <vtkUnsignedShortArray.h>
 #include <vtkErrorCode.h>
 
+// Header for zlib
+#ifdef DICOM_USE_VTKZLIB
+#include "vtk_zlib.h"
+#else
+#include "zlib.h"
+#endif
+
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -28,6 +36,7 @@
 #include <assert.h>
 
 #include <string>
+#include <vector>
 
 vtkStandardNewMacro(vtkDICOMParser);
 vtkCxxSetObjectMacro(vtkDICOMParser, MetaData, vtkDICOMMetaData);
@@ -1257,6 +1266,160 @@ bool Decoder<E>::SkipElements(
 
 } // end anonymous namespace
 
+//----------------------------------------------------------------------------
+// The zlib stream for the deflated transfer syntax, which is active from
+// the end of the meta header until the end of the file.
+class vtkDICOMParser::InflateState
+{
+public:
+  InflateState() : Active(false), Finished(false), Error(false) {}
+
+  // Start a raw inflate stream (no zlib header, as required by DICOM),
+  // given the compressed bytes that have already been read from the file.
+  bool Begin(const unsigned char *cp, const unsigned char *ep,
+             size_t bufferSize, vtkTypeInt64 bytesRead);
+
+  // Inflate up to n bytes into the buffer, reading the file as needed.
+  size_t Read(char *dp, size_t n, FILE *file);
+
+  // Check whether all of the compressed data has been consumed.
+  bool AtEnd(FILE *file)
+  {
+    return (this->Finished || (this->Stream.avail_in == 0 && feof(file)));
+  }
+
+  // Get the number of compressed bytes that have not been inflated.
+  vtkTypeInt64 GetCompressedBytesRemaining(vtkTypeInt64 fileSize)
+  {
+    return fileSize - this->CompressedBytesRead + this->Stream.avail_in;
+  }
+
+  // Free the zlib stream.
+  void End();
+
+  z_stream Stream;
+  std::vector<unsigned char> Input;
+  vtkTypeInt64 CompressedBytesRead;
+  bool Active;
+  bool Finished;
+  bool Error;
+};
+
+//----------------------------------------------------------------------------
+bool vtkDICOMParser::InflateState::Begin(
+  const unsigned char *cp, const unsigned char *ep,
+  size_t bufferSize, vtkTypeInt64 bytesRead)
+{
+  this->End();
+  this->Input.assign(cp, ep);
+  if (this->Input.size() < bufferSize)
+    {
+    this->Input.resize(bufferSize);
+    }
+  this->CompressedBytesRead = bytesRead;
+  this->Finished = false;
+  this->Error = false;
+
+  this->Stream.zalloc = Z_NULL;
+  this->Stream.zfree = Z_NULL;
+  this->Stream.opaque = Z_NULL;
+  this->Stream.next_in = &this->Input[0];
+  this->Stream.avail_in = static_cast<uInt>(ep - cp);
+  this->Active = (inflateInit2(&this->Stream, -MAX_WBITS) == Z_OK);
+  return this->Active;
+}
+
+//----------------------------------------------------------------------------
+size_t vtkDICOMParser::InflateState::Read(char *dp, size_t n, FILE *file)
+{
+  z_stream *zs = &this->Stream;
+  zs->next_out = reinterpret_cast<Bytef *>(dp);
+  zs->avail_out = static_cast<uInt>(n);
+
+  while (zs->avail_out != 0 && !this->Finished)
+    {
+    if (zs->avail_in == 0)
+      {
+      // refill the input buffer with compressed data
+      size_t m = fread(&this->Input[0], 1, this->Input.size(), file);
+      if (m == 0)
+        {
+        break;
+        }
+      this->CompressedBytesRead += m;
+      zs->next_in = &this->Input[0];
+      zs->avail_in = static_cast<uInt>(m);
+      }
+
+    int code = inflate(zs, Z_NO_FLUSH);
+    if (code == Z_STREAM_END)
+      {
+      this->Finished = true;
+      }
+    else if (code != Z_OK)
+      {
+      this->Error = true;
+      break;
+      }
+    }
+
+  return n - zs->avail_out;
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMParser::InflateState::End()
+{
+  if (this->Active)
+    {
+    inflateEnd(&this->Stream);
+    this->Active = false;
+    }
+}
+
+//----------------------------------------------------------------------------
+size_t vtkDICOMParser::ReadDeflatedData(
+  FILE *file, vtkTypeInt64 skip, char *buffer, size_t n)
+{
+  const size_t bufferSize = 8192;
+  InflateState inflater;
+  if (!inflater.Begin(0, 0, bufferSize, 0))
+    {
+    return 0;
+    }
+
+  // inflate and discard everything that precedes the requested data
+  std::vector<char> scratch(bufferSize);
+  while (skip > 0)
+    {
+    size_t m = (skip < static_cast<vtkTypeInt64>(bufferSize) ?
+                static_cast<size_t>(skip) : bufferSize);
+    if (inflater.Read(&scratch[0], m, file) != m)
+      {
+      inflater.End();
+      return 0;
+      }
+    skip -= m;
+    }
+
+  // inflate in chunks, since zlib counts the output with a 32-bit uInt
+  const size_t chunkSize = 0x40000000;
+  size_t bytesRead = 0;
+  while (bytesRead < n)
+    {
+    size_t m = n - bytesRead;
+    m = (m < chunkSize ? m : chunkSize);
+    size_t k = inflater.Read(buffer + bytesRead, m, file);
+    bytesRead += k;
+    if (k != m)
+      {
+      break;
+      }
+    }
+
+  inflater.End();
+  return bytesRead;
+}
+
 //----------------------------------------------------------------------------
 //----------------------------------------------------------------------------
 // Constructor
@@ -1268,13 +1431,17 @@ vtkDICOMParser::vtkDICOMParser()
   this->InputFile = NULL;
   this->BytesRead = 0;
   this->FileOffset = 0;
+  this->DataSetOffset = 0;
   this->FileSize = 0;
   this->Buffer = NULL;
   this->BufferSize = 8192;
   this->ChunkSize = 0;
   this->Index = -1;
+  this->Sniff = 0;
   this->PixelDataFound = false;
+  this->QueryMatched = true;
   this->ErrorCode = 0;
+  this->Inflate = new InflateState;
 }
 
 // Destructor
@@ -1290,6 +1457,8 @@ vtkDICOMParser::~vtkDICOMParser()
     {
     this->Groups->Delete();
     }
+
+  delete this->Inflate;
 }
 
 //----------------------------------------------------------------------------
@@ -1304,6 +1473,13 @@ void vtkDICOMParser::SetBufferSize(int size)
     }
 }
 
+//----------------------------------------------------------------------------
+void vtkDICOMParser::SetQuery(const vtkDICOMItem& query)
+{
+  this->Query = query;
+  this->Modified();
+}
+
 //----------------------------------------------------------------------------
 void vtkDICOMParser::Update()
 {
@@ -1326,7 +1502,10 @@ bool vtkDICOMParser::ReadFile(vtkDICOMMetaData *data, int idx)
 {
   // Mark pixel data as not found yet
   this->PixelDataFound = false;
+  this->QueryMatched = true;
+  this->ErrorCode = 0;
   this->FileOffset = 0;
+  this->DataSetOffset = 0;
   this->FileSize = 0;
 
   // Check that the file name has been set.
@@ -1337,26 +1516,32 @@ bool vtkDICOMParser::ReadFile(vtkDICOMMetaData *data, int idx)
     return false;
     }
 
-  // Make sure that the file exists.
+  // Open the file, and then get its size from the open file, rather
+  // than calling stat() first, so that each file is only opened once.
   struct stat fs;
-  if (stat(this->FileName, &fs) != 0)
-    {
-    this->SetErrorCode(vtkErrorCode::CannotOpenFileError);
-    vtkErrorMacro("ReadFile: Can't open file " << this->FileName);
-    return false;
-    }
-
-  this->FileSize = fs.st_size;
-
-  // Make sure that the file is readable.
   this->InputFile = fopen(this->FileName, "rb");
-  if (this->InputFile == 0)
+  if (this->InputFile == 0 ||
+      fstat(fileno(this->InputFile), &fs) != 0 ||
+      (fs.st_mode & S_IFMT) == S_IFDIR)
     {
+    if (this->InputFile)
+      {
+      fclose(this->InputFile);
+      this->InputFile = NULL;
+      }
+    if (this->Sniff)
+      {
+      // quietly skip anything that can't be read as a file
+      this->SetErrorCode(vtkErrorCode::UnrecognizedFileTypeError);
+      return false;
+      }
     this->SetErrorCode(vtkErrorCode::CannotOpenFileError);
     vtkErrorMacro("ReadFile: Can't read the file " << this->FileName);
     return false;
     }
 
+  this->FileSize = fs.st_size;
+
   this->Buffer = new char [this->BufferSize + 8];
   this->BytesRead = 0;
   // guard against anyone changing BufferSize while reading
@@ -1366,6 +1551,16 @@ bool vtkDICOMParser::ReadFile(vtkDICOMMetaData *data, int idx)
   const unsigned char *ep = NULL;
   this->FillBuffer(cp, ep);
 
+  // In sniff mode, check the header while it is in the buffer
+  if (this->Sniff && !vtkDICOMUtilities::IsDICOMHeader(cp, ep - cp))
+    {
+    this->SetErrorCode(vtkErrorCode::UnrecognizedFileTypeError);
+    delete [] this->Buffer;
+    fclose(this->InputFile);
+    this->InputFile = NULL;
+    return false;
+    }
+
   if (ep - cp >= 132 &&
       cp[128] == 'D' && cp[129] == 'I' && cp[130] == 'C' && cp[131] == 'M')
     {
@@ -1379,8 +1574,45 @@ bool vtkDICOMParser::ReadFile(vtkDICOMMetaData *data, int idx)
     cp += 4;
     }
 
+  // A query can only be checked if the data elements are kept
+  vtkDICOMMetaData *tempMeta = 0;
+  if (data == 0 && !this->Query.IsEmpty())
+    {
+    tempMeta = vtkDICOMMetaData::New();
+    data = tempMeta;
+    idx = -1;
+    }
+
   this->ReadMetaHeader(cp, ep, data, idx);
-  this->ReadMetaData(cp, ep, data, idx);
+  this->DataSetOffset = this->FileOffset;
+
+  // everything after the meta header is deflated
+  bool readable = true;
+  if (this->TransferSyntax == "1.2.840.10008.1.2.1.99")
+    {
+    readable = this->Inflate->Begin(cp, ep, this->ChunkSize, this->BytesRead);
+    if (!readable)
+      {
+      this->SetErrorCode(vtkErrorCode::UnknownError);
+      vtkErrorMacro("ReadFile: Can't initialize zlib for "
+                    << this->FileName);
+      }
+    // from here on, the buffer only holds inflated data
+    this->BytesRead = this->FileOffset;
+    cp = ep;
+    }
+
+  if (readable)
+    {
+    this->ReadMetaData(cp, ep, data, idx);
+    }
+
+  this->Inflate->End();
+
+  if (tempMeta)
+    {
+    tempMeta->Delete();
+    }
 
   delete [] this->Buffer;
   fclose(this->InputFile);
@@ -1486,10 +1718,14 @@ bool vtkDICOMParser::ReadMetaData(
 
   vtkUnsignedShortArray *groups = this->Groups;
 
+  // the query is checked group-by-group, as the data is read
+  vtkDICOMDataElementIterator queryIter = this->Query.Begin();
+  vtkDICOMDataElementIterator queryEnd = this->Query.End();
+
   // read group-by-group
   bool foundPixelData = false;
   bool readFailure = false;
-  while (!foundPixelData && !readFailure)
+  while (!foundPixelData && !readFailure && this->QueryMatched)
     {
     unsigned int g = decoder->PeekGroup(cp, ep);
 
@@ -1506,6 +1742,12 @@ bool vtkDICOMParser::ReadMetaData(
         {
         found = (g == groups->GetValue(i));
         }
+      // groups that are needed by the query must be read
+      for (vtkDICOMDataElementIterator iter = queryIter;
+           iter != queryEnd && !found; ++iter)
+        {
+        found = (g == iter->GetTag().GetGroup());
+        }
       }
 
     // create a delimiter to read/skip only this group
@@ -1527,6 +1769,24 @@ bool vtkDICOMParser::ReadMetaData(
       {
       readFailure = !decoder->SkipElements(cp, ep, HxFFFFFFFF, delimiter);
       }
+
+    // check the query against the group that was just read
+    if (queryIter != queryEnd)
+      {
+      this->QueryMatched = this->MatchQuery(queryIter, g, meta, idx);
+      }
+    }
+
+  // check any query attributes that were not present in the file
+  if (queryIter != queryEnd && this->QueryMatched && !readFailure)
+    {
+    this->QueryMatched = this->MatchQuery(queryIter, 0xFFFF, meta, idx);
+    }
+
+  if (!this->QueryMatched)
+    {
+    this->FileOffset = this->GetBytesProcessed(cp, ep);
+    return true;
     }
 
   this->PixelDataFound = (decoder->GetLastTag() == DC::PixelData);
@@ -1551,6 +1811,34 @@ bool vtkDICOMParser::ReadMetaData(
   return true;
 }
 
+//----------------------------------------------------------------------------
+bool vtkDICOMParser::MatchQuery(
+  vtkDICOMDataElementIterator &iter, unsigned short group,
+  vtkDICOMMetaData *meta, int idx)
+{
+  vtkDICOMDataElementIterator iterEnd = this->Query.End();
+
+  bool matched = true;
+  while (matched && iter != iterEnd && iter->GetTag().GetGroup() <= group)
+    {
+    vtkDICOMTag tag = iter->GetTag();
+    if (meta)
+      {
+      if (idx >= 0)
+        {
+        matched = meta->GetAttributeValue(idx, tag).Matches(iter->GetValue());
+        }
+      else
+        {
+        matched = meta->GetAttributeValue(tag).Matches(iter->GetValue());
+        }
+      }
+    ++iter;
+    }
+
+  return matched;
+}
+
 //----------------------------------------------------------------------------
 bool vtkDICOMParser::FillBuffer(
   const unsigned char* &ucp, const unsigned char* &ep)
@@ -1577,14 +1865,23 @@ bool vtkDICOMParser::FillBuffer(
     vtkErrorMacro("FillBuffer: error reading from file " << this->FileName);
     return false;
     }
-  else if (feof(this->InputFile))
+  else if (this->Inflate->Active ?
+           this->Inflate->AtEnd(this->InputFile) : feof(this->InputFile))
     {
     // if buffer is drained, and eof, then done
     return false;
     }
 
-  // read at most n bytes
-  n = fread(dp, 1, nbytes, this->InputFile);
+  if (this->Inflate->Active)
+    {
+    // inflate at most n bytes
+    n = this->Inflate->Read(dp, nbytes, this->InputFile);
+    }
+  else
+    {
+    // read at most n bytes
+    n = fread(dp, 1, nbytes, this->InputFile);
+    }
 
   // get number of chars read
   this->BytesRead += n;
@@ -1593,6 +1890,13 @@ bool vtkDICOMParser::FillBuffer(
   ep = reinterpret_cast<unsigned char *>(dp + n);
   ucp = reinterpret_cast<unsigned char *>(this->Buffer);
 
+  if (this->Inflate->Error)
+    {
+    this->Inflate->Error = false;
+    this->ParseError(ucp, ep, "Corrupt data in deflated file.");
+    return false;
+    }
+
   return true;
 }
 
@@ -1600,6 +1904,15 @@ bool vtkDICOMParser::FillBuffer(
 vtkTypeInt64 vtkDICOMParser::GetBytesRemaining(
   const unsigned char *cp, const unsigned char *ep)
 {
+  if (this->Inflate->Active)
+    {
+    // the inflated size is unknown, but deflate cannot compress
+    // by a factor of more than 1032, so use that as the limit
+    return static_cast<vtkTypeInt64>(
+      1032*this->Inflate->GetCompressedBytesRemaining(this->FileSize) +
+      (ep - cp));
+    }
+
   return static_cast<vtkTypeInt64>(
     this->FileSize - this->BytesRead + (ep - cp));
 }
@@ -1632,10 +1945,14 @@ void vtkDICOMParser::PrintSelf(ostream& os, vtkIndent indent)
      << (this->FileName ? this->FileName : "(NULL)") << "\n";
   os << indent << "PixelDataFound: "
      << (this->PixelDataFound ? "True\n" : "False\n");
+  os << indent << "QueryMatched: "
+     << (this->QueryMatched ? "True\n" : "False\n");
   os << indent << "FileOffset: " << this->FileOffset << "\n";
+  os << indent << "DataSetOffset: " << this->DataSetOffset << "\n";
   os << indent << "FileSize: " << this->FileSize << "\n";
   os << indent << "MetaData: " << this->MetaData << "\n";
   os << indent << "Index: " << this->Index << "\n";
   os << indent << "BufferSize: " << this->BufferSize << "\n";
+  os << indent << "Sniff: " << (this->Sniff ? "On\n" : "Off\n");
   os << indent << "Groups: " << this->Groups << "\n";
 }
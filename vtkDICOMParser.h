@@ -16,6 +16,7 @@
 
 #include <vtkObject.h>
 #include "vtkDICOMModule.h"
+#include "vtkDICOMItem.h"
 
 #include <string>
 #include <stdio.h>
@@ -60,16 +61,55 @@ public:
   void SetGroups(vtkUnsignedShortArray *groups);
   vtkUnsignedShortArray *GetGroups() { return this->Groups; }
 
+  //! Check the file header before parsing (off by default).
+  /*!
+   *  When this is on, the parser checks the first bytes that it reads
+   *  from the file for the DICM magic number or, failing that, for
+   *  data elements that look like DICOM.  Files that fail this check,
+   *  including directories and unreadable files, are skipped without
+   *  generating an error message, and the error code is set to
+   *  UnrecognizedFileTypeError.  This allows a list of files to be
+   *  filtered and parsed with only a single open() per file.
+   */
+  vtkSetMacro(Sniff, int);
+  vtkBooleanMacro(Sniff, int);
+  int GetSniff() { return this->Sniff; }
+
+  //! Set a query, so that only matching files will be fully read.
+  /*!
+   *  The query is an item that contains the attributes to match, using
+   *  the rules described in vtkDICOMValue::Matches().  Each attribute
+   *  is checked as soon as its group has been read, and if any attribute
+   *  fails to match, the parser stops reading the file and sets
+   *  QueryMatched to false.  Groups that contain query attributes are
+   *  always read, even if they are not in the list set by SetGroups().
+   */
+  void SetQuery(const vtkDICOMItem& query);
+  const vtkDICOMItem& GetQuery() { return this->Query; }
+
+  //! This is false if the file did not match the query.
+  bool GetQueryMatched() { return this->QueryMatched; }
+
   //! This is true only if PixelData was found in the file.
   bool GetPixelDataFound() { return this->PixelDataFound; }
 
   //! Get the byte offset to the end of the metadata.
   /*!
    *  After the metadata has been read, the file offset
-   *  will be set to the position of the pixel data.
+   *  will be set to the position of the pixel data.  For the
+   *  deflated transfer syntax (1.2.840.10008.1.2.1.99), this is
+   *  the offset within the file as it would be after inflation.
    */
   vtkTypeInt64 GetFileOffset() { return this->FileOffset; }
 
+  //! Get the byte offset to the data set that follows the meta header.
+  /*!
+   *  For the deflated transfer syntax, this is where the compressed
+   *  data begins, and GetFileOffset() minus this value is the offset
+   *  to the pixel data within the inflated data set.
+   */
+  vtkTypeInt64 GetDataSetOffset() { return this->DataSetOffset; }
+
   //! Get the total file length (only valid after Update).
   vtkTypeInt64 GetFileSize() { return this->FileSize; }
 
@@ -84,6 +124,17 @@ public:
   //! Read the metadata from the file.
   virtual void Update();
 
+  //! Read data from a file that uses the deflated transfer syntax.
+  /*!
+   *  The file must be positioned at the data set offset, where the
+   *  deflated data begins.  The first "skip" bytes of inflated data
+   *  are discarded, and then up to "n" bytes are inflated into the
+   *  buffer.  The return value is the number of bytes that were put
+   *  into the buffer, which is less than "n" if an error occurred.
+   */
+  static size_t ReadDeflatedData(
+    FILE *file, vtkTypeInt64 skip, char *buffer, size_t n);
+
   //! Get the error code.
   unsigned long GetErrorCode() { return this->ErrorCode; }
 
@@ -129,6 +180,15 @@ protected:
     const unsigned char* &cp, const unsigned char* &ep,
     vtkDICOMMetaData *data, int idx);
 
+  //! Check the query against the elements that have been read so far.
+  /*!
+   *  The iterator is advanced past all query elements that belong
+   *  to groups up to and including the specified group.
+   */
+  bool MatchQuery(
+    vtkDICOMDataElementIterator &iter, unsigned short group,
+    vtkDICOMMetaData *data, int idx);
+
   //! Compute the file offset to the current position.
   vtkTypeInt64 GetBytesProcessed(
     const unsigned char* cp, const unsigned char* ep);
@@ -137,16 +197,20 @@ protected:
   std::string TransferSyntax;
   vtkDICOMMetaData *MetaData;
   vtkUnsignedShortArray *Groups;
+  vtkDICOMItem Query;
   FILE *InputFile;
   vtkTypeInt64 BytesRead;
   vtkTypeInt64 FileOffset;
+  vtkTypeInt64 DataSetOffset;
   vtkTypeInt64 FileSize;
   char *Buffer;
   int BufferSize;
   int ChunkSize;
   int Index;
+  int Sniff;
   unsigned long ErrorCode;
   bool PixelDataFound;
+  bool QueryMatched;
 
   // used to share FillBuffer with internal classes
   friend class vtkDICOMParserInternalFriendship;
@@ -154,6 +218,11 @@ protected:
 private:
   vtkDICOMParser(const vtkDICOMParser&);  // Not implemented.
   void operator=(const vtkDICOMParser&);  // Not implemented.
+
+  class InflateState;
+
+  //! The zlib stream, when reading the deflated transfer syntax.
+  InflateState *Inflate;
 };
 
 #endif /* __vtkDICOMParser_h */
@@ -18,6 +18,7 @@
 #include "vtkDICOMSequence.h"
 #include "vtkDICOMItem.h"
 #include "vtkDICOMTagPath.h"
+#include "vtkDICOMUtilities.h"
 
 #include "vtkObjectFactory.h"
 #include "vtkImageData.h"
@@ -88,6 +89,7 @@ vtkDICOMReader::vtkDICOMReader()
   this->TimeDimension = 0;
   this->TimeSpacing = 1.0;
   this->DesiredStackID[0] = '\0';
+  this->MemoryMapDirectory = 0;
 
   this->DataScalarType = VTK_SHORT;
   this->NumberOfScalarComponents = 1;
@@ -143,6 +145,7 @@ vtkDICOMReader::~vtkDICOMReader()
     {
     this->PatientMatrix->Delete();
     }
+  delete [] this->MemoryMapDirectory;
 }
 
 //----------------------------------------------------------------------------
@@ -195,6 +198,9 @@ void vtkDICOMReader::PrintSelf(ostream& os, vtkIndent indent)
 
   os << indent << "MemoryRowOrder: "
      << this->GetMemoryRowOrderAsString() << "\n";
+  os << indent << "MemoryMapDirectory: "
+     << (this->MemoryMapDirectory ? this->MemoryMapDirectory : "(none)")
+     << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -281,6 +287,7 @@ int vtkDICOMReader::CanReadFile(const char *filename)
 
   // add a dummy observer to silence errors
   unsigned long cid = parser->AddObserver(vtkCommand::ErrorEvent, command);
+  parser->SniffOn();
   parser->SetFileName(filename);
   parser->Update();
   parser->RemoveObserver(cid);
@@ -302,18 +309,19 @@ struct vtkDICOMReaderSortInfo
   int PositionNumber;
   double ComputedLocation;
   double Time;
+  double SortKey;
 
   vtkDICOMReaderSortInfo() :
     FileNumber(0), FrameNumber(0), InstanceNumber(0), PositionNumber(0),
-    ComputedLocation(0.0), Time(0.0) {}
+    ComputedLocation(0.0), Time(0.0), SortKey(0.0) {}
 
   vtkDICOMReaderSortInfo(int i, int j, int k, int s, double l, double t) :
     FileNumber(i), FrameNumber(j), InstanceNumber(k), PositionNumber(s),
-    ComputedLocation(l), Time(t) {}
+    ComputedLocation(l), Time(t), SortKey(0.0) {}
 
   vtkDICOMReaderSortInfo(int i, int k) :
     FileNumber(i), FrameNumber(0), InstanceNumber(k), PositionNumber(0),
-    ComputedLocation(0), Time(0) {}
+    ComputedLocation(0), Time(0), SortKey(0.0) {}
 
   // for sorting by by instance number
   static bool CompareInstance(
@@ -322,23 +330,94 @@ struct vtkDICOMReaderSortInfo
     return (si1.InstanceNumber < si2.InstanceNumber);
   }
 
-  // for sorting by position number
-  static bool ComparePosition(
+  // for sorting by the precomputed key (location or position number)
+  static bool CompareKey(
     const vtkDICOMReaderSortInfo &si1, const vtkDICOMReaderSortInfo &si2)
   {
-    return (si1.PositionNumber < si2.PositionNumber);
+    // keys must differ by at least the tolerance, since position
+    // numbers are integers this tolerance only affects locations
+    const double keyTolerance = 1e-3;
+    return (si1.SortKey + keyTolerance < si2.SortKey);
   }
 
-  // for sorting by spatial location
-  static bool CompareLocation(
+  // for sorting by key, and then by time for slices at the same key
+  static bool CompareKeyAndTime(
     const vtkDICOMReaderSortInfo &si1, const vtkDICOMReaderSortInfo &si2)
   {
-    // locations must differ by at least the tolerance
-    const double locationTolerance = 1e-3;
-    return (si1.ComputedLocation + locationTolerance < si2.ComputedLocation);
+    const double timeTolerance = 1e-3;
+    return (CompareKey(si1, si2) ||
+            (!CompareKey(si2, si1) && si1.Time + timeTolerance < si2.Time));
   }
 };
 
+// the functional groups that provide the sort keys for a frame
+struct vtkDICOMReaderFrameGroups
+{
+  const vtkDICOMItem *Content;
+  const vtkDICOMItem *Time;
+  const vtkDICOMItem *Position;
+  const vtkDICOMItem *Orientation;
+
+  vtkDICOMReaderFrameGroups() :
+    Content(0), Time(0), Position(0), Orientation(0) {}
+
+  // find all the groups with a single pass through the item
+  void Find(const vtkDICOMItem& item, vtkDICOMTag timeSequence);
+};
+
+void vtkDICOMReaderFrameGroups::Find(
+  const vtkDICOMItem& item, vtkDICOMTag timeSequence)
+{
+  vtkDICOMDataElementIterator iter = item.Begin();
+  vtkDICOMDataElementIterator iterEnd = item.End();
+  for (; iter != iterEnd; ++iter)
+    {
+    vtkDICOMTag tag = iter->GetTag();
+    const vtkDICOMItem *items = iter->GetValue().GetSequenceData();
+    if (items == 0 || iter->GetValue().GetNumberOfValues() == 0)
+      {
+      continue;
+      }
+    // the time sequence might also be the frame content sequence
+    if (tag == timeSequence)
+      {
+      this->Time = items;
+      }
+    if (tag == DC::FrameContentSequence)
+      {
+      this->Content = items;
+      }
+    else if (tag == DC::PlanePositionSequence)
+      {
+      this->Position = items;
+      }
+    else if (tag == DC::PlaneOrientationSequence)
+      {
+      this->Orientation = items;
+      }
+    }
+}
+
+// get a value from a per-frame group, or from the shared group
+vtkDICOMValue vtkDICOMReaderGetGroupValue(
+  const vtkDICOMItem *frameGroup, const vtkDICOMItem *sharedGroup,
+  vtkDICOMTag tag)
+{
+  if (frameGroup)
+    {
+    const vtkDICOMValue& v = frameGroup->GetAttributeValue(tag);
+    if (v.IsValid())
+      {
+      return v;
+      }
+    }
+  if (sharedGroup)
+    {
+    return sharedGroup->GetAttributeValue(tag);
+    }
+  return vtkDICOMValue();
+}
+
 // get an attribute value for a particular frame
 const vtkDICOMValue& vtkDICOMReaderGetFrameAttributeValue(
   const vtkDICOMSequence& frameSeq, const vtkDICOMSequence& sharedSeq,
@@ -522,20 +601,17 @@ void vtkDICOMReader::SortFiles(vtkIntArray *files, vtkIntArray *frames)
   int numFiles = meta->GetNumberOfInstances();
   std::vector<vtkDICOMReaderSortInfo> info;
 
-  // sort by instance first
+  // sort the files by instance first, the instance numbers are kept
+  // so that they do not have to be looked up again for each frame
+  std::vector<vtkDICOMReaderSortInfo> fileOrder;
+  fileOrder.reserve(numFiles);
   for (int i = 0; i < numFiles; i++)
     {
     int inst = meta->GetAttributeValue(i, DC::InstanceNumber).AsInt();
-    info.push_back(vtkDICOMReaderSortInfo(i, inst));
+    fileOrder.push_back(vtkDICOMReaderSortInfo(i, inst));
     }
-  std::stable_sort(info.begin(), info.end(),
+  std::stable_sort(fileOrder.begin(), fileOrder.end(),
     vtkDICOMReaderSortInfo::CompareInstance);
-  std::vector<int> fileOrder(info.size());
-  for (int i = 0; i < numFiles; i++)
-    {
-    fileOrder[i] = info[i].FileNumber;
-    }
-  info.clear();
 
   // important position-related variables
   std::vector<size_t> volumeBreaks;
@@ -568,10 +644,13 @@ void vtkDICOMReader::SortFiles(vtkIntArray *files, vtkIntArray *frames)
     bool canSortStackByIPP = true;
 
     // files have enhanced frame information
+    // the most recently seen StackID, to avoid searching StackIDs
+    vtkDICOMValue lastStackId;
+
     for (int ii = 0; ii < numFiles; ii++)
       {
-      int i = fileOrder[ii];
-      int inst = meta->GetAttributeValue(i, DC::InstanceNumber).AsInt();
+      int i = fileOrder[ii].FileNumber;
+      int inst = fileOrder[ii].InstanceNumber;
       int numberOfFrames =
         meta->GetAttributeValue(i, DC::NumberOfFrames).AsInt();
 
@@ -626,18 +705,34 @@ void vtkDICOMReader::SortFiles(vtkIntArray *files, vtkIntArray *frames)
           }
         }
 
+      // the shared groups only have to be found once per file
+      vtkDICOMReaderFrameGroups shared;
+      if (sharedSeq.GetNumberOfItems() > 0)
+        {
+        shared.Find(sharedSeq.GetItem(0), timeSequence);
+        }
+      const vtkDICOMItem *frameItems = frameSeq.GetSequenceData();
+      int numberOfFrameItems = frameSeq.GetNumberOfItems();
+
       // position counter
       int position = 0;
       double lastTime = 0.0;
 
       for (int k = 0; k < numberOfFrames; k++)
         {
+        // extract all keys for this frame from the groups found here
+        vtkDICOMReaderFrameGroups groups;
+        if (k < numberOfFrameItems)
+          {
+          groups.Find(frameItems[k], timeSequence);
+          }
+
         // time: use chosen time tag, if present
         double t = 0.0;
         if (timeTag.GetGroup() != 0)
           {
-          t = vtkDICOMReaderGetFrameAttributeValue(
-            frameSeq, sharedSeq, k, timeSequence, timeTag).AsDouble();
+          t = vtkDICOMReaderGetGroupValue(
+            groups.Time, shared.Time, timeTag).AsDouble();
           }
 
         // adjust position only if time did not change
@@ -648,13 +743,13 @@ void vtkDICOMReader::SortFiles(vtkIntArray *files, vtkIntArray *frames)
           }
 
         // get the StackID
-        vtkDICOMValue stackId = vtkDICOMReaderGetFrameAttributeValue(
-          frameSeq, sharedSeq, k, DC::FrameContentSequence,
-          DC::StackID);
+        vtkDICOMValue stackId = vtkDICOMReaderGetGroupValue(
+          groups.Content, shared.Content, DC::StackID);
 
-        if (stackId.IsValid())
+        if (stackId.IsValid() && !(stackId == lastStackId))
           {
           // append new StackIDs to this->StackIDs
+          lastStackId = stackId;
           vtkIdType stacksFound = this->StackIDs->GetNumberOfValues();
           std::string stackName = stackId.AsString();
           vtkIdType si;
@@ -666,19 +761,21 @@ void vtkDICOMReader::SortFiles(vtkIntArray *files, vtkIntArray *frames)
             {
             this->StackIDs->InsertNextValue(stackName);
             }
+          }
 
+        if (stackId.IsValid())
+          {
           // position: look for InStackPositionNumber
-          position = vtkDICOMReaderGetFrameAttributeValue(
-            frameSeq, sharedSeq, k, DC::FrameContentSequence,
+          position = vtkDICOMReaderGetGroupValue(
+            groups.Content, shared.Content,
             DC::InStackPositionNumber).AsInt();
           }
 
         // check for valid Image Plane Module information
-        vtkDICOMValue pv = vtkDICOMReaderGetFrameAttributeValue(
-          frameSeq, sharedSeq, k, DC::PlanePositionSequence,
-          DC::ImagePositionPatient);
-        vtkDICOMValue ov = vtkDICOMReaderGetFrameAttributeValue(
-          frameSeq, sharedSeq, k, DC::PlaneOrientationSequence,
+        vtkDICOMValue pv = vtkDICOMReaderGetGroupValue(
+          groups.Position, shared.Position, DC::ImagePositionPatient);
+        vtkDICOMValue ov = vtkDICOMReaderGetGroupValue(
+          groups.Orientation, shared.Orientation,
           DC::ImageOrientationPatient);
 
         // check if the StackId is the one the user specified
@@ -751,10 +848,8 @@ void vtkDICOMReader::SortFiles(vtkIntArray *files, vtkIntArray *frames)
 
     for (int ii = 0; ii < numFiles; ii++)
       {
-      int i = fileOrder[ii];
-
-      // get the instance number
-      int inst = meta->GetAttributeValue(i, DC::InstanceNumber).AsInt();
+      int i = fileOrder[ii].FileNumber;
+      int inst = fileOrder[ii].InstanceNumber;
 
       // check for valid Image Plane Module information
       // (for NM this information is per-detector and is put in
@@ -887,17 +982,14 @@ void vtkDICOMReader::SortFiles(vtkIntArray *files, vtkIntArray *frames)
   if (volumeBreaks.size() > 0)
     {
     // count the number of unique positions
-    size_t pcount = 0;
+    std::vector<int> positions(info.size());
     for (size_t j = 0; j < info.size(); j++)
       {
-      int p = info[j].PositionNumber;
-      size_t k;
-      for (k = 0; k < j; k++)
-        {
-        if (info[k].PositionNumber == p) { break; }
-        }
-      pcount += (k == j);
+      positions[j] = info[j].PositionNumber;
       }
+    std::sort(positions.begin(), positions.end());
+    size_t pcount =
+      std::unique(positions.begin(), positions.end()) - positions.begin();
 
     if (volumeBreaks.size() + 1 > pcount/2)
       {
@@ -932,16 +1024,15 @@ void vtkDICOMReader::SortFiles(vtkIntArray *files, vtkIntArray *frames)
   int slicesPerLocation = 0;
   if (numSlices > 1)
     {
-    if (canSortByLocation)
-      {
-      std::stable_sort(info.begin(), info.end(),
-        vtkDICOMReaderSortInfo::CompareLocation);
-      }
-    else
+    // choose the key once, so that one sort by key and then by time
+    // puts the slices at each location into temporal order
+    for (int j = 0; j < numSlices; j++)
       {
-      std::stable_sort(info.begin(), info.end(),
-        vtkDICOMReaderSortInfo::ComparePosition);
+      info[j].SortKey = (canSortByLocation ? info[j].ComputedLocation :
+                         static_cast<double>(info[j].PositionNumber));
       }
+    std::stable_sort(info.begin(), info.end(),
+      vtkDICOMReaderSortInfo::CompareKeyAndTime);
 
     // look for slices at the same location
     std::vector<vtkDICOMReaderSortInfo>::iterator iter = info.begin();
@@ -953,17 +1044,9 @@ void vtkDICOMReader::SortFiles(vtkIntArray *files, vtkIntArray *frames)
       bool positionIncreased = false;
       if (nextIter != info.end())
         {
-        // use the tolerance built into CompareLocation
-        if (canSortByLocation)
-          {
-          positionIncreased =
-            vtkDICOMReaderSortInfo::CompareLocation(*iter, *nextIter);
-          }
-        else
-          {
-          positionIncreased =
-            vtkDICOMReaderSortInfo::ComparePosition(*iter, *nextIter);
-          }
+        // use the tolerance built into CompareKey
+        positionIncreased =
+          vtkDICOMReaderSortInfo::CompareKey(*iter, *nextIter);
         }
       if (nextIter == info.end() || positionIncreased)
         {
@@ -995,7 +1078,7 @@ void vtkDICOMReader::SortFiles(vtkIntArray *files, vtkIntArray *frames)
     tMin = (d > tMin ? tMin : d);
     tMax = (d < tMax ? tMax : d);
     int u = 1;
-    for (int j = 0; j < i; j++)
+    for (int j = 0; j < i && u != 0; j++)
       {
       u &= !(fabs(info[j].Time - d) < 1e-3);
       }
@@ -1159,9 +1242,10 @@ int vtkDICOMReader::RequestInformation(
   this->Parser->AddObserver(
     vtkCommand::ErrorEvent, this, &vtkDICOMReader::RelayError);
 
-  // First component is offset to pixel data, 2nd component is file size.
+  // First component is offset to pixel data, 2nd component is file size,
+  // 3rd component is offset to the data set (for deflated files).
   this->FileOffsetArray = vtkTypeInt64Array::New();
-  this->FileOffsetArray->SetNumberOfComponents(2);
+  this->FileOffsetArray->SetNumberOfComponents(3);
   this->FileOffsetArray->SetNumberOfTuples(numFiles);
 
   for (int idx = 0; idx < numFiles; idx++)
@@ -1177,9 +1261,10 @@ int vtkDICOMReader::RequestInformation(
       }
 
     // save the offset to the pixel data
-    vtkTypeInt64 offset[2];
+    vtkTypeInt64 offset[3];
     offset[0] = this->Parser->GetFileOffset();
     offset[1] = this->Parser->GetFileSize();
+    offset[2] = this->Parser->GetDataSetOffset();
     this->FileOffsetArray->SetTupleValue(idx, offset);
     }
 
@@ -1627,10 +1712,22 @@ bool vtkDICOMReader::ReadUncompressedFile(
   const char *filename, int fileIdx, char *buffer, vtkIdType bufferSize)
 {
   // get the offset to the PixelData in the file
-  vtkTypeInt64 offsetAndSize[2];
+  vtkTypeInt64 offsetAndSize[3];
   this->FileOffsetArray->GetTupleValue(fileIdx, offsetAndSize);
   vtkTypeInt64 offset = offsetAndSize[0];
 
+  // for deflated files, the offset is within the inflated data set,
+  // so seek to the start of the data set and inflate from there
+  std::string transferSyntax = this->MetaData->GetAttributeValue(
+    fileIdx, DC::TransferSyntaxUID).AsString();
+  bool deflated = (transferSyntax == "1.2.840.10008.1.2.1.99");
+  vtkTypeInt64 skip = 0;
+  if (deflated)
+    {
+    skip = offset - offsetAndSize[2];
+    offset = offsetAndSize[2];
+    }
+
   vtkDebugMacro("Opening DICOM file " << filename);
   FILE *infile = fopen(filename, "rb");
 
@@ -1663,34 +1760,41 @@ bool vtkDICOMReader::ReadUncompressedFile(
 
   size_t readSize = bufferSize;
   size_t resultSize = 0;
+  char *filePtr = buffer;
   if (bitsAllocated == 12)
     {
     // unpack 12 bits little endian into 16 bits little endian,
     // the result will have to be swapped if machine is BE (the
     // swapping is done at the end of this function)
     readSize = bufferSize/2 + (bufferSize+3)/4;
-    char *filePtr = buffer + (bufferSize - readSize);
-    resultSize = fread(filePtr, 1, readSize, infile);
-
-    vtkDICOMReader::UnpackBits(filePtr, buffer, bufferSize, bitsAllocated);
+    filePtr = buffer + (bufferSize - readSize);
     }
   else if (bitsAllocated == 1)
     {
     // unpack 1 bit into 8 bits, source assumed to be either OB
     // or little endian OW, never big endian OW
     readSize = (bufferSize + 7)/8;
-    char *filePtr = buffer + (bufferSize - readSize);
-    resultSize = fread(filePtr, 1, readSize, infile);
+    filePtr = buffer + (bufferSize - readSize);
+    }
 
-    vtkDICOMReader::UnpackBits(filePtr, buffer, bufferSize, bitsAllocated);
+  if (deflated)
+    {
+    resultSize = vtkDICOMParser::ReadDeflatedData(
+      infile, skip, filePtr, readSize);
     }
   else
     {
-    resultSize = fread(buffer, 1, readSize, infile);
+    resultSize = fread(filePtr, 1, readSize, infile);
     }
 
+  if (bitsAllocated == 12 || bitsAllocated == 1)
+    {
+    vtkDICOMReader::UnpackBits(filePtr, buffer, bufferSize, bitsAllocated);
+    }
+
+  // inflating reads ahead, so it is expected to reach the end of file
   bool success = true;
-  if (feof(infile) || resultSize != readSize)
+  if ((feof(infile) && !deflated) || resultSize != readSize)
     {
     this->SetErrorCode(vtkErrorCode::PrematureEndOfFileError);
     vtkErrorMacro("DICOM file is truncated, " <<
@@ -1815,6 +1919,7 @@ bool vtkDICOMReader::ReadOneFile(
   if (transferSyntax == "1.2.840.10008.1.2"   ||  // Implicit LE
       transferSyntax == "1.2.840.10008.1.20"  ||  // Papyrus Implicit LE
       transferSyntax == "1.2.840.10008.1.2.1" ||  // Explicit LE
+      transferSyntax == "1.2.840.10008.1.2.1.99" || // Deflated Explicit LE
       transferSyntax == "1.2.840.10008.1.2.2" ||  // Explicit BE
       transferSyntax == "1.2.840.113619.5.2"  ||  // GE LE with BE data
       transferSyntax == "")
@@ -1890,11 +1995,31 @@ int vtkDICOMReader::RequestData(
   // get the data object, allocate memory
   vtkImageData *data =
     static_cast<vtkImageData *>(outInfo->Get(vtkDataObject::DATA_OBJECT()));
+  vtkDataArray *array = 0;
+  if (this->MemoryMapDirectory)
+    {
+    // use a memory-mapped scratch file instead of the heap
+    vtkIdType numTuples = extent[1] - extent[0] + 1;
+    numTuples *= extent[3] - extent[2] + 1;
+    numTuples *= extent[5] - extent[4] + 1;
+    array = vtkDICOMUtilities::NewScratchArray(
+      this->DataScalarType, this->NumberOfScalarComponents, numTuples,
+      this->MemoryMapDirectory);
+    }
+  if (array)
+    {
+    data->SetExtent(extent);
+    data->GetPointData()->SetScalars(array);
+    array->Delete();
+    }
+  else
+    {
 #if VTK_MAJOR_VERSION >= 6
-  this->AllocateOutputData(data, outInfo, extent);
+    this->AllocateOutputData(data, outInfo, extent);
 #else
-  this->AllocateOutputData(data, extent);
+    this->AllocateOutputData(data, extent);
 #endif
+    }
 
   data->GetPointData()->GetScalars()->SetName("PixelData");
 
@@ -162,6 +162,18 @@ public:
   int GetMemoryRowOrder() { return this->MemoryRowOrder; }
   const char *GetMemoryRowOrderAsString();
 
+  // Description:
+  // Set a directory for a scratch file that will hold the image.
+  // If this is set, then rather than allocating memory for the output,
+  // the reader creates a temporary file in this directory and maps it
+  // into memory, so that series that are larger than the available RAM
+  // can be read and the operating system can page the pixels in and out
+  // as they are used.  The file is deleted when the output scalars are
+  // deleted.  If the file cannot be created, memory is allocated as
+  // usual.  The default is NULL, which means no scratch file.
+  vtkSetStringMacro(MemoryMapDirectory);
+  vtkGetStringMacro(MemoryMapDirectory);
+
 protected:
   vtkDICOMReader();
   ~vtkDICOMReader();
@@ -189,7 +201,8 @@ protected:
     const void *source, void *buffer, vtkIdType bufferSize, int bits);
 
   // Description:
-  // Read an uncompressed DICOM file.
+  // Read an uncompressed DICOM file.  This also reads files with the
+  // deflated transfer syntax, since only the data set is compressed.
   virtual bool ReadUncompressedFile(
     const char *filename, int idx, char *buffer, vtkIdType bufferSize);
 
@@ -280,6 +293,10 @@ protected:
   // The stack to load.
   char DesiredStackID[20];
 
+  // Description:
+  // The directory for the memory-mapped scratch file.
+  char *MemoryMapDirectory;
+
 private:
   vtkDICOMReader(const vtkDICOMReader&);  // Not implemented.
   void operator=(const vtkDICOMReader&);  // Not implemented.
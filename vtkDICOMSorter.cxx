@@ -13,6 +13,7 @@
 =========================================================================*/
 #include "vtkDICOMSorter.h"
 #include "vtkDICOMMetaData.h"
+#include "vtkDICOMItem.h"
 #include "vtkDICOMParser.h"
 #include "vtkDICOMUtilities.h"
 
@@ -80,6 +81,7 @@ vtkDICOMSorter::vtkDICOMSorter()
   this->ErrorCode = 0;
   this->InternalFileName = 0;
   this->RequirePixelData = 1;
+  this->Query = new vtkDICOMItem;
 }
 
 //----------------------------------------------------------------------------
@@ -100,6 +102,7 @@ vtkDICOMSorter::~vtkDICOMSorter()
 
   this->OutputFileNames->Delete();
   delete this->Series;
+  delete this->Query;
   this->Studies->Delete();
 }
 
@@ -115,6 +118,9 @@ void vtkDICOMSorter::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "RequirePixelData: "
      << (this->RequirePixelData ? "On\n" : "Off\n");
 
+  os << indent << "FindQuery: ("
+     << this->Query->GetNumberOfDataElements() << " elements)\n";
+
   os << indent << "NumberOfSeries: " << this->GetNumberOfSeries() << "\n";
   os << indent << "NumberOfStudies: " << this->GetNumberOfStudies() << "\n";
 
@@ -145,6 +151,13 @@ void vtkDICOMSorter::SetInputFileName(const char *name)
   this->Modified();
 }
 
+//----------------------------------------------------------------------------
+void vtkDICOMSorter::SetFindQuery(const vtkDICOMItem& query)
+{
+  *this->Query = query;
+  this->Modified();
+}
+
 //----------------------------------------------------------------------------
 void vtkDICOMSorter::SetInputFileNames(vtkStringArray *input)
 {
@@ -229,6 +242,8 @@ void vtkDICOMSorter::SortFiles(vtkStringArray *input)
   groups->InsertNextValue(0x0020);
   parser->SetMetaData(meta);
   parser->SetGroups(groups);
+  parser->SetQuery(*this->Query);
+  parser->SniffOn();
 
   FileInfoVectorList sortedFiles;
   FileInfoVectorList::iterator li;
@@ -237,19 +252,24 @@ void vtkDICOMSorter::SortFiles(vtkStringArray *input)
   for (vtkIdType j = 0; j < numberOfStrings; j++)
     {
     const std::string& fileName = input->GetValue(j);
-    this->SetInternalFileName(fileName.c_str());
-
-    // Skip anything that is a directory
-    if (vtksys::SystemTools::FileIsDirectory(fileName.c_str()))
-      {
-      continue;
-      }
 
     // Read the file metadata
     meta->Initialize();
     this->SetInternalFileName(fileName.c_str());
     parser->SetFileName(fileName.c_str());
     parser->Update();
+
+    // Skip directories and anything else that is not DICOM
+    if (parser->GetErrorCode() == vtkErrorCode::UnrecognizedFileTypeError)
+      {
+      continue;
+      }
+
+    // Skip files that do not match the query.
+    if (!parser->GetQueryMatched())
+      {
+      continue;
+      }
     if (!parser->GetPixelDataFound())
       {
       if (!this->ErrorCode)
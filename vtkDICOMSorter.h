@@ -20,6 +20,7 @@
 class vtkStringArray;
 class vtkIntArray;
 class vtkDICOMMetaData;
+class vtkDICOMItem;
 
 //! Sort DICOM files and group them by study and series.
 /*!
@@ -54,6 +55,16 @@ public:
   void SetInputFileNames(vtkStringArray *input);
   vtkStringArray *GetInputFileNames() { return this->InputFileNames; }
 
+  //! Set a query, so that only matching files will be returned.
+  /*!
+   *  The query is an item that contains the attributes to match, using
+   *  the rules described in vtkDICOMValue::Matches().  The query is
+   *  given to the parser, which stops reading any file that cannot
+   *  match, so the files that fail the query are only partially read.
+   */
+  void SetFindQuery(const vtkDICOMItem& query);
+  const vtkDICOMItem& GetFindQuery() { return *this->Query; }
+
   //! Update the information about the files.
   /*!
    * This method must be called before any of the Get methods.
@@ -142,6 +153,7 @@ private:
 
   StringArrayVector *Series;
   vtkIntArray *Studies;
+  vtkDICOMItem *Query;
 
   //! Compare FileInfo entries by instance number
   static bool CompareInstance(const FileInfo &fi1, const FileInfo &fi2);
@@ -13,9 +13,13 @@
 =========================================================================*/
 
 #include <vtkStringArray.h>
+#include <vtkDataArray.h>
+#include <vtkCallbackCommand.h>
 #include "vtkDICOMUtilities.h"
 
 #include <string>
+#include <vector>
+#include <algorithm>
 
 #include <stdio.h>
 #include <string.h>
@@ -33,28 +37,47 @@
 #ifdef _WIN32
 #include <windows.h>
 #include <wincrypt.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
 #endif
 
 namespace {
 
-// divide a hex string by 10, return remainder
-int vtkDivideHexStringBy10(char *value)
+// convert a hex uuid string to a decimal uid string, the
+// supplied uid will be at most 1.5 times as long as the uuid
+void vtkConvertHexToDecimal(const char *uuid, char *uid)
 {
-  char *cp = value;
+  // max characters in a uuid and uid
+  const unsigned int uuidlen = 36;
+  const unsigned int uidlen = 64;
+
+  if (uuid[0] == '0' && uuid[1] == 'x')
+    {
+    uuid += 2;
+    }
+
+  // convert hex string to binary, as 32-bit words with the least
+  // significant word first
+  const int nwords = (uuidlen + 7)/8;
+  unsigned int x[nwords];
+  for (int k = 0; k < nwords; k++)
+    {
+    x[k] = 0;
+    }
 
-  // convert hex string to binary
-  unsigned int x = 0;
-  while (*cp != '\0')
+  for (unsigned int i = 0; i < uuidlen && uuid[i] != '\0'; i++)
     {
     // skip any hyphens
-    if (*cp == '-')
+    if (uuid[i] == '-')
       {
-      cp++;
       continue;
       }
 
     // convert hex digit to a nibble
-    unsigned int d = *cp;
+    unsigned int d = uuid[i];
     if ((d -= '0') > 9)
       {
       if ((d -= ('A' - '0' - 10)) > 15)
@@ -64,71 +87,45 @@ int vtkDivideHexStringBy10(char *value)
       }
 
     // append the nibble
-    x <<= 4;
-    x += d;
-
-    // divide by 10
-    unsigned int y = (10 << 3);
-    unsigned int z = 0;
-    int i;
-    for (i = 0; i < 4; i++)
+    for (int k = 0; k < nwords; k++)
       {
-      z <<= 1;
-      int nx = x - y;
-      if (nx >= 0)
-        {
-        x = nx;
-        z++;
-        }
-      y >>= 1;
+      unsigned int c = (x[k] >> 28);
+      x[k] = ((x[k] << 4) | d);
+      d = c;
       }
-
-    // convert quotient to new hex digit
-    if ((z += '0') > '9')
-      {
-      z += ('A' - '0' - 10);
-      }
-
-    *cp++ = static_cast<char>(z);
     }
 
-  // return the remainder
-  return static_cast<int>(x);
-}
-
-// convert a hex uuid string to a decimal uid string, the
-// supplied uid will be at most 1.5 times as long as the uuid
-void vtkConvertHexToDecimal(const char *uuid, char *uid)
-{
-  // max characters in a uuid and uid
-  const unsigned int uuidlen = 36;
-  const unsigned int uidlen = 64;
-
-  char x[uuidlen + 4];
   char y[uidlen + 4];
-
-  if (uuid[0] == '0' && uuid[1] == 'x')
-    {
-    uuid += 2;
-    }
-
-  strncpy(x, uuid, uuidlen);
-  x[uuidlen] = '\0';
-
   char *cp = y + uidlen;
   *cp = '\0';
 
-  char *dp = x;
+  // divide by 10^9 to get nine decimal digits at a time
+  int n = nwords;
   do
     {
-    *(--cp) = vtkDivideHexStringBy10(x) + '0';
-    // remove any leading zeros
-    while (*dp == '0' || *dp == '-')
+    unsigned long long r = 0;
+    for (int k = n - 1; k >= 0; k--)
+      {
+      r = ((r << 32) | x[k]);
+      x[k] = static_cast<unsigned int>(r/1000000000u);
+      r %= 1000000000u;
+      }
+    while (n > 0 && x[n - 1] == 0)
+      {
+      n--;
+      }
+
+    // the final group of digits has no leading zeros
+    unsigned int z = static_cast<unsigned int>(r);
+    int i = 0;
+    do
       {
-      dp++;
+      *(--cp) = static_cast<char>('0' + z % 10);
+      z /= 10;
       }
+    while (++i < 9 && (n > 0 || z != 0));
     }
-  while (*dp != '\0');
+  while (n > 0);
 
   // copy out the result
   strcpy(uid, cp);
@@ -222,13 +219,27 @@ void vtkGenerateRandomBytes(char *bytes, vtkIdType n)
     CryptReleaseContext(hProv, 0);
     }
 #else
-  // use the "random" device on unix-like systems
-  FILE *infile = fopen("/dev/random", "rb");
-  if (infile)
-    {
-    size_t m = fread(bytes, 1, n, infile);
-    r = (m == static_cast<size_t>(n));
-    fclose(infile);
+  // use the "urandom" device on unix-like systems, it is seeded from
+  // the same pool as "random" but it never blocks, and it is read
+  // without stdio buffering so that only the needed bytes are read
+  int fd = open("/dev/urandom", O_RDONLY);
+  if (fd >= 0)
+    {
+    vtkIdType m = 0;
+    while (m < n)
+      {
+      ssize_t k = read(fd, bytes + m, n - m);
+      if (k > 0)
+        {
+        m += k;
+        }
+      else if (k == 0 || errno != EINTR)
+        {
+        break;
+        }
+      }
+    r = (m == n);
+    close(fd);
     }
 #endif
   if (r == 0)
@@ -341,6 +352,12 @@ void vtkGeneratePrefixedUID(
     }
 }
 
+// for sorting UIDs numerically
+bool vtkCompareUIDStrings(const std::string& u1, const std::string& u2)
+{
+  return (vtkDICOMUtilities::CompareUIDs(u1.c_str(), u2.c_str()) < 0);
+}
+
 } // end anonymous namespace
 
 //----------------------------------------------------------------------------
@@ -395,11 +412,12 @@ void vtkDICOMUtilities::GenerateUIDs(vtkDICOMTag tag, vtkStringArray *uids)
     d = vtkDICOMTagToDigit(tag);
     }
 
-  // read from random number generator
+  // read all of the random bytes at once
   vtkIdType n = uids->GetNumberOfValues();
   char *r = new char[n*m];
   vtkGenerateRandomBytes(r, n*m);
 
+  std::vector<std::string> uidList(n);
   for (vtkIdType i = 0; i < n; i++)
     {
     char uid[64];
@@ -415,23 +433,17 @@ void vtkDICOMUtilities::GenerateUIDs(vtkDICOMTag tag, vtkStringArray *uids)
       vtkGeneratePrefixedUID(r + i*m, m, prefix, d, uid);
       }
 
-    // put uids into the array in order (simple insertion sort)
-    vtkIdType j = 0;
-    for (; j < i; j++)
-      {
-      if (vtkDICOMUtilities::CompareUIDs(uids->GetValue(j), uid) > 0)
-        {
-        break;
-        }
-      }
-    for (vtkIdType k = i; k > j; --k)
-      {
-      uids->SetValue(k, uids->GetValue(k - 1));
-      }
-    uids->SetValue(j, uid);
+    uidList[i] = uid;
     }
 
   delete [] r;
+
+  // put uids into the array in order
+  std::sort(uidList.begin(), uidList.end(), vtkCompareUIDStrings);
+  for (vtkIdType i = 0; i < n; i++)
+    {
+    uids->SetValue(i, uidList[i]);
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -596,7 +608,7 @@ std::string vtkDICOMUtilities::GenerateDateTime(const char *z)
 //----------------------------------------------------------------------------
 bool vtkDICOMUtilities::IsDICOMFile(const char *filename)
 {
-  char buffer[256];
+  unsigned char buffer[256];
 
   struct stat fs;
   if (filename == 0 || stat(filename, &fs) != 0)
@@ -624,10 +636,22 @@ bool vtkDICOMUtilities::IsDICOMFile(const char *filename)
     return false;
     }
 
-  const char *cp = buffer;
+  return vtkDICOMUtilities::IsDICOMHeader(buffer, rsize);
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMUtilities::IsDICOMHeader(
+  const unsigned char *buffer, size_t size)
+{
+  if (buffer == 0)
+    {
+    return false;
+    }
+
+  const unsigned char *cp = buffer;
 
   // Look for the magic number and the first meta header tag.
-  off_t skip = 128;
+  size_t skip = 128;
   for (int i = 0; i < 2; i++)
     {
     if (size > skip + 8)
@@ -669,6 +693,233 @@ bool vtkDICOMUtilities::IsDICOMFile(const char *filename)
   return false;
 }
 
+//----------------------------------------------------------------------------
+namespace {
+
+// a region of memory that was mapped from a file
+struct vtkDICOMMappedRegion
+{
+  void *Address;
+  size_t Length;
+};
+
+// release the mapping when the array that uses it is deleted
+void vtkDICOMUtilitiesUnmap(
+  vtkObject *, unsigned long, void *clientdata, void *)
+{
+  vtkDICOMMappedRegion *region =
+    static_cast<vtkDICOMMappedRegion *>(clientdata);
+#ifdef _WIN32
+  UnmapViewOfFile(region->Address);
+#else
+  munmap(region->Address, region->Length);
+#endif
+  delete region;
+}
+
+// get the size of the array in bytes, or zero if too large for size_t
+size_t vtkDICOMUtilitiesArrayBytes(
+  int scalarType, int numComponents, vtkIdType numTuples)
+{
+  vtkTypeInt64 n = vtkDataArray::GetDataTypeSize(scalarType);
+  n *= numComponents;
+  n *= numTuples;
+  if (n <= 0 || static_cast<vtkTypeUInt64>(n) >
+      static_cast<vtkTypeUInt64>(static_cast<size_t>(-1)))
+    {
+    return 0;
+    }
+  return static_cast<size_t>(n);
+}
+
+// create an array that uses the mapped memory, starting at "offset"
+vtkDataArray *vtkDICOMUtilitiesMappedArray(
+  int scalarType, int numComponents, vtkIdType numTuples,
+  void *address, size_t length, size_t offset)
+{
+  vtkDataArray *array = vtkDataArray::CreateDataArray(scalarType);
+  array->SetNumberOfComponents(numComponents);
+  array->SetVoidArray(static_cast<char *>(address) + offset,
+                      numTuples*numComponents, 1);
+
+  vtkDICOMMappedRegion *region = new vtkDICOMMappedRegion;
+  region->Address = address;
+  region->Length = length;
+  vtkCallbackCommand *cb = vtkCallbackCommand::New();
+  cb->SetCallback(vtkDICOMUtilitiesUnmap);
+  cb->SetClientData(region);
+  array->AddObserver(vtkCommand::DeleteEvent, cb);
+  cb->Delete();
+
+  return array;
+}
+
+} // end anonymous namespace
+
+//----------------------------------------------------------------------------
+vtkDataArray *vtkDICOMUtilities::NewScratchArray(
+  int scalarType, int numComponents, vtkIdType numTuples,
+  const char *directory)
+{
+  size_t length = vtkDICOMUtilitiesArrayBytes(
+    scalarType, numComponents, numTuples);
+  if (length == 0 || directory == 0)
+    {
+    return 0;
+    }
+
+  void *address = 0;
+
+#ifdef _WIN32
+  // create a temporary file that is deleted when it is closed
+  char filename[MAX_PATH];
+  if (GetTempFileNameA(directory, "vtk", 0, filename) == 0)
+    {
+    return 0;
+    }
+  HANDLE fh = CreateFileA(
+    filename, GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_ALWAYS,
+    FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, 0);
+  if (fh == INVALID_HANDLE_VALUE)
+    {
+    DeleteFileA(filename);
+    return 0;
+    }
+  ULARGE_INTEGER size;
+  size.QuadPart = length;
+  HANDLE mh = CreateFileMappingA(
+    fh, 0, PAGE_READWRITE, size.HighPart, size.LowPart, 0);
+  if (mh)
+    {
+    address = MapViewOfFile(mh, FILE_MAP_ALL_ACCESS, 0, 0, length);
+    CloseHandle(mh);
+    }
+  // the file will be deleted after the view is unmapped
+  CloseHandle(fh);
+#else
+  // create a temporary file and unlink it immediately, so that it
+  // is removed when the mapping is released
+  std::string path = directory;
+  if (path.empty())
+    {
+    path = ".";
+    }
+  if (path[path.length() - 1] != '/')
+    {
+    path += '/';
+    }
+  path += "vtkDICOMXXXXXX";
+  std::vector<char> filename(path.begin(), path.end());
+  filename.push_back('\0');
+  int fd = mkstemp(&filename[0]);
+  if (fd < 0)
+    {
+    return 0;
+    }
+  unlink(&filename[0]);
+#ifdef DICOM_HAVE_POSIX_FALLOCATE
+  // reserve the disk blocks before mapping, because writing to a sparse
+  // mapping would raise SIGBUS if the disk became full
+  int err = posix_fallocate(fd, 0, static_cast<off_t>(length));
+#else
+  // extend the file, which creates a sparse file on most filesystems
+  int err = ftruncate(fd, static_cast<off_t>(length));
+#endif
+  if (err == 0)
+    {
+    address = mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED)
+      {
+      address = 0;
+      }
+    }
+  close(fd);
+#endif
+
+  if (address == 0)
+    {
+    return 0;
+    }
+
+  return vtkDICOMUtilitiesMappedArray(
+    scalarType, numComponents, numTuples, address, length, 0);
+}
+
+//----------------------------------------------------------------------------
+vtkDataArray *vtkDICOMUtilities::NewFileArray(
+  int scalarType, int numComponents, vtkIdType numTuples,
+  const char *filename, vtkTypeInt64 offset)
+{
+  size_t length = vtkDICOMUtilitiesArrayBytes(
+    scalarType, numComponents, numTuples);
+  if (length == 0 || filename == 0 || offset < 0)
+    {
+    return 0;
+    }
+
+  void *address = 0;
+  size_t delta = 0;
+
+#ifdef _WIN32
+  // the mapping must start on an allocation boundary
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  delta = static_cast<size_t>(offset % si.dwAllocationGranularity);
+  HANDLE fh = CreateFileA(
+    filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL, 0);
+  if (fh == INVALID_HANDLE_VALUE)
+    {
+    return 0;
+    }
+  LARGE_INTEGER fileSize;
+  if (GetFileSizeEx(fh, &fileSize) &&
+      fileSize.QuadPart - offset >= static_cast<vtkTypeInt64>(length))
+    {
+    HANDLE mh = CreateFileMappingA(fh, 0, PAGE_WRITECOPY, 0, 0, 0);
+    if (mh)
+      {
+      ULARGE_INTEGER start;
+      start.QuadPart = offset - delta;
+      address = MapViewOfFile(
+        mh, FILE_MAP_COPY, start.HighPart, start.LowPart, length + delta);
+      CloseHandle(mh);
+      }
+    }
+  CloseHandle(fh);
+#else
+  // the mapping must start on a page boundary
+  long pageSize = sysconf(_SC_PAGESIZE);
+  delta = static_cast<size_t>(offset % (pageSize > 0 ? pageSize : 4096));
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    {
+    return 0;
+    }
+  struct stat fs;
+  if (fstat(fd, &fs) == 0 &&
+      fs.st_size - offset >= static_cast<vtkTypeInt64>(length))
+    {
+    // a private mapping is copy-on-write, the file is never modified
+    address = mmap(0, length + delta, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   fd, static_cast<off_t>(offset - delta));
+    if (address == MAP_FAILED)
+      {
+      address = 0;
+      }
+    }
+  close(fd);
+#endif
+
+  if (address == 0)
+    {
+    return 0;
+    }
+
+  return vtkDICOMUtilitiesMappedArray(
+    scalarType, numComponents, numTuples, address, length + delta, delta);
+}
+
 //----------------------------------------------------------------------------
 char vtkDICOMUtilities::UIDPrefix[64] = "2.25.";
 
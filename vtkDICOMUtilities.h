@@ -22,6 +22,7 @@
 #include <string>
 
 class vtkStringArray;
+class vtkDataArray;
 
 //! Utility functions for use with DICOM classes.
 class VTK_DICOM_EXPORT vtkDICOMUtilities : public vtkObject
@@ -47,7 +48,10 @@ public:
    *  the array to specify the number of UIDs that you want to be
    *  stored in it.  The stored UIDs will be sorted, low to high.
    *  Generating a batch of UIDs is more efficient than calling
-   *  GenerateUID() repeatedly.
+   *  GenerateUID() repeatedly, since the random bytes for the whole
+   *  batch are read from the system's random number generator at once.
+   *  Both methods keep no state of their own, so they can be called
+   *  from several threads at the same time.
    */
   static void GenerateUIDs(vtkDICOMTag tag, vtkStringArray *uids);
 
@@ -70,6 +74,15 @@ public:
    */
   static bool IsDICOMFile(const char *filename);
 
+  //! Check if a buffer holds the beginning of a DICOM file.
+  /*!
+   *  This applies the same checks as IsDICOMFile() to data that has
+   *  already been read from a file, so that the file does not have to
+   *  be opened a second time.  The buffer should contain the first 256
+   *  bytes of the file, or the whole file if it is smaller than that.
+   */
+  static bool IsDICOMHeader(const unsigned char *buffer, size_t size);
+
   //! Get the UID for this DICOM implementation.
   static const char *GetImplementationClassUID();
 
@@ -92,6 +105,34 @@ public:
    */
   static void SetImplementationVersionName(const char *name);
 
+  //! Create a data array whose memory is mapped to a scratch file.
+  /*!
+   *  A temporary file that is large enough for the array is created in
+   *  the given directory and is mapped into memory, so that the operating
+   *  system can page the data out to the file instead of to swap.  The
+   *  file is removed as soon as it is created, and the mapping is released
+   *  when the array is deleted.  If the array is resized, the new memory
+   *  is allocated normally.  NULL is returned if the file cannot be
+   *  created or mapped.  The caller must delete the array.
+   */
+  static vtkDataArray *NewScratchArray(
+    int scalarType, int numComponents, vtkIdType numTuples,
+    const char *directory);
+
+  //! Create a data array that is a copy-on-write mapping of a file.
+  /*!
+   *  The array will share its memory with the file, starting at the
+   *  given offset, and the data will be paged in from the file as it
+   *  is accessed.  Modifications to the array are private and are never
+   *  written to the file, but changes that other processes make to the
+   *  file might be seen in any pages that have not yet been modified.
+   *  NULL is returned if the file is too short or cannot be mapped.
+   *  The caller must delete the array.
+   */
+  static vtkDataArray *NewFileArray(
+    int scalarType, int numComponents, vtkIdType numTuples,
+    const char *filename, vtkTypeInt64 offset);
+
 protected:
   vtkDICOMUtilities();
   ~vtkDICOMUtilities();
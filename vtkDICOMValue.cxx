@@ -22,6 +22,8 @@
 #include <float.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
+#include <ctype.h>
 #include <assert.h>
 
 #include <new>
@@ -1802,6 +1804,270 @@ bool vtkDICOMValue::ValueT<vtkDICOMValue>::Compare(
   return r;
 }
 
+//----------------------------------------------------------------------------
+// Helper functions for matching values to a query.
+namespace {
+
+// Compare two characters, optionally ignoring case.
+inline bool vtkDICOMCharEqual(char a, char b, bool ignoreCase)
+{
+  return (a == b || (ignoreCase && tolower(a) == tolower(b)));
+}
+
+// Match the string [vb,ve) to the pattern [pb,pe), where the pattern
+// can contain "*" to match any sequence and "?" to match any character.
+bool vtkDICOMMatchWildcard(
+  const char *pb, const char *pe, const char *vb, const char *ve,
+  bool ignoreCase)
+{
+  // position of the most recent "*", for backtracking
+  const char *ps = 0;
+  const char *vs = 0;
+
+  while (vb != ve)
+    {
+    if (pb != pe && *pb == '*')
+      {
+      ps = ++pb;
+      vs = vb;
+      }
+    else if (pb != pe &&
+             (*pb == '?' || vtkDICOMCharEqual(*pb, *vb, ignoreCase)))
+      {
+      pb++;
+      vb++;
+      }
+    else if (ps)
+      {
+      // let the "*" absorb one more character and try again
+      pb = ps;
+      vb = ++vs;
+      }
+    else
+      {
+      return false;
+      }
+    }
+
+  // only trailing "*" can remain in the pattern
+  while (pb != pe && *pb == '*') { pb++; }
+
+  return (pb == pe);
+}
+
+// Lexically compare [ab,ae) to [bb,be), return -1, 0, or +1.  Only
+// the first "n" characters of each string are compared.
+int vtkDICOMCompareText(
+  const char *ab, const char *ae, const char *bb, const char *be,
+  size_t n)
+{
+  size_t la = ae - ab;
+  size_t lb = be - bb;
+  la = (la < n ? la : n);
+  lb = (lb < n ? lb : n);
+  size_t m = (la < lb ? la : lb);
+  int c = (m > 0 ? strncmp(ab, bb, m) : 0);
+  if (c == 0)
+    {
+    c = (la < lb ? -1 : (la > lb ? 1 : 0));
+    }
+  return (c < 0 ? -1 : (c > 0 ? 1 : 0));
+}
+
+// Check whether the '-' at cp within the DT value [pb,pe) is the sign
+// of a UTC offset "-ZZXX" rather than a range separator.  The offset
+// must follow a digit, must be followed by the end of the value or by
+// a range separator, and must be a valid offset (no more than 14 hours).
+bool vtkDICOMIsOffsetSign(const char *pb, const char *cp, const char *pe)
+{
+  if (cp == pb || cp[-1] < '0' || cp[-1] > '9' || pe - cp < 5 ||
+      (pe - cp > 5 && cp[5] != '-'))
+    {
+    return false;
+    }
+  for (int i = 1; i <= 4; i++)
+    {
+    if (cp[i] < '0' || cp[i] > '9')
+      {
+      return false;
+      }
+    }
+  int hh = (cp[1] - '0')*10 + (cp[2] - '0');
+  int mm = (cp[3] - '0')*10 + (cp[4] - '0');
+  return (mm < 60 && hh*100 + mm <= 1400);
+}
+
+// Find the '-' that separates a range in [pb,pe), or return pe.
+// For DT, a '-' that gives a negative UTC offset is skipped.
+const char *vtkDICOMFindRangeSeparator(
+  const char *pb, const char *pe, bool isDT)
+{
+  const char *dp = pb;
+  while (dp != pe &&
+         (*dp != '-' || (isDT && vtkDICOMIsOffsetSign(pb, dp, pe))))
+    {
+    dp++;
+    }
+  return dp;
+}
+
+// Match a date or time [vb,ve) to a range "A-B" in [pb,pe), where "A"
+// or "B" can be empty for an open range.  The upper bound is compared
+// only up to its own length, so that "-1200" includes "120030.5".
+bool vtkDICOMMatchDateTimeRange(
+  const char *pb, const char *pe, const char *vb, const char *ve,
+  bool isDT)
+{
+  const char *dp = vtkDICOMFindRangeSeparator(pb, pe, isDT);
+
+  bool r = true;
+  if (dp != pb)
+    {
+    r = (vtkDICOMCompareText(vb, ve, pb, dp, ve - vb) >= 0);
+    }
+  if (r && dp + 1 < pe)
+    {
+    r = (vtkDICOMCompareText(vb, ve, dp + 1, pe, pe - dp - 1) <= 0);
+    }
+  return r;
+}
+
+} // end anonymous namespace
+
+//----------------------------------------------------------------------------
+bool vtkDICOMValue::Matches(const vtkDICOMValue& query) const
+{
+  const vtkDICOMValue::Value *q = query.V;
+  const vtkDICOMValue::Value *v = this->V;
+
+  // an empty query provides universal matching
+  if (q == 0 || q->VL == 0 || q->NumberOfValues == 0)
+    {
+    return true;
+    }
+
+  // an empty value cannot match a non-empty query
+  if (v == 0 || v->VL == 0 || v->NumberOfValues == 0)
+    {
+    return false;
+    }
+
+  // for per-instance values, any instance can match
+  if (v->Type == VTK_DICOM_VALUE)
+    {
+    const vtkDICOMValue *vp = this->GetMultiplexData();
+    for (unsigned int i = 0; i < v->NumberOfValues; i++)
+      {
+      if (vp[i].Matches(query))
+        {
+        return true;
+        }
+      }
+    return false;
+    }
+
+  bool r = false;
+  vtkDICOMVR vr = v->VR;
+
+  if (v->Type == VTK_CHAR && q->Type == VTK_CHAR)
+    {
+    bool isRange = (vr == vtkDICOMVR::DA ||
+                    vr == vtkDICOMVR::TM ||
+                    vr == vtkDICOMVR::DT);
+    bool ignoreCase = (vr == vtkDICOMVR::PN);
+
+    for (unsigned int j = 0; j < q->NumberOfValues && !r; j++)
+      {
+      const char *pb, *pe;
+      query.Substring(j, pb, pe);
+
+      // an empty query value matches anything
+      if (pb == pe)
+        {
+        return true;
+        }
+
+      // check for range matching for dates and times
+      bool isDT = (vr == vtkDICOMVR::DT);
+      bool useRange = (isRange &&
+                       vtkDICOMFindRangeSeparator(pb, pe, isDT) != pe);
+
+      for (unsigned int i = 0; i < v->NumberOfValues && !r; i++)
+        {
+        const char *vb, *ve;
+        this->Substring(i, vb, ve);
+
+        if (useRange)
+          {
+          r = vtkDICOMMatchDateTimeRange(pb, pe, vb, ve, isDT);
+          }
+        else if (vr == vtkDICOMVR::UI)
+          {
+          r = (ve - vb == pe - pb && strncmp(vb, pb, pe - pb) == 0);
+          }
+        else
+          {
+          r = vtkDICOMMatchWildcard(pb, pe, vb, ve, ignoreCase);
+          }
+        }
+      }
+    }
+  else if (v->Type == VTK_DICOM_ITEM && q->Type == VTK_DICOM_ITEM)
+    {
+    // every query item must match at least one of the items
+    const vtkDICOMItem *qp = query.GetSequenceData();
+    const vtkDICOMItem *vp = this->GetSequenceData();
+    r = true;
+    for (unsigned int j = 0; j < q->NumberOfValues && r; j++)
+      {
+      r = false;
+      for (unsigned int i = 0; i < v->NumberOfValues && !r; i++)
+        {
+        r = true;
+        vtkDICOMDataElementIterator iter = qp[j].Begin();
+        vtkDICOMDataElementIterator iterEnd = qp[j].End();
+        for (; iter != iterEnd && r; ++iter)
+          {
+          r = vp[i].GetAttributeValue(iter->GetTag()).Matches(
+            iter->GetValue());
+          }
+        }
+      }
+    }
+  else if (v->Type == VTK_DICOM_TAG && q->Type == VTK_DICOM_TAG)
+    {
+    const vtkDICOMTag *qp = query.GetTagData();
+    const vtkDICOMTag *vp = this->GetTagData();
+    for (unsigned int j = 0; j < q->NumberOfValues && !r; j++)
+      {
+      for (unsigned int i = 0; i < v->NumberOfValues && !r; i++)
+        {
+        r = (vp[i] == qp[j]);
+        }
+      }
+    }
+  else if (vr == vtkDICOMVR::OB || vr == vtkDICOMVR::OW ||
+           vr == vtkDICOMVR::OF || vr == vtkDICOMVR::UN)
+    {
+    // binary data must match exactly
+    r = (*this == query);
+    }
+  else
+    {
+    // numerical values (including IS and DS) are compared as doubles
+    for (unsigned int j = 0; j < q->NumberOfValues && !r; j++)
+      {
+      double d = query.GetDouble(j);
+      for (unsigned int i = 0; i < v->NumberOfValues && !r; i++)
+        {
+        r = (this->GetDouble(i) == d);
+        }
+      }
+    }
+
+  return r;
+}
+
 //----------------------------------------------------------------------------
 bool vtkDICOMValue::operator==(const vtkDICOMValue& o) const
 {
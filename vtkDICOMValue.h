@@ -317,6 +317,21 @@ public:
   //! Assign a value from a sequence object.
   vtkDICOMValue& operator=(const vtkDICOMSequence& o);
 
+  //! Check whether this value matches the given query value.
+  /*!
+   *  The matching rules are the same as for a DICOM C-FIND query.  An
+   *  empty query matches any value (universal matching).  For UI, the
+   *  query can be a backslash-separated list of UIDs, and any one of
+   *  them must match.  For DA, DT, and TM, a query of the form "A-B",
+   *  "A-", or "-B" will match a range of dates or times.  For other
+   *  text VRs, the query can contain "*" and "?" wildcards, and the
+   *  match is case-insensitive for PN.  If either the query or this
+   *  value has multiple values, then it is sufficient for any query
+   *  value to match any value.  For sequences, each item in the query
+   *  must match at least one item in this value.
+   */
+  bool Matches(const vtkDICOMValue& query) const;
+
   //! Equality requires that all elements of the value are equal.
   bool operator==(const vtkDICOMValue& o) const;
   bool operator!=(const vtkDICOMValue& o) const { return !(*this == o); }
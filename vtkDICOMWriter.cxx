@@ -31,12 +31,15 @@
 #include "vtkCommand.h"
 #include "vtkErrorCode.h"
 #include "vtkSmartPointer.h"
+#include "vtkMultiThreader.h"
 
 #include <time.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 
+#include <string>
 #include <vector>
 
 vtkStandardNewMacro(vtkDICOMWriter);
@@ -58,6 +61,13 @@ vtkDICOMWriter::vtkDICOMWriter()
   this->RescaleSlope = 1.0;
   this->PatientMatrix = 0;
   this->MemoryRowOrder = vtkDICOMWriter::BottomUp;
+  this->NumberOfThreads = 1;
+  this->Streaming = 0;
+  this->Stream = 0;
+  this->TransferSyntaxUID = 0;
+  this->CompressionLevel = -1;
+  this->Callback = 0;
+  this->ClientData = 0;
   this->SeriesDescription = 0;
   this->ImageType = new char[24];
   strcpy(this->ImageType, "DERIVED/SECONDARY/OTHER");
@@ -80,6 +90,7 @@ vtkDICOMWriter::~vtkDICOMWriter()
     }
   delete [] this->SeriesDescription;
   delete [] this->ImageType;
+  delete [] this->TransferSyntaxUID;
 }
 
 //----------------------------------------------------------------------------
@@ -138,6 +149,26 @@ void vtkDICOMWriter::PrintSelf(ostream& os, vtkIndent indent)
 
   os << indent << "MemoryRowOrder: "
      << this->GetMemoryRowOrderAsString() << "\n";
+  os << indent << "TransferSyntaxUID: "
+     << (this->TransferSyntaxUID ? this->TransferSyntaxUID : "(none)") << "\n";
+  os << indent << "CompressionLevel: " << this->CompressionLevel << "\n";
+  os << indent << "OutputCallback: "
+     << (this->Callback ? "Set\n" : "(none)\n");
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "Streaming: "
+     << (this->Streaming ? "On\n" : "Off\n");
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMWriter::SetOutputCallback(
+  vtkDICOMCompiler::OutputCallback callback, void *clientData)
+{
+  if (this->Callback != callback || this->ClientData != clientData)
+    {
+    this->Callback = callback;
+    this->ClientData = clientData;
+    this->Modified();
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -234,6 +265,7 @@ int vtkDICOMWriter::GenerateMetaData(
   this->Generator->SetTimeSpacing(this->TimeSpacing);
   this->Generator->SetRescaleIntercept(this->RescaleIntercept);
   this->Generator->SetRescaleSlope(this->RescaleSlope);
+  this->Generator->SetNumberOfThreads(this->NumberOfThreads);
   this->Generator->SetMetaData(this->MetaData);
   this->Generator->SetPatientMatrix(this->PatientMatrix);
   if (!this->Generator->GenerateInstance(info, meta))
@@ -301,6 +333,42 @@ int vtkDICOMWriter::GenerateMetaData(
       return 0;
       }
 
+    // enhanced multi-frame objects need a fourth value, and the
+    // FrameType of the frames must agree with the ImageType
+    if (meta->HasAttribute(DC::SharedFunctionalGroupsSequence))
+      {
+      int nvalues = 1;
+      for (const char *cp = sd; *cp != '\0'; cp++)
+        {
+        nvalues += (*cp == '\\');
+        }
+      if (nvalues == 2)
+        {
+        strcat(sd, "\\OTHER");
+        nvalues++;
+        }
+      if (nvalues == 3)
+        {
+        strcat(sd, "\\NONE");
+        }
+
+      static const DC::EnumType frameTypeSequences[] = {
+        DC::CTImageFrameTypeSequence,
+        DC::MRImageFrameTypeSequence,
+        DC::ItemDelimitationItem
+      };
+      for (const DC::EnumType *tp = frameTypeSequences;
+           *tp != DC::ItemDelimitationItem; tp++)
+        {
+        vtkDICOMTagPath path(
+          DC::SharedFunctionalGroupsSequence, 0, *tp, 0, DC::FrameType);
+        if (meta->GetAttributeValue(path).IsValid())
+          {
+          meta->SetAttributeValue(path, sd);
+          }
+        }
+      }
+
     meta->SetAttributeValue(DC::ImageType, sd);
     }
 
@@ -313,29 +381,410 @@ int vtkDICOMWriter::GenerateMetaData(
 }
 
 //----------------------------------------------------------------------------
-int vtkDICOMWriter::RequestData(
-  vtkInformation* vtkNotUsed(request),
-  vtkInformationVector** inputVector,
-  vtkInformationVector* vtkNotUsed(outputVector))
+namespace {
+
+// the information that is shared by all threads that write files
+struct vtkDICOMWriterThreadStruct
 {
-  this->SetErrorCode(vtkErrorCode::NoError);
+  vtkDICOMWriter *Writer;
+  vtkDICOMMetaData *MetaData;
+  vtkIntArray *SliceMap;
+  vtkIntArray *ComponentMap;
+  std::vector<std::string> FileNames;
+  std::vector<vtkSmartPointer<vtkDICOMCompiler> > Compilers;
+  std::vector<unsigned long> ErrorCodes; // first error for each thread
+  std::vector<int> ErrorFiles; // file that caused the error
+  char *DataPtr;
+  int Extent[6];
+  int FirstSlice; // the slice at DataPtr
+  int FirstFrame; // the first frame to write
+  int LastFrame; // one past the last frame to write
+  int NumberOfPlanes;
+  int SamplesPerPixel;
+  int ScalarSize;
+  vtkIdType PixelSize;
+  vtkIdType SliceSize;
+  vtkIdType FilePixelSize;
+  vtkIdType FileRowSize;
+  vtkIdType FilePlaneSize;
+  vtkIdType FileFrameSize;
+  bool FlipImage;
+};
 
-  vtkInformation *info = inputVector[0]->GetInformationObject(0);
-  vtkImageData *data =
-    vtkImageData::SafeDownCast(info->Get(vtkDataObject::DATA_OBJECT()));
+// copy one frame from the image data into the layout used in the file,
+// and return a pointer to the frame (either frameBuffer or the image data)
+char *vtkDICOMWriterPrepareFrame(
+  vtkDICOMWriterThreadStruct *ts, int fileIdx, int frameIdx,
+  char *frameBuffer, char *rowBuffer)
+{
+  const int *extent = ts->Extent;
+  char *dataPtr = ts->DataPtr;
+  int numPlanes = ts->NumberOfPlanes;
+  int samplesPerPixel = ts->SamplesPerPixel;
+  int scalarSize = ts->ScalarSize;
+  vtkIdType pixelSize = ts->PixelSize;
+  vtkIdType sliceSize = ts->SliceSize;
+  vtkIdType filePixelSize = ts->FilePixelSize;
+  vtkIdType fileRowSize = ts->FileRowSize;
+  vtkIdType filePlaneSize = ts->FilePlaneSize;
+  vtkIdType fileFrameSize = ts->FileFrameSize;
+  bool flipImage = ts->FlipImage;
+  bool packedToPlanar = (filePixelSize != pixelSize);
 
-  if (data == NULL)
+  int sliceIdx = ts->SliceMap->GetComponent(fileIdx, frameIdx);
+  int componentIdx = ts->ComponentMap->GetComponent(fileIdx, frameIdx);
+  sliceIdx -= ts->FirstSlice;
+
+  // pointer to the frame that will be written to the file
+  char *framePtr = frameBuffer;
+
+  if (!framePtr)
     {
-    vtkErrorMacro("No input provided!");
-    return 0;
+    // write the frame directly from image data
+    framePtr = (dataPtr + sliceIdx*sliceSize);
+    }
+
+  // go to the correct position in image data
+  char *slicePtr = (dataPtr +
+                    sliceIdx*sliceSize +
+                    componentIdx*samplesPerPixel*scalarSize);
+
+  // iterate through all color planes in the slice
+  char *planePtr = framePtr;
+  for (int pIdx = 0; pIdx < numPlanes; pIdx++)
+    {
+    // convert scalar components to planes
+    if (packedToPlanar)
+      {
+      const char *tmpInPtr = slicePtr;
+      char *tmpOutPtr = planePtr;
+      int m = sliceSize/pixelSize;
+      for (int i = 0; i < m; i++)
+        {
+        vtkIdType n = filePixelSize;
+        do { *tmpOutPtr++ = *tmpInPtr++; } while (--n);
+        tmpInPtr += pixelSize - filePixelSize;
+        }
+      slicePtr += filePixelSize;
+      }
+    else
+      {
+      memcpy(framePtr, slicePtr, fileFrameSize);
+      }
+
+    // flip the data if necessary
+    if (flipImage)
+      {
+      int numRows = extent[3] - extent[2] + 1;
+      int halfRows = numRows/2;
+      for (int yIdx = 0; yIdx < halfRows; yIdx++)
+        {
+        char *row1 = planePtr + yIdx*fileRowSize;
+        char *row2 = planePtr + (numRows-yIdx-1)*fileRowSize;
+        memcpy(rowBuffer, row1, fileRowSize);
+        memcpy(row1, row2, fileRowSize);
+        memcpy(row2, rowBuffer, fileRowSize);
+        }
+      }
+
+    planePtr += filePlaneSize;
+    }
+
+  return framePtr;
+}
+
+// set the compiler's file name and UIDs, and write the header
+void vtkDICOMWriterStartFile(
+  vtkDICOMWriterThreadStruct *ts, vtkDICOMCompiler *compiler, int fileIdx)
+{
+  vtkDICOMMetaData *meta = ts->MetaData;
+  compiler->SetFileName(ts->FileNames[fileIdx].c_str());
+  compiler->SetIndex(fileIdx);
+  compiler->SetSOPInstanceUID(
+    meta->GetAttributeValue(fileIdx, DC::SOPInstanceUID).GetCharData());
+  compiler->SetSeriesInstanceUID(
+    meta->GetAttributeValue(fileIdx, DC::SeriesInstanceUID).GetCharData());
+  compiler->WriteHeader();
+}
+
+// close the file if it is complete or if it failed, and record any error
+// for the given compiler, the return value is false if an error occurred
+bool vtkDICOMWriterFinishFile(
+  vtkDICOMWriterThreadStruct *ts, int compilerIdx, int fileIdx, bool done)
+{
+  vtkDICOMCompiler *compiler = ts->Compilers[compilerIdx];
+
+  // the file stays open if its remaining frames are in the next piece
+  if (done ||
+      ts->Writer->GetAbortExecute() ||
+      compiler->GetErrorCode() != vtkErrorCode::NoError)
+    {
+    compiler->Close();
+    }
+
+  if (compiler->GetErrorCode() != vtkErrorCode::NoError)
+    {
+    ts->ErrorCodes[compilerIdx] = compiler->GetErrorCode();
+    ts->ErrorFiles[compilerIdx] = fileIdx;
+    return false;
+    }
+
+  return true;
+}
+
+// write the frames from FirstFrame to LastFrame, where the frames of
+// all files are numbered consecutively, and where a thread writes every
+// file whose index is equal to threadId modulo threadCount
+void vtkDICOMWriterWriteFiles(
+  vtkDICOMWriterThreadStruct *ts, int threadId, int threadCount)
+{
+  vtkDICOMWriter *self = ts->Writer;
+  vtkDICOMCompiler *compiler = ts->Compilers[threadId];
+  int numFiles = static_cast<int>(ts->SliceMap->GetNumberOfTuples());
+  int numFrames = ts->SliceMap->GetNumberOfComponents();
+
+  // a thread that failed on an earlier piece does not continue
+  if (ts->ErrorCodes[threadId] != vtkErrorCode::NoError)
+    {
+    return;
+    }
+
+  // each thread has its own buffers
+  bool packedToPlanar = (ts->FilePixelSize != ts->PixelSize);
+  char *rowBuffer = 0;
+  if (ts->FlipImage)
+    {
+    rowBuffer = new char[ts->FileRowSize];
+    }
+  char *frameBuffer = 0;
+  if (ts->FlipImage || packedToPlanar)
+    {
+    frameBuffer = new char[ts->FileFrameSize];
+    }
+
+  // find the first file for this thread
+  int firstFile = ts->FirstFrame/numFrames;
+  int lastFile = (ts->LastFrame + numFrames - 1)/numFrames;
+  lastFile = (lastFile < numFiles ? lastFile : numFiles);
+  int fileIdx = firstFile + threadId - firstFile % threadCount;
+  fileIdx += (fileIdx < firstFile ? threadCount : 0);
+
+  // loop through all files in the update extent
+  for (; fileIdx < lastFile; fileIdx += threadCount)
+    {
+    if (self->GetAbortExecute()) { break; }
+
+    // the frames of this file that are in the update extent
+    int firstFrame = ts->FirstFrame - fileIdx*numFrames;
+    firstFrame = (firstFrame > 0 ? firstFrame : 0);
+    int lastFrame = ts->LastFrame - fileIdx*numFrames;
+    lastFrame = (lastFrame < numFrames ? lastFrame : numFrames);
+
+    if (firstFrame == 0)
+      {
+      vtkDICOMWriterStartFile(ts, compiler, fileIdx);
+      }
+
+    // iterate through all frames in the file
+    int frameIdx = firstFrame;
+    for (; frameIdx < lastFrame; frameIdx++)
+      {
+      if (self->GetAbortExecute() ||
+          compiler->GetErrorCode() != vtkErrorCode::NoError) { break; }
+
+      // only the first thread reports progress
+      if (threadId == 0)
+        {
+        self->UpdateProgress(
+          static_cast<double>(fileIdx*numFrames + frameIdx)/
+          static_cast<double>(numFiles*numFrames));
+        }
+
+      // write the frame to the file
+      char *framePtr = vtkDICOMWriterPrepareFrame(
+        ts, fileIdx, frameIdx, frameBuffer, rowBuffer);
+      compiler->WriteFrame(framePtr, ts->FileFrameSize);
+      }
+
+    // stop this thread at the first error
+    if (!vtkDICOMWriterFinishFile(
+          ts, threadId, fileIdx, (frameIdx == numFrames)))
+      {
+      break;
+      }
+    }
+
+  delete [] rowBuffer;
+  delete [] frameBuffer;
+}
+
+// compress the frames from FirstFrame to LastFrame, where a thread
+// compresses every frame whose index is equal to threadId modulo
+// threadCount, and where each file has its own compiler
+void vtkDICOMWriterEncodeFrames(
+  vtkDICOMWriterThreadStruct *ts, int threadId, int threadCount)
+{
+  vtkDICOMWriter *self = ts->Writer;
+  int numFiles = static_cast<int>(ts->SliceMap->GetNumberOfTuples());
+  int numFrames = ts->SliceMap->GetNumberOfComponents();
+  int numCompilers = static_cast<int>(ts->Compilers.size());
+
+  // each thread has its own buffers
+  bool packedToPlanar = (ts->FilePixelSize != ts->PixelSize);
+  char *rowBuffer = 0;
+  if (ts->FlipImage)
+    {
+    rowBuffer = new char[ts->FileRowSize];
+    }
+  char *frameBuffer = 0;
+  if (ts->FlipImage || packedToPlanar)
+    {
+    frameBuffer = new char[ts->FileFrameSize];
+    }
+
+  int idx = ts->FirstFrame + threadId;
+  for (; idx < ts->LastFrame; idx += threadCount)
+    {
+    if (self->GetAbortExecute()) { break; }
+
+    int fileIdx = idx/numFrames;
+    int frameIdx = idx - fileIdx*numFrames;
+    vtkDICOMCompiler *compiler = ts->Compilers[fileIdx % numCompilers];
+    if (compiler->GetErrorCode() != vtkErrorCode::NoError) { continue; }
+
+    // only the first thread reports progress
+    if (threadId == 0)
+      {
+      self->UpdateProgress(
+        static_cast<double>(idx)/static_cast<double>(numFiles*numFrames));
+      }
+
+    // any failure is reported when the frame is written
+    char *framePtr = vtkDICOMWriterPrepareFrame(
+      ts, fileIdx, frameIdx, frameBuffer, rowBuffer);
+    compiler->EncodeFrame(frameIdx, framePtr, ts->FileFrameSize);
+    }
+
+  delete [] rowBuffer;
+  delete [] frameBuffer;
+}
+
+// the thread entry point for vtkMultiThreader
+VTK_THREAD_RETURN_TYPE vtkDICOMWriterThreadedExecute(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *info =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkDICOMWriterThreadStruct *ts =
+    static_cast<vtkDICOMWriterThreadStruct *>(info->UserData);
+
+  vtkDICOMWriterWriteFiles(ts, info->ThreadID, info->NumberOfThreads);
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+// the thread entry point for compressing frames in parallel
+VTK_THREAD_RETURN_TYPE vtkDICOMWriterThreadedEncode(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *info =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkDICOMWriterThreadStruct *ts =
+    static_cast<vtkDICOMWriterThreadStruct *>(info->UserData);
+
+  vtkDICOMWriterEncodeFrames(ts, info->ThreadID, info->NumberOfThreads);
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+// write the frames from FirstFrame to LastFrame when each file has its
+// own compiler: the headers are written, then the frames are compressed
+// by all threads, and then the compressed frames are written in order
+void vtkDICOMWriterWriteEncodedFiles(
+  vtkDICOMWriterThreadStruct *ts, int threadCount)
+{
+  vtkDICOMWriter *self = ts->Writer;
+  int numFiles = static_cast<int>(ts->SliceMap->GetNumberOfTuples());
+  int numFrames = ts->SliceMap->GetNumberOfComponents();
+  int numCompilers = static_cast<int>(ts->Compilers.size());
+  int firstFile = ts->FirstFrame/numFrames;
+  int lastFile = (ts->LastFrame + numFrames - 1)/numFrames;
+  lastFile = (lastFile < numFiles ? lastFile : numFiles);
+
+  // a file that failed on an earlier piece does not continue
+  for (int i = 0; i < numCompilers; i++)
+    {
+    if (ts->ErrorCodes[i] != vtkErrorCode::NoError)
+      {
+      return;
+      }
+    }
+
+  for (int fileIdx = firstFile; fileIdx < lastFile; fileIdx++)
+    {
+    if (ts->FirstFrame <= fileIdx*numFrames)
+      {
+      vtkDICOMWriterStartFile(
+        ts, ts->Compilers[fileIdx % numCompilers], fileIdx);
+      }
+    }
+
+  vtkSmartPointer<vtkMultiThreader> threader =
+    vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(threadCount);
+  threader->SetSingleMethod(vtkDICOMWriterThreadedEncode, ts);
+  threader->SingleMethodExecute();
+
+  for (int fileIdx = firstFile; fileIdx < lastFile; fileIdx++)
+    {
+    int compilerIdx = fileIdx % numCompilers;
+    vtkDICOMCompiler *compiler = ts->Compilers[compilerIdx];
+
+    // the frames of this file that are in the update extent
+    int firstFrame = ts->FirstFrame - fileIdx*numFrames;
+    firstFrame = (firstFrame > 0 ? firstFrame : 0);
+    int lastFrame = ts->LastFrame - fileIdx*numFrames;
+    lastFrame = (lastFrame < numFrames ? lastFrame : numFrames);
+
+    int frameIdx = firstFrame;
+    for (; frameIdx < lastFrame; frameIdx++)
+      {
+      if (self->GetAbortExecute() ||
+          compiler->GetErrorCode() != vtkErrorCode::NoError) { break; }
+
+      // the frame was already compressed, so just write it
+      compiler->WriteFrame(0, ts->FileFrameSize);
+      }
+
+    if (!vtkDICOMWriterFinishFile(
+          ts, compilerIdx, fileIdx, (frameIdx == numFrames)))
+      {
+      break;
+      }
     }
+}
+
+} // end anonymous namespace
+
+//----------------------------------------------------------------------------
+// the state of a write, which is kept between pieces when streaming
+struct vtkDICOMWriter::StreamInfo
+{
+  vtkDICOMWriterThreadStruct Threads;
+  vtkSmartPointer<vtkDICOMMetaData> MetaData;
+  std::vector<int> Pieces; // the first frame of each piece, plus the end
+  int CurrentPiece;
+  int NumberOfThreads;
+  int NumberOfEncoders; // threads for compressing frames, if more than one
+};
 
+//----------------------------------------------------------------------------
+bool vtkDICOMWriter::StartWrite(vtkInformation *info)
+{
   if (!this->FileName && !this->FilePattern)
     {
     vtkErrorMacro("Write:Please specify either a FileName "
                   "or a file prefix and pattern");
     this->SetErrorCode(vtkErrorCode::NoFileNameError);
-    return 0;
+    return false;
     }
 
   vtkSmartPointer<vtkDICOMMetaData> meta =
@@ -344,7 +793,7 @@ int vtkDICOMWriter::RequestData(
   // Generate the meta data to go with the image
   if (!this->GenerateMetaData(info, meta))
     {
-    return 0;
+    return false;
     }
 
   // Get the map from file,frame to slice.
@@ -352,18 +801,160 @@ int vtkDICOMWriter::RequestData(
   vtkIntArray *componentMap = this->Generator->GetComponentIndexArray();
   int numFiles = static_cast<int>(sliceMap->GetNumberOfTuples());
   int numFrames = sliceMap->GetNumberOfComponents();
+  int numTotalFrames = numFiles*numFrames;
 
-  vtkSmartPointer<vtkDICOMCompiler> compiler =
-    vtkSmartPointer<vtkDICOMCompiler>::New();
-  compiler->SetMetaData(meta);
+  // the files are divided between the threads
+  int numThreads = this->NumberOfThreads;
+  numThreads = (numThreads < numFiles ? numThreads : numFiles);
+  numThreads = (numThreads > 1 ? numThreads : 1);
+
+  // if there are more threads than files, the frames are divided between
+  // the threads instead, but only if compressing the frames is worth it
+  int numEncoders = 1;
+  if (this->NumberOfThreads > numFiles && numFrames > 1 &&
+      this->TransferSyntaxUID &&
+      strcmp(this->TransferSyntaxUID, "1.2.840.10008.1.2.5") == 0)
+    {
+    numEncoders = this->NumberOfThreads;
+    }
+
+  StreamInfo *stream = new StreamInfo;
+  this->Stream = stream;
+  stream->MetaData = meta;
+  stream->CurrentPiece = 0;
+  stream->NumberOfThreads = numThreads;
+  stream->NumberOfEncoders = numEncoders;
+
+  vtkDICOMWriterThreadStruct& ts = stream->Threads;
+  ts.Writer = this;
+  ts.MetaData = meta;
+  ts.SliceMap = sliceMap;
+  ts.ComponentMap = componentMap;
+  ts.DataPtr = 0;
+  ts.FlipImage = (this->MemoryRowOrder == vtkDICOMWriter::BottomUp);
+  ts.ErrorCodes.resize(numThreads, vtkErrorCode::NoError);
+  ts.ErrorFiles.resize(numThreads, numFiles);
+
+  // divide the frames into pieces: when streaming, each piece has one
+  // file per thread, or one frame if all frames go into a single file,
+  // or one frame per thread if the frames are divided between threads
+  int piece = numTotalFrames;
+  if (this->Streaming)
+    {
+    piece = (numFiles > 1 ? numThreads*numFrames : 1);
+    piece = (numEncoders > 1 ? numEncoders : piece);
+    }
+  int frameIdx = 0;
+  do
+    {
+    stream->Pieces.push_back(frameIdx);
+    frameIdx += piece;
+    }
+  while (frameIdx < numTotalFrames);
+  stream->Pieces.push_back(numTotalFrames);
+
+  // compute all file names before any threads are started
+  ts.FileNames.resize(numFiles);
+  for (int fileIdx = 0; fileIdx < numFiles; fileIdx++)
+    {
+    this->ComputeInternalFileName(fileIdx + 1);
+    ts.FileNames[fileIdx] = this->InternalFileName;
+    }
+
+  // create one compiler per thread
+  ts.Compilers.resize(numThreads);
+  for (int threadId = 0; threadId < numThreads; threadId++)
+    {
+    vtkDICOMCompiler *compiler = vtkDICOMCompiler::New();
+    compiler->SetMetaData(meta);
+    if (this->TransferSyntaxUID)
+      {
+      compiler->SetTransferSyntaxUID(this->TransferSyntaxUID);
+      }
+    compiler->SetCompressionLevel(this->CompressionLevel);
+    // the generated meta data is not modified during the write
+    compiler->ReuseHeaderTemplateOn();
+    compiler->SetOutputCallback(this->Callback, this->ClientData);
+    if (numThreads > 1)
+      {
+      // generate the fallback UIDs now, so that the threads will
+      // not race to create the compiler's shared study UID
+      compiler->GenerateSeriesUIDs();
+      }
+    ts.Compilers[threadId] = compiler;
+    compiler->Delete();
+    }
+
+  this->InvokeEvent(vtkCommand::StartEvent);
+  this->UpdateProgress(0.0);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMWriter::ComputePieceExtent(int extent[6])
+{
+  // find the slab of slices that hold the frames of the current piece
+  StreamInfo *stream = this->Stream;
+  vtkIntArray *sliceMap = stream->Threads.SliceMap;
+  int minSlice = VTK_INT_MAX;
+  int maxSlice = VTK_INT_MIN;
+  int firstFrame = stream->Pieces[stream->CurrentPiece];
+  int lastFrame = stream->Pieces[stream->CurrentPiece + 1];
+  for (int frameIdx = firstFrame; frameIdx < lastFrame; frameIdx++)
+    {
+    int sliceIdx = sliceMap->GetValue(frameIdx);
+    minSlice = (sliceIdx < minSlice ? sliceIdx : minSlice);
+    maxSlice = (sliceIdx > maxSlice ? sliceIdx : maxSlice);
+    }
+
+  if (minSlice <= maxSlice)
+    {
+    extent[5] = extent[4] + maxSlice;
+    extent[4] = extent[4] + minSlice;
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkDICOMWriter::WritePiece(vtkInformation *info)
+{
+  StreamInfo *stream = this->Stream;
+  vtkDICOMWriterThreadStruct& ts = stream->Threads;
+  vtkDICOMMetaData *meta = stream->MetaData;
+  vtkImageData *data =
+    vtkImageData::SafeDownCast(info->Get(vtkDataObject::DATA_OBJECT()));
 
   // Get the image dimensions
+  int wholeExtent[6];
+  info->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), wholeExtent);
   int extent[6];
-  info->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
+  data->GetExtent(extent);
 
-  // write the image
-  char *dataPtr = static_cast<char *>(data->GetScalarPointer());
-  bool flipImage = (this->MemoryRowOrder == vtkDICOMWriter::BottomUp);
+  // make sure that the data holds all of the slices that were requested,
+  // in case the upstream algorithm did not respect the update extent
+  int pieceExtent[6];
+  for (int i = 0; i < 6; i++)
+    {
+    pieceExtent[i] = wholeExtent[i];
+    }
+  this->ComputePieceExtent(pieceExtent);
+  if (extent[0] != pieceExtent[0] || extent[1] != pieceExtent[1] ||
+      extent[2] != pieceExtent[2] || extent[3] != pieceExtent[3] ||
+      extent[4] > pieceExtent[4] || extent[5] < pieceExtent[5])
+    {
+    vtkErrorMacro("WritePiece: The input extent [" << extent[0] << ","
+                  << extent[1] << "," << extent[2] << "," << extent[3]
+                  << "," << extent[4] << "," << extent[5]
+                  << "] does not contain the requested extent ["
+                  << pieceExtent[0] << "," << pieceExtent[1] << ","
+                  << pieceExtent[2] << "," << pieceExtent[3] << ","
+                  << pieceExtent[4] << "," << pieceExtent[5] << "]");
+    this->SetErrorCode(vtkErrorCode::UnknownError);
+    // mark the write as failed, so that IsWriteComplete() stops it
+    ts.ErrorCodes[0] = vtkErrorCode::UnknownError;
+    stream->CurrentPiece++;
+    return;
+    }
 
   int planarConfiguration =
     meta->GetAttributeValue(DC::PlanarConfiguration).AsInt();
@@ -384,110 +975,198 @@ int vtkDICOMWriter::RequestData(
   vtkIdType filePlaneSize = fileRowSize*(extent[3] - extent[2] + 1);
   vtkIdType fileFrameSize = filePlaneSize*numPlanes;
 
-  this->InvokeEvent(vtkCommand::StartEvent);
-  this->UpdateProgress(0.0);
+  ts.DataPtr = static_cast<char *>(data->GetScalarPointer());
+  for (int i = 0; i < 6; i++)
+    {
+    ts.Extent[i] = extent[i];
+    }
+  ts.FirstSlice = extent[4] - wholeExtent[4];
+  ts.FirstFrame = stream->Pieces[stream->CurrentPiece];
+  ts.LastFrame = stream->Pieces[stream->CurrentPiece + 1];
+  ts.NumberOfPlanes = numPlanes;
+  ts.SamplesPerPixel = samplesPerPixel;
+  ts.ScalarSize = scalarSize;
+  ts.PixelSize = pixelSize;
+  ts.SliceSize = sliceSize;
+  ts.FilePixelSize = filePixelSize;
+  ts.FileRowSize = fileRowSize;
+  ts.FilePlaneSize = filePlaneSize;
+  ts.FileFrameSize = fileFrameSize;
 
-  bool packedToPlanar = (filePixelSize != pixelSize);
-  char *rowBuffer = 0;
-  if (flipImage)
+  int numThreads = stream->NumberOfThreads;
+  if (stream->NumberOfEncoders > 1)
     {
-    rowBuffer = new char[fileRowSize];
+    vtkDICOMWriterWriteEncodedFiles(&ts, stream->NumberOfEncoders);
     }
-  char *frameBuffer = 0;
-  if (flipImage || packedToPlanar)
+  else if (numThreads == 1)
+    {
+    vtkDICOMWriterWriteFiles(&ts, 0, 1);
+    }
+  else
     {
-    frameBuffer = new char[fileFrameSize];
+    vtkSmartPointer<vtkMultiThreader> threader =
+      vtkSmartPointer<vtkMultiThreader>::New();
+    threader->SetNumberOfThreads(numThreads);
+    threader->SetSingleMethod(vtkDICOMWriterThreadedExecute, &ts);
+    threader->SingleMethodExecute();
     }
 
-  // loop through all files in the update extent
-  for (int fileIdx = 0; fileIdx < numFiles; fileIdx++)
+  stream->CurrentPiece++;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDICOMWriter::IsWriteComplete()
+{
+  StreamInfo *stream = this->Stream;
+  if (stream->CurrentPiece + 1 >= static_cast<int>(stream->Pieces.size()) ||
+      this->GetAbortExecute())
     {
-    // get the index for this file
-    this->ComputeInternalFileName(fileIdx + 1);
-    compiler->SetFileName(this->InternalFileName);
-    compiler->SetIndex(fileIdx);
-    compiler->SetSOPInstanceUID(
-      meta->GetAttributeValue(fileIdx, DC::SOPInstanceUID).GetCharData());
-    compiler->SetSeriesInstanceUID(
-      meta->GetAttributeValue(fileIdx, DC::SeriesInstanceUID).GetCharData());
-    compiler->WriteHeader();
+    return true;
+    }
 
-    // iterate through all frames in the file
-    for (int frameIdx = 0; frameIdx < numFrames; frameIdx++)
+  // stop as soon as any file fails
+  vtkDICOMWriterThreadStruct& ts = stream->Threads;
+  for (int threadId = 0; threadId < stream->NumberOfThreads; threadId++)
+    {
+    if (ts.ErrorCodes[threadId] != vtkErrorCode::NoError)
       {
-      if (this->AbortExecute) { break; }
+      return true;
+      }
+    }
 
-      this->UpdateProgress(static_cast<double>(fileIdx*numFrames + frameIdx)/
-                           static_cast<double>(numFiles*numFrames));
+  return false;
+}
 
-      int sliceIdx = sliceMap->GetComponent(fileIdx, frameIdx);
-      int componentIdx = componentMap->GetComponent(fileIdx, frameIdx);
+//----------------------------------------------------------------------------
+void vtkDICOMWriter::FinishWrite()
+{
+  StreamInfo *stream = this->Stream;
+  vtkDICOMWriterThreadStruct& ts = stream->Threads;
+  int numThreads = stream->NumberOfThreads;
+  int numFiles = static_cast<int>(ts.FileNames.size());
 
-      // pointer to the frame that will be written to the file
-      char *framePtr = frameBuffer;
+  // close any files that were left open by an abort
+  for (int threadId = 0; threadId < numThreads; threadId++)
+    {
+    ts.Compilers[threadId]->Close();
+    }
 
-      if (!framePtr)
-        {
-        // write the frame directly from image data
-        framePtr = (dataPtr + (sliceIdx - extent[4])*sliceSize);
-        }
+  // report the error for the lowest-numbered file that failed
+  int errorFile = numFiles;
+  for (int threadId = 0; threadId < numThreads; threadId++)
+    {
+    if (ts.ErrorCodes[threadId] != vtkErrorCode::NoError &&
+        ts.ErrorFiles[threadId] < errorFile)
+      {
+      errorFile = ts.ErrorFiles[threadId];
+      this->SetErrorCode(ts.ErrorCodes[threadId]);
+      }
+    }
+  if (errorFile < numFiles)
+    {
+    this->ComputeInternalFileName(errorFile + 1);
+    }
 
-      // go to the correct position in image data
-      char *slicePtr = (dataPtr +
-                        (sliceIdx - extent[4])*sliceSize +
-                        componentIdx*samplesPerPixel*scalarSize);
+  delete stream;
+  this->Stream = 0;
 
-      // iterate through all color planes in the slice
-      char *planePtr = framePtr;
-      for (int pIdx = 0; pIdx < numPlanes; pIdx++)
-        {
-        // convert scalar components to planes
-        if (packedToPlanar)
-          {
-          const char *tmpInPtr = slicePtr;
-          char *tmpOutPtr = planePtr;
-          int m = sliceSize/pixelSize;
-          for (int i = 0; i < m; i++)
-            {
-            vtkIdType n = filePixelSize;
-            do { *tmpOutPtr++ = *tmpInPtr++; } while (--n);
-            tmpInPtr += pixelSize - filePixelSize;
-            }
-          slicePtr += filePixelSize;
-          }
-        else
-          {
-          memcpy(framePtr, slicePtr, fileFrameSize);
-          }
+  this->UpdateProgress(1.0);
+  this->InvokeEvent(vtkCommand::EndEvent);
+}
 
-        // flip the data if necessary
-        if (flipImage)
-          {
-          int numRows = extent[3] - extent[2] + 1;
-          int halfRows = numRows/2;
-          for (int yIdx = 0; yIdx < halfRows; yIdx++)
-            {
-            char *row1 = planePtr + yIdx*fileRowSize;
-            char *row2 = planePtr + (numRows-yIdx-1)*fileRowSize;
-            memcpy(rowBuffer, row1, fileRowSize);
-            memcpy(row1, row2, fileRowSize);
-            memcpy(row2, rowBuffer, fileRowSize);
-            }
-          }
+//----------------------------------------------------------------------------
+void vtkDICOMWriter::Write()
+{
+  this->Superclass::Write();
 
-        planePtr += filePlaneSize;
-        }
-      // write the frame to the file
-      compiler->WriteFrame(framePtr, fileFrameSize);
+  // if the pipeline failed before the last piece arrived, end the write
+  if (this->Stream)
+    {
+    this->FinishWrite();
+    }
+}
+
+//----------------------------------------------------------------------------
+int vtkDICOMWriter::RequestUpdateExtent(
+  vtkInformation* vtkNotUsed(request),
+  vtkInformationVector** inputVector,
+  vtkInformationVector* vtkNotUsed(outputVector))
+{
+  if (!this->Streaming)
+    {
+    // the whole extent was requested by Write()
+    return 1;
+    }
+
+  vtkInformation *info = inputVector[0]->GetInformationObject(0);
+
+  if (this->Stream == 0)
+    {
+    // the meta data is generated before the first piece is requested,
+    // so the generator must not look at the data object (which might
+    // hold data from an earlier update)
+    this->SetErrorCode(vtkErrorCode::NoError);
+    vtkSmartPointer<vtkInformation> metaInfo =
+      vtkSmartPointer<vtkInformation>::New();
+    metaInfo->Copy(info);
+    metaInfo->Remove(vtkDataObject::DATA_OBJECT());
+    if (!this->StartWrite(metaInfo))
+      {
+      return 0;
       }
-    compiler->Close();
     }
 
-  delete [] rowBuffer;
-  delete [] frameBuffer;
+  // request the slices for the current piece
+  int extent[6];
+  info->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
+  this->ComputePieceExtent(extent);
+  info->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), extent, 6);
 
-  this->UpdateProgress(1.0);
-  this->InvokeEvent(vtkCommand::EndEvent);
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkDICOMWriter::RequestData(
+  vtkInformation* request,
+  vtkInformationVector** inputVector,
+  vtkInformationVector* vtkNotUsed(outputVector))
+{
+  vtkInformation *info = inputVector[0]->GetInformationObject(0);
+  vtkImageData *data =
+    vtkImageData::SafeDownCast(info->Get(vtkDataObject::DATA_OBJECT()));
+
+  if (data == NULL)
+    {
+    vtkErrorMacro("No input provided!");
+    if (this->Stream)
+      {
+      this->FinishWrite();
+      }
+    return 0;
+    }
+
+  if (this->Stream == 0)
+    {
+    // not streaming, so the whole image is present
+    this->SetErrorCode(vtkErrorCode::NoError);
+    if (!this->StartWrite(info))
+      {
+      return 0;
+      }
+    }
+
+  this->WritePiece(info);
+
+  // ask the executive to call us again for the next piece
+  if (this->IsWriteComplete())
+    {
+    request->Remove(vtkStreamingDemandDrivenPipeline::CONTINUE_EXECUTING());
+    this->FinishWrite();
+    }
+  else
+    {
+    request->Set(vtkStreamingDemandDrivenPipeline::CONTINUE_EXECUTING(), 1);
+    }
 
   return 1;
 }
@@ -18,7 +18,9 @@
 // modality-specific information.  To write other kinds of DICOM files,
 // use the SetGenerator() method to supply a generator for the type of
 // data set that you wish to write.  Currently, there are generators for
-// MR and CT data sets.
+// MR and CT data sets.  If the FileDimensionality is set to 3, then the
+// whole volume is written as a single multi-frame file, and the MR and
+// CT generators will produce Enhanced MR and Enhanced CT data sets.
 // .SECTION Thanks
 // This class was contributed to VTK by David Gobbi.
 
@@ -27,6 +29,7 @@
 
 #include <vtkImageWriter.h>
 #include "vtkDICOMModule.h"
+#include "vtkDICOMCompiler.h"
 
 class vtkMatrix4x4;
 class vtkDICOMMetaData;
@@ -136,6 +139,66 @@ public:
   void SetGenerator(vtkDICOMGenerator *);
   vtkDICOMGenerator *GetGenerator() { return this->Generator; }
 
+  // Description:
+  // Set the transfer syntax UID for the files.
+  // The default is explicit little-endian (1.2.840.10008.1.2.1).
+  // The only compressed transfer syntaxes that can be written are
+  // RLE Lossless (1.2.840.10008.1.2.5) and Deflated Explicit VR
+  // Little Endian (1.2.840.10008.1.2.1.99).
+  vtkSetStringMacro(TransferSyntaxUID);
+  vtkGetStringMacro(TransferSyntaxUID);
+
+  // Description:
+  // Set the zlib compression level for the deflated transfer syntax.
+  // The level goes from 1 (fastest) to 9 (smallest), and the default
+  // of -1 uses the zlib default.
+  vtkSetClampMacro(CompressionLevel, int, -1, 9);
+  vtkGetMacro(CompressionLevel, int);
+
+  // Description:
+  // Set the number of threads to use for writing the files.
+  // The default is 1, which writes the files one after another.  When
+  // more than one thread is used, each thread writes a different subset
+  // of the files through its own compiler.  The UIDs are identical to
+  // those of a single-threaded write, since they are all created by the
+  // generator before any files are written.  If any file cannot be
+  // written, the ErrorCode is set from the lowest-numbered failed file.
+  // If there are more threads than files and the transfer syntax is RLE
+  // Lossless, the frames are compressed in parallel instead, and each
+  // file is written by the main thread once its frames are compressed.
+  // The threads are also given to the generator, which uses them to scan
+  // the image for the range of pixel values before writing begins.
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  // Description:
+  // Send the files to a callback function, instead of writing to disk.
+  // The callback is given to the vtkDICOMCompiler for each file, see
+  // vtkDICOMCompiler::SetOutputCallback() for details.  The callback
+  // can call GetFileName() on the compiler to get the name that the
+  // file would have been given.  If NumberOfThreads is greater than
+  // one, then the callback will be called from several threads at once.
+  void SetOutputCallback(
+    vtkDICOMCompiler::OutputCallback callback, void *clientData);
+
+  // Description:
+  // Request the image from the pipeline in pieces (default: Off).
+  // If this is on, the writer requests only the slices that are needed
+  // for the next few files, and writes them before requesting more.
+  // Each piece holds one file per thread, or a single frame if the whole
+  // volume is written as one multi-frame file (one frame per thread if
+  // the frames are compressed in parallel), so the input does not have
+  // to fit in memory.  Since the meta data must be written before all of
+  // the pixel data has been seen, the SmallestPixelValueInSeries and the
+  // window/level are not computed when streaming.
+  vtkSetMacro(Streaming, int);
+  vtkBooleanMacro(Streaming, int);
+  vtkGetMacro(Streaming, int);
+
+  // Description:
+  // Write the files.
+  virtual void Write();
+
 protected:
   vtkDICOMWriter();
   ~vtkDICOMWriter();
@@ -149,6 +212,12 @@ protected:
   virtual int GenerateMetaData(vtkInformation *info,
                                vtkDICOMMetaData *meta);
 
+  // Description:
+  // Request the slices for the next piece, if streaming.
+  virtual int RequestUpdateExtent(vtkInformation *request,
+                                  vtkInformationVector** inputVector,
+                                  vtkInformationVector* outputVector);
+
   // Description:
   // The main execution method, which writes the file.
   virtual int RequestData(vtkInformation *request,
@@ -193,9 +262,56 @@ protected:
   // The row order to use when storing the data in memory.
   int MemoryRowOrder;
 
+  // Description:
+  // The number of threads to use when writing.
+  int NumberOfThreads;
+
+  // Description:
+  // Whether to request the input in pieces.
+  int Streaming;
+
+  // Description:
+  // The transfer syntax, or NULL to use the default.
+  char *TransferSyntaxUID;
+
+  // Description:
+  // The compression level for the deflated transfer syntax.
+  int CompressionLevel;
+
+  // Description:
+  // The function that receives the files, if not writing to disk.
+  vtkDICOMCompiler::OutputCallback Callback;
+  void *ClientData;
+
 private:
   vtkDICOMWriter(const vtkDICOMWriter&);  // Not implemented.
   void operator=(const vtkDICOMWriter&);  // Not implemented.
+
+  struct StreamInfo;
+
+  // Description:
+  // Generate the meta data, and get ready to write the first piece.
+  bool StartWrite(vtkInformation *info);
+
+  // Description:
+  // Compute the update extent for the current piece.
+  void ComputePieceExtent(int extent[6]);
+
+  // Description:
+  // Write the frames for the current piece.
+  void WritePiece(vtkInformation *info);
+
+  // Description:
+  // Check whether there are no more pieces to write.
+  bool IsWriteComplete();
+
+  // Description:
+  // Close the files and report any errors.
+  void FinishWrite();
+
+  // Description:
+  // The state of the write, kept between pieces.
+  StreamInfo *Stream;
 };
 
 #endif // __vtkDICOMWriter_h
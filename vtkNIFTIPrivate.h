@@ -274,4 +274,36 @@ typedef struct nifti_2_header nifti_2_header;
 /*=================*/
 
 #endif /* __NIFTI2_HEADER */
+#ifdef __cplusplus
+#ifndef __vtkNIFTIPrivateSeek
+#define __vtkNIFTIPrivateSeek
+
+#include "vtkType.h"
+#include <stdio.h>
+
+/* Seek to an absolute offset, for use by the NIFTI reader and writer.
+   Since the "long offset" that fseek() takes might only be 32 bits,
+   large offsets are done as a series of relative seeks. */
+inline bool vtkNIFTIPrivateSeek(FILE *fp, vtkTypeInt64 offset)
+{
+  int whence = SEEK_SET;
+  do
+    {
+    long chunk = (offset < VTK_LONG_MAX ?
+                  static_cast<long>(offset) : VTK_LONG_MAX);
+    if (fseek(fp, chunk, whence) != 0)
+      {
+      return false;
+      }
+    whence = SEEK_CUR;
+    offset -= chunk;
+    }
+  while (offset > 0);
+
+  return true;
+}
+
+#endif /* __vtkNIFTIPrivateSeek */
+#endif /* __cplusplus */
+
 // VTK-HeaderTest-Exclude: vtkNIFTIPrivate.h
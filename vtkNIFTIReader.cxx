@@ -23,6 +23,7 @@
 #include "vtkMath.h"
 #include "vtkCommand.h"
 #include "vtkErrorCode.h"
+#include "vtkMultiThreader.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
@@ -35,6 +36,7 @@
 // Header for NIFTI
 #include "vtkNIFTIHeader.h"
 #include "vtkNIFTIPrivate.h"
+#include "vtkDICOMUtilities.h"
 
 // Header for zlib
 #ifdef DICOM_USE_VTKZLIB
@@ -43,12 +45,912 @@
 #include "zlib.h"
 #endif
 
+#include <sys/stat.h>
 #include <ctype.h>
+#include <stdio.h>
 #include <string.h>
 #include <string>
+#include <vector>
 
 vtkStandardNewMacro(vtkNIFTIReader);
 
+//----------------------------------------------------------------------------
+// An index of access points into a gzip file, in the manner of zran.c
+// from the zlib examples.  Each point records where a deflate block
+// starts (the byte offset and the bit offset within that byte), the
+// corresponding offset in the uncompressed data, and the 32k of data
+// that precedes the block, which is the dictionary for the block.
+struct vtkNIFTIReader::GzipIndex
+{
+  struct Point
+  {
+    vtkTypeInt64 In; // offset in the compressed file
+    vtkTypeInt64 Out; // offset in the uncompressed data
+    int Bits; // bits from the byte before "In" that begin the block
+    std::vector<unsigned char> Window;
+  };
+
+  GzipIndex() : FileSize(0), FileTime(0), Spacing(0), Modified(false) {}
+
+  // Check whether the index was built for the given file.
+  bool Matches(const char *filename, int spacing);
+
+  // Clear the index, and set it to the given file.
+  void Reset(const char *filename, int spacing);
+
+  // Read the index from a file, return false on failure.
+  bool ReadFile(const char *filename);
+
+  // Write the index to a file, return false on failure.
+  bool WriteFile(const char *filename);
+
+  std::string FileName;
+  vtkTypeInt64 FileSize;
+  vtkTypeInt64 FileTime;
+  int Spacing;
+  bool Modified;
+  std::vector<Point> Points;
+};
+
+//----------------------------------------------------------------------------
+namespace {
+
+// get the size and modification time of a file
+bool vtkNIFTIReaderFileStat(
+  const char *filename, vtkTypeInt64 *size, vtkTypeInt64 *mtime)
+{
+  struct stat fs;
+  if (stat(filename, &fs) != 0)
+    {
+    return false;
+    }
+  *size = static_cast<vtkTypeInt64>(fs.st_size);
+  *mtime = static_cast<vtkTypeInt64>(fs.st_mtime);
+  return true;
+}
+
+// swap the bytes of an unsigned integer
+inline vtkTypeUInt8 vtkNIFTIReaderSwap(vtkTypeUInt8 x)
+{
+  return x;
+}
+
+inline vtkTypeUInt16 vtkNIFTIReaderSwap(vtkTypeUInt16 x)
+{
+  return static_cast<vtkTypeUInt16>((x >> 8) | (x << 8));
+}
+
+inline vtkTypeUInt32 vtkNIFTIReaderSwap(vtkTypeUInt32 x)
+{
+  return ((x >> 24) | ((x >> 8) & 0x0000ff00u) |
+          ((x << 8) & 0x00ff0000u) | (x << 24));
+}
+
+inline vtkTypeUInt64 vtkNIFTIReaderSwap(vtkTypeUInt64 x)
+{
+  vtkTypeUInt32 lo = static_cast<vtkTypeUInt32>(x);
+  vtkTypeUInt32 hi = static_cast<vtkTypeUInt32>(x >> 32);
+  return ((static_cast<vtkTypeUInt64>(vtkNIFTIReaderSwap(lo)) << 32) |
+          vtkNIFTIReaderSwap(hi));
+}
+
+// copy "n" voxels from a vector plane with "m" values per voxel into
+// packed vectors with "nc" values per voxel, and swap bytes if "Swap",
+// if "N" is not zero then "m" is one and "N" is the constant stride
+template<class T, bool Swap, int N>
+void vtkNIFTIReaderUnpackVoxels(
+  const T *in, T *out, size_t n, int m, int nc)
+{
+  if (N != 0)
+    {
+    for (size_t i = 0; i < n; i++)
+      {
+      T x = in[i];
+      out[i*N] = (Swap ? vtkNIFTIReaderSwap(x) : x);
+      }
+    }
+  else
+    {
+    for (size_t i = 0; i < n; i++)
+      {
+      for (int j = 0; j < m; j++)
+        {
+        T x = in[j];
+        out[j] = (Swap ? vtkNIFTIReaderSwap(x) : x);
+        }
+      in += m;
+      out += nc;
+      }
+    }
+}
+
+template<class T, bool Swap>
+void vtkNIFTIReaderUnpackTyped(
+  const void *in, void *out, size_t n, int m, int nc)
+{
+  const T *ip = static_cast<const T *>(in);
+  T *op = static_cast<T *>(out);
+  if (m == 1 && nc == 2)
+    {
+    vtkNIFTIReaderUnpackVoxels<T, Swap, 2>(ip, op, n, m, nc);
+    }
+  else if (m == 1 && nc == 3)
+    {
+    vtkNIFTIReaderUnpackVoxels<T, Swap, 3>(ip, op, n, m, nc);
+    }
+  else if (m == 1 && nc == 4)
+    {
+    vtkNIFTIReaderUnpackVoxels<T, Swap, 4>(ip, op, n, m, nc);
+    }
+  else
+    {
+    vtkNIFTIReaderUnpackVoxels<T, Swap, 0>(ip, op, n, m, nc);
+    }
+}
+
+// do planar-to-packed conversion of vector components, and byte swap
+template<class T>
+void vtkNIFTIReaderUnpack(
+  const void *in, void *out, size_t n, int m, int nc, bool swap)
+{
+  if (swap)
+    {
+    vtkNIFTIReaderUnpackTyped<T, true>(in, out, n, m, nc);
+    }
+  else
+    {
+    vtkNIFTIReaderUnpackTyped<T, false>(in, out, n, m, nc);
+    }
+}
+
+// the magic number for the index file, and a check for the byte order
+const char vtkNIFTIReaderIndexMagic[8] = {
+  'N', 'I', 'I', 'G', 'Z', 'I', 'D', 'X' };
+const vtkTypeInt64 vtkNIFTIReaderIndexOrder = 0x0102030405060708ll;
+
+} // end anonymous namespace
+
+//----------------------------------------------------------------------------
+bool vtkNIFTIReader::GzipIndex::Matches(const char *filename, int spacing)
+{
+  vtkTypeInt64 size, mtime;
+  return (this->FileName == filename && this->Spacing == spacing &&
+          vtkNIFTIReaderFileStat(filename, &size, &mtime) &&
+          this->FileSize == size && this->FileTime == mtime);
+}
+
+//----------------------------------------------------------------------------
+void vtkNIFTIReader::GzipIndex::Reset(const char *filename, int spacing)
+{
+  this->FileName = filename;
+  this->FileSize = 0;
+  this->FileTime = 0;
+  vtkNIFTIReaderFileStat(filename, &this->FileSize, &this->FileTime);
+  this->Spacing = spacing;
+  this->Modified = false;
+  this->Points.clear();
+}
+
+//----------------------------------------------------------------------------
+bool vtkNIFTIReader::GzipIndex::ReadFile(const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+  if (!fp)
+    {
+    return false;
+    }
+
+  // the header must match the image file that this index is for
+  char magic[8];
+  vtkTypeInt64 header[5];
+  bool success = (fread(magic, 1, 8, fp) == 8 &&
+                  memcmp(magic, vtkNIFTIReaderIndexMagic, 8) == 0 &&
+                  fread(header, sizeof(vtkTypeInt64), 5, fp) == 5 &&
+                  header[0] == vtkNIFTIReaderIndexOrder &&
+                  header[1] == this->FileSize &&
+                  header[2] == this->FileTime &&
+                  header[3] == this->Spacing &&
+                  header[4] >= 0);
+
+  std::vector<Point> points;
+  for (vtkTypeInt64 i = 0; success && i < header[4]; i++)
+    {
+    vtkTypeInt64 values[4];
+    success = (fread(values, sizeof(vtkTypeInt64), 4, fp) == 4 &&
+               values[3] >= 0 && values[3] <= 32768);
+    if (success)
+      {
+      points.resize(points.size() + 1);
+      Point *p = &points.back();
+      p->In = values[0];
+      p->Out = values[1];
+      p->Bits = static_cast<int>(values[2]);
+      p->Window.resize(static_cast<size_t>(values[3]));
+      success = (values[3] == 0 ||
+                 fread(&p->Window[0], 1, p->Window.size(), fp) ==
+                   p->Window.size());
+      }
+    }
+  fclose(fp);
+
+  if (success)
+    {
+    this->Points.swap(points);
+    this->Modified = false;
+    }
+  return success;
+}
+
+//----------------------------------------------------------------------------
+bool vtkNIFTIReader::GzipIndex::WriteFile(const char *filename)
+{
+  FILE *fp = fopen(filename, "wb");
+  if (!fp)
+    {
+    return false;
+    }
+
+  vtkTypeInt64 header[5];
+  header[0] = vtkNIFTIReaderIndexOrder;
+  header[1] = this->FileSize;
+  header[2] = this->FileTime;
+  header[3] = this->Spacing;
+  header[4] = static_cast<vtkTypeInt64>(this->Points.size());
+  bool success = (fwrite(vtkNIFTIReaderIndexMagic, 1, 8, fp) == 8 &&
+                  fwrite(header, sizeof(vtkTypeInt64), 5, fp) == 5);
+
+  for (size_t i = 0; success && i < this->Points.size(); i++)
+    {
+    Point *p = &this->Points[i];
+    vtkTypeInt64 values[4];
+    values[0] = p->In;
+    values[1] = p->Out;
+    values[2] = p->Bits;
+    values[3] = static_cast<vtkTypeInt64>(p->Window.size());
+    success = (fwrite(values, sizeof(vtkTypeInt64), 4, fp) == 4 &&
+               (values[3] == 0 ||
+                fwrite(&p->Window[0], 1, p->Window.size(), fp) ==
+                  p->Window.size()));
+    }
+
+  success &= (fclose(fp) == 0);
+  if (success)
+    {
+    this->Modified = false;
+    }
+  else
+    {
+    vtksys::SystemTools::RemoveFile(filename);
+    }
+  return success;
+}
+
+//----------------------------------------------------------------------------
+// Read the image data from a file that might be compressed.  For gzip
+// files, the access points in the index are used for seeking, and new
+// access points are added as the file is decompressed.
+class vtkNIFTIReader::InputStream
+{
+public:
+  InputStream();
+  ~InputStream();
+
+  // Open the file, use the index if the file is compressed.
+  bool Open(const char *filename, GzipIndex *index);
+
+  // Close the file.
+  void Close();
+
+  // Go to an offset within the uncompressed data.
+  bool Seek(vtkTypeInt64 offset);
+
+  // Get the current offset within the uncompressed data.
+  vtkTypeInt64 Tell() { return this->Offset; }
+
+  // Read uncompressed data, return the number of bytes read.
+  size_t Read(void *buffer, size_t n);
+
+  // Check whether the end of the file was reached.
+  bool AtEnd() { return this->End; }
+
+  // Check whether the file is compressed.
+  bool IsCompressed() { return this->Compressed; }
+
+  // Set the number of threads to use for large reads.
+  void SetNumberOfThreads(int n) { this->NumberOfThreads = n; }
+
+private:
+  static const unsigned int WindowSize = 32768;
+  static const unsigned int ChunkSize = 65536;
+
+  // The ranges of data that are decompressed by each thread.
+  struct ThreadRanges
+  {
+    GzipIndex *Index;
+    unsigned char *Buffer;
+    std::vector<vtkTypeInt64> Bounds;
+    std::vector<int> Success;
+  };
+
+  // Start decompressing at an access point, or at the beginning.
+  bool Restart(const GzipIndex::Point *point);
+
+  // Decompress into the buffer, or discard the data if buffer is null.
+  size_t Inflate(unsigned char *buffer, size_t n);
+
+  // Add an access point at the current position.
+  void AddPoint();
+
+  // Read more compressed data if the input buffer is empty.
+  bool FillInput();
+
+  // Go to the next gzip member, return false if there are none.
+  bool NextMember();
+
+  // Add access points for BGZF files, which give the member sizes.
+  void ScanMembers();
+
+  // Decompress from the access points in the range with several threads,
+  // return the number of bytes, which might be less than requested.
+  size_t ReadParallel(unsigned char *buffer, size_t n);
+
+  // The thread entry point for ReadParallel.
+  static VTK_THREAD_RETURN_TYPE ReadThread(void *arg);
+
+  FILE *File;
+  GzipIndex *Index;
+  bool Compressed;
+  bool Active; // inflate stream is initialized
+  bool Raw; // inflate stream was started at an access point
+  bool End;
+  bool Error;
+  bool AddPoints; // false if the index is used only for seeking
+  int NumberOfThreads;
+  vtkTypeInt64 Offset; // offset in the uncompressed data
+  vtkTypeInt64 FileOffset; // offset in the file after the input buffer
+  z_stream Stream;
+  std::vector<unsigned char> Input;
+  std::vector<unsigned char> Window; // the most recent output
+  unsigned int WindowPos;
+  unsigned int WindowHave;
+};
+
+//----------------------------------------------------------------------------
+vtkNIFTIReader::InputStream::InputStream()
+{
+  this->File = 0;
+  this->Index = 0;
+  this->Compressed = false;
+  this->Active = false;
+  this->Raw = false;
+  this->End = false;
+  this->Error = false;
+  this->AddPoints = true;
+  this->NumberOfThreads = 1;
+  this->Offset = 0;
+  this->FileOffset = 0;
+  this->WindowPos = 0;
+  this->WindowHave = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkNIFTIReader::InputStream::~InputStream()
+{
+  this->Close();
+}
+
+//----------------------------------------------------------------------------
+bool vtkNIFTIReader::InputStream::Open(const char *filename, GzipIndex *index)
+{
+  this->Close();
+  this->File = fopen(filename, "rb");
+  if (!this->File)
+    {
+    return false;
+    }
+
+  // check for the gzip magic number
+  unsigned char magic[2] = { 0, 0 };
+  size_t n = fread(magic, 1, 2, this->File);
+  this->Compressed = (n == 2 && magic[0] == 0x1f && magic[1] == 0x8b);
+  this->Index = (this->Compressed ? index : 0);
+  this->End = false;
+  this->Error = false;
+
+  if (this->Compressed)
+    {
+    this->Input.resize(ChunkSize);
+    this->Window.resize(WindowSize);
+    if (this->Index && this->AddPoints && this->Index->Points.empty())
+      {
+      this->ScanMembers();
+      }
+    return this->Restart(0);
+    }
+
+  this->Offset = 0;
+  return vtkNIFTIPrivateSeek(this->File, 0);
+}
+
+//----------------------------------------------------------------------------
+void vtkNIFTIReader::InputStream::Close()
+{
+  if (this->Active)
+    {
+    inflateEnd(&this->Stream);
+    this->Active = false;
+    }
+  if (this->File)
+    {
+    fclose(this->File);
+    this->File = 0;
+    }
+}
+
+//----------------------------------------------------------------------------
+bool vtkNIFTIReader::InputStream::Restart(const GzipIndex::Point *point)
+{
+  if (this->Active)
+    {
+    inflateEnd(&this->Stream);
+    this->Active = false;
+    }
+
+  this->Stream.zalloc = Z_NULL;
+  this->Stream.zfree = Z_NULL;
+  this->Stream.opaque = Z_NULL;
+  this->Stream.next_in = Z_NULL;
+  this->Stream.avail_in = 0;
+  this->End = false;
+  this->Error = true;
+
+  if (point == 0)
+    {
+    // start at the gzip header at the beginning of the file
+    this->Offset = 0;
+    this->FileOffset = 0;
+    this->WindowPos = 0;
+    this->WindowHave = 0;
+    if (!vtkNIFTIPrivateSeek(this->File, 0) ||
+        inflateInit2(&this->Stream, 15 + 16) != Z_OK)
+      {
+      return false;
+      }
+    this->Active = true;
+    this->Raw = false;
+    }
+  else
+    {
+    // start at a block within the raw deflate data
+    this->Offset = point->Out;
+    this->FileOffset = point->In - (point->Bits ? 1 : 0);
+    if (!vtkNIFTIPrivateSeek(this->File, this->FileOffset) ||
+        inflateInit2(&this->Stream, -15) != Z_OK)
+      {
+      return false;
+      }
+    this->Active = true;
+    this->Raw = true;
+    if (point->Bits)
+      {
+      int c = getc(this->File);
+      if (c == EOF)
+        {
+        return false;
+        }
+      this->FileOffset++;
+      inflatePrime(&this->Stream, point->Bits, c >> (8 - point->Bits));
+      }
+    unsigned int m = static_cast<unsigned int>(point->Window.size());
+    if (m > 0)
+      {
+      inflateSetDictionary(&this->Stream, &point->Window[0], m);
+      memcpy(&this->Window[0], &point->Window[0], m);
+      }
+    this->WindowPos = m % WindowSize;
+    this->WindowHave = m;
+    }
+
+  this->Error = false;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkNIFTIReader::InputStream::AddPoint()
+{
+  GzipIndex *index = this->Index;
+  index->Points.resize(index->Points.size() + 1);
+  index->Modified = true;
+  GzipIndex::Point *point = &index->Points.back();
+  point->In = this->FileOffset - this->Stream.avail_in;
+  point->Out = this->Offset;
+  point->Bits = (this->Stream.data_type & 7);
+
+  // copy the most recent data, the oldest data first
+  unsigned int m = this->WindowHave;
+  point->Window.resize(m);
+  unsigned int pos = this->WindowPos;
+  unsigned int k = (pos >= m ? m : pos);
+  if (m > k)
+    {
+    memcpy(&point->Window[0], &this->Window[WindowSize - (m - k)], m - k);
+    }
+  if (k > 0)
+    {
+    memcpy(&point->Window[m - k], &this->Window[pos - k], k);
+    }
+}
+
+//----------------------------------------------------------------------------
+bool vtkNIFTIReader::InputStream::FillInput()
+{
+  z_stream *strm = &this->Stream;
+  if (strm->avail_in == 0)
+    {
+    size_t m = fread(&this->Input[0], 1, ChunkSize, this->File);
+    if (m == 0)
+      {
+      return false;
+      }
+    this->FileOffset += m;
+    strm->next_in = &this->Input[0];
+    strm->avail_in = static_cast<uInt>(m);
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkNIFTIReader::InputStream::NextMember()
+{
+  z_stream *strm = &this->Stream;
+
+  // if decompression started at an access point, then zlib does not
+  // know about the gzip wrapper, so the trailer must be skipped
+  for (int i = 0; i < 8 && this->Raw; i++)
+    {
+    if (!this->FillInput())
+      {
+      return false;
+      }
+    strm->next_in++;
+    strm->avail_in--;
+    }
+
+  // check for the magic number of another gzip member
+  if (!this->FillInput() || strm->next_in[0] != 0x1f)
+    {
+    return false;
+    }
+
+  // decode the gzip header of the next member
+  if (this->Raw)
+    {
+    Bytef *next = strm->next_in;
+    uInt avail = strm->avail_in;
+    inflateEnd(strm);
+    this->Active = false;
+    strm->next_in = next;
+    strm->avail_in = avail;
+    if (inflateInit2(strm, 15 + 16) != Z_OK)
+      {
+      this->Error = true;
+      return false;
+      }
+    this->Active = true;
+    this->Raw = false;
+    }
+  else
+    {
+    inflateReset(strm);
+    }
+  this->WindowHave = 0;
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+size_t vtkNIFTIReader::InputStream::Inflate(unsigned char *buffer, size_t n)
+{
+  z_stream *strm = &this->Stream;
+  GzipIndex *index = (this->AddPoints ? this->Index : 0);
+  size_t total = 0;
+
+  while (n > 0 && !this->End && !this->Error)
+    {
+    if (!this->FillInput())
+      {
+      // the file ended before the end of the compressed stream
+      this->End = true;
+      break;
+      }
+
+    // decompress into the window, then copy to the buffer, unless the
+    // buffer is large enough to decompress into it directly
+    bool direct = (buffer != 0 && n >= WindowSize);
+    unsigned int m = (direct ? 1073741824u : WindowSize - this->WindowPos);
+    m = (n < m ? static_cast<unsigned int>(n) : m);
+
+    // only stop at block boundaries if the index needs a new point
+    int flush = Z_NO_FLUSH;
+    vtkTypeInt64 nextPoint = 0;
+    if (index)
+      {
+      nextPoint = (index->Points.empty() ? 0 : index->Points.back().Out);
+      nextPoint += index->Spacing;
+      flush = (this->Offset + m >= nextPoint ? Z_BLOCK : Z_NO_FLUSH);
+      }
+
+    strm->next_out = (direct ? buffer : &this->Window[this->WindowPos]);
+    strm->avail_out = m;
+    int code = inflate(strm, flush);
+    m -= strm->avail_out;
+    if (direct)
+      {
+      // keep the most recent data in the window, for the index
+      unsigned int l = (m < WindowSize ? m : WindowSize);
+      const unsigned char *cp = buffer + (m - l);
+      while (l > 0)
+        {
+        unsigned int k = WindowSize - this->WindowPos;
+        k = (l < k ? l : k);
+        memcpy(&this->Window[this->WindowPos], cp, k);
+        this->WindowPos = (this->WindowPos + k) % WindowSize;
+        cp += k;
+        l -= k;
+        }
+      buffer += m;
+      }
+    else
+      {
+      if (buffer)
+        {
+        memcpy(buffer, &this->Window[this->WindowPos], m);
+        buffer += m;
+        }
+      this->WindowPos = (this->WindowPos + m) % WindowSize;
+      }
+    n -= m;
+    total += m;
+    this->Offset += m;
+    this->WindowHave += m;
+    this->WindowHave = (this->WindowHave < WindowSize ?
+                        this->WindowHave : WindowSize);
+
+    if (code == Z_STREAM_END)
+      {
+      // continue if the file has another gzip member
+      this->End = !this->NextMember();
+      }
+    else if (code != Z_OK && code != Z_BUF_ERROR)
+      {
+      this->Error = true;
+      }
+    else if (index && (strm->data_type & 128) != 0 &&
+             (strm->data_type & 64) == 0 && this->Offset >= nextPoint)
+      {
+      // at the start of a block that is not after the final block
+      this->AddPoint();
+      }
+    }
+
+  return total;
+}
+
+//----------------------------------------------------------------------------
+bool vtkNIFTIReader::InputStream::Seek(vtkTypeInt64 offset)
+{
+  if (!this->Compressed)
+    {
+    this->Offset = offset;
+    this->End = false;
+    return vtkNIFTIPrivateSeek(this->File, offset);
+    }
+
+  // find the last access point before the offset
+  const GzipIndex::Point *point = 0;
+  if (this->Index)
+    {
+    const std::vector<GzipIndex::Point>& points = this->Index->Points;
+    size_t lo = 0;
+    size_t hi = points.size();
+    while (lo < hi)
+      {
+      size_t mid = (lo + hi)/2;
+      if (points[mid].Out <= offset)
+        {
+        lo = mid + 1;
+        }
+      else
+        {
+        hi = mid;
+        }
+      }
+    point = (lo > 0 ? &points[lo - 1] : 0);
+    }
+
+  // restart unless the current position is a better place to start
+  if (this->Error || offset < this->Offset ||
+      (point && point->Out > this->Offset))
+    {
+    if (!this->Restart(point))
+      {
+      return false;
+      }
+    }
+
+  // decompress and discard the data until the offset is reached
+  vtkTypeInt64 n = offset - this->Offset;
+  return (n == 0 ||
+          this->Inflate(0, static_cast<size_t>(n)) == static_cast<size_t>(n));
+}
+
+//----------------------------------------------------------------------------
+void vtkNIFTIReader::InputStream::ScanMembers()
+{
+  // a BGZF member has a "BC" extra field that gives the member size,
+  // so the uncompressed size can be read from each member's trailer
+  GzipIndex *index = this->Index;
+  vtkTypeInt64 in = 0;
+  vtkTypeInt64 out = 0;
+  vtkTypeInt64 last = 0;
+  unsigned char header[18];
+  while (vtkNIFTIPrivateSeek(this->File, in) &&
+         fread(header, 1, 18, this->File) == 18)
+    {
+    // only FEXTRA can be set, so that the extra field is at offset 12
+    if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 ||
+        header[3] != 4 || header[12] != 'B' || header[13] != 'C' ||
+        header[14] != 2 || header[15] != 0)
+      {
+      break;
+      }
+    unsigned int xlen = header[10] + (header[11] << 8);
+    unsigned int size = header[16] + (header[17] << 8) + 1;
+    unsigned char trailer[4];
+    if (size < 12 + xlen + 8 ||
+        !vtkNIFTIPrivateSeek(this->File, in + size - 4) ||
+        fread(trailer, 1, 4, this->File) != 4)
+      {
+      break;
+      }
+
+    // add a point at the start of the deflate data of the member
+    if (out > 0 && out >= last + index->Spacing)
+      {
+      index->Points.resize(index->Points.size() + 1);
+      index->Modified = true;
+      GzipIndex::Point *point = &index->Points.back();
+      point->In = in + 12 + xlen;
+      point->Out = out;
+      point->Bits = 0;
+      last = out;
+      }
+
+    in += size;
+    out += trailer[0] + (trailer[1] << 8) + (trailer[2] << 16) +
+      (static_cast<vtkTypeInt64>(trailer[3]) << 24);
+    }
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkNIFTIReader::InputStream::ReadThread(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *info =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  ThreadRanges *ranges = static_cast<ThreadRanges *>(info->UserData);
+  int i = info->ThreadID;
+
+  // each thread has its own stream, which uses the index for seeking
+  vtkTypeInt64 start = ranges->Bounds[i];
+  size_t n = static_cast<size_t>(ranges->Bounds[i + 1] - start);
+  unsigned char *buffer = ranges->Buffer + (start - ranges->Bounds[0]);
+  InputStream stream;
+  stream.AddPoints = false;
+  ranges->Success[i] =
+    (stream.Open(ranges->Index->FileName.c_str(), ranges->Index) &&
+     stream.Seek(start) && stream.Read(buffer, n) == n);
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+size_t vtkNIFTIReader::InputStream::ReadParallel(
+  unsigned char *buffer, size_t n)
+{
+  // find the access points within the range that will be read, each
+  // thread will decompress the data between some of these points
+  const std::vector<GzipIndex::Point>& points = this->Index->Points;
+  vtkTypeInt64 start = this->Offset;
+  vtkTypeInt64 end = start + static_cast<vtkTypeInt64>(n);
+  std::vector<vtkTypeInt64> bounds;
+  bounds.push_back(start);
+  for (size_t i = 0; i < points.size(); i++)
+    {
+    if (points[i].Out > start && points[i].Out < end)
+      {
+      bounds.push_back(points[i].Out);
+      }
+    }
+
+  // the data after the last point is read after the threads finish
+  int numRanges = static_cast<int>(bounds.size()) - 1;
+  if (numRanges < 2)
+    {
+    return 0;
+    }
+  int numThreads = this->NumberOfThreads;
+  numThreads = (numThreads < numRanges ? numThreads : numRanges);
+
+  ThreadRanges ranges;
+  ranges.Index = this->Index;
+  ranges.Buffer = buffer;
+  ranges.Bounds.resize(numThreads + 1);
+  ranges.Success.resize(numThreads, 0);
+  for (int i = 0; i <= numThreads; i++)
+    {
+    ranges.Bounds[i] = bounds[i*numRanges/numThreads];
+    }
+
+  vtkMultiThreader *threader = vtkMultiThreader::New();
+  threader->SetNumberOfThreads(numThreads);
+  threader->SetSingleMethod(ReadThread, &ranges);
+  threader->SingleMethodExecute();
+  threader->Delete();
+
+  // if a thread failed, the whole range will be read without threads
+  for (int i = 0; i < numThreads; i++)
+    {
+    if (!ranges.Success[i])
+      {
+      return 0;
+      }
+    }
+
+  // continue from the last access point
+  vtkTypeInt64 last = ranges.Bounds[numThreads];
+  if (!this->Seek(last))
+    {
+    return 0;
+    }
+
+  return static_cast<size_t>(last - start);
+}
+
+//----------------------------------------------------------------------------
+size_t vtkNIFTIReader::InputStream::Read(void *buffer, size_t n)
+{
+  unsigned char *cp = static_cast<unsigned char *>(buffer);
+  if (this->Compressed)
+    {
+    size_t m = 0;
+    if (this->NumberOfThreads > 1 && this->Index && !this->Error)
+      {
+      m = this->ReadParallel(cp, n);
+      }
+    return m + this->Inflate(cp + m, n - m);
+    }
+
+  size_t m = fread(cp, 1, n, this->File);
+  this->Offset += m;
+  this->End = (m < n && feof(this->File) != 0);
+  return m;
+}
+
+//----------------------------------------------------------------------------
+// The locations of the header extensions, so that they can be read later.
+struct vtkNIFTIReader::HeaderExtensions
+{
+  struct Extension
+  {
+    int Code;
+    vtkTypeInt64 Offset; // offset of the data within the header file
+    vtkTypeInt64 Size; // size of the data, not including size and code
+  };
+
+  std::string FileName;
+  std::vector<Extension> List;
+};
+
 //----------------------------------------------------------------------------
 vtkNIFTIReader::vtkNIFTIReader()
 {
@@ -67,6 +969,13 @@ vtkNIFTIReader::vtkNIFTIReader()
   this->QFormMatrix = 0;
   this->SFormMatrix = 0;
   this->NIFTIHeader = 0;
+  this->IndexFileName = 0;
+  this->IndexSpacing = 4194304;
+  this->NumberOfThreads = 1;
+  this->MemoryMapDirectory = 0;
+  this->MemoryMapFile = 0;
+  this->Index = 0;
+  this->Extensions = new HeaderExtensions;
 }
 
 //----------------------------------------------------------------------------
@@ -84,6 +993,10 @@ vtkNIFTIReader::~vtkNIFTIReader()
     {
     this->NIFTIHeader->Delete();
     }
+  delete [] this->IndexFileName;
+  delete [] this->MemoryMapDirectory;
+  delete this->Index;
+  delete this->Extensions;
 }
 
 //----------------------------------------------------------------------------
@@ -180,6 +1093,67 @@ vtkNIFTIHeader *vtkNIFTIReader::GetNIFTIHeader()
   return this->NIFTIHeader;
 }
 
+//----------------------------------------------------------------------------
+int vtkNIFTIReader::GetNumberOfHeaderExtensions()
+{
+  return static_cast<int>(this->Extensions->List.size());
+}
+
+//----------------------------------------------------------------------------
+int vtkNIFTIReader::GetHeaderExtensionCode(int i)
+{
+  if (i < 0 || i >= this->GetNumberOfHeaderExtensions())
+    {
+    return 0;
+    }
+  return this->Extensions->List[i].Code;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkNIFTIReader::GetHeaderExtensionSize(int i)
+{
+  if (i < 0 || i >= this->GetNumberOfHeaderExtensions())
+    {
+    return 0;
+    }
+  return static_cast<vtkIdType>(this->Extensions->List[i].Size);
+}
+
+//----------------------------------------------------------------------------
+bool vtkNIFTIReader::ReadHeaderExtension(int i, void *buffer)
+{
+  if (i < 0 || i >= this->GetNumberOfHeaderExtensions())
+    {
+    vtkErrorMacro("ReadHeaderExtension: index " << i << " is out of range");
+    return false;
+    }
+
+  const HeaderExtensions::Extension& ext = this->Extensions->List[i];
+  const char *filename = this->Extensions->FileName.c_str();
+
+  // the extensions are near the beginning of the file, so it is not
+  // worth using the index of access points to find them
+  gzFile file = gzopen(filename, "rb");
+  if (!file)
+    {
+    vtkErrorMacro("Cannot open file " << filename);
+    return false;
+    }
+
+  bool success = (gzseek(file, static_cast<z_off_t>(ext.Offset), SEEK_SET) ==
+                  static_cast<z_off_t>(ext.Offset) &&
+                  gzread(file, buffer, static_cast<unsigned int>(ext.Size)) ==
+                  static_cast<int>(ext.Size));
+  gzclose(file);
+
+  if (!success)
+    {
+    vtkErrorMacro("Cannot read header extension from file " << filename);
+    }
+
+  return success;
+}
+
 //----------------------------------------------------------------------------
 void vtkNIFTIReader::PrintSelf(ostream& os, vtkIndent indent)
 {
@@ -226,6 +1200,17 @@ void vtkNIFTIReader::PrintSelf(ostream& os, vtkIndent indent)
     }
 
   os << indent << "NIFTIHeader:" << (this->NIFTIHeader ? "\n" : " (none)\n");
+  os << indent << "IndexFileName: "
+     << (this->IndexFileName ? this->IndexFileName : "(none)") << "\n";
+  os << indent << "IndexSpacing: " << this->IndexSpacing << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "MemoryMapDirectory: "
+     << (this->MemoryMapDirectory ? this->MemoryMapDirectory : "(none)")
+     << "\n";
+  os << indent << "MemoryMapFile: "
+     << (this->MemoryMapFile ? "On\n" : "Off\n");
+  os << indent << "NumberOfHeaderExtensions: "
+     << this->GetNumberOfHeaderExtensions() << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -539,6 +1524,7 @@ int vtkNIFTIReader::RequestInformation(
       }
     }
 
+  bool swapped = false;
   if (canRead)
     {
     if (niftiVersion >= 2)
@@ -547,6 +1533,7 @@ int vtkNIFTIReader::RequestInformation(
         {
         vtkNIFTIReaderSwapHeader(hdr2);
         isLittleEndian = !isLittleEndian;
+        swapped = true;
         }
       this->NIFTIHeader->SetHeader(hdr2);
       }
@@ -556,6 +1543,7 @@ int vtkNIFTIReader::RequestInformation(
         {
         vtkNIFTIReaderSwapHeader(hdr1);
         isLittleEndian = !isLittleEndian;
+        swapped = true;
         }
       // convert NIFTIv1 header into NIFTIv2
       this->NIFTIHeader->SetHeader(hdr1);
@@ -563,6 +1551,45 @@ int vtkNIFTIReader::RequestInformation(
       }
     }
 
+  // record the location of each header extension, but do not read them
+  this->Extensions->FileName = hdrname;
+  this->Extensions->List.clear();
+  char extender[4] = { 0, 0, 0, 0 };
+  if (canRead && niftiVersion > 0 &&
+      gzread(file, extender, 4) == 4 && extender[0] != 0)
+    {
+    // for .nii files the extensions must end before the image data,
+    // and for .hdr files they continue to the end of the file
+    bool singleFile = (hdr2->magic[1] == '+');
+    vtkTypeInt64 offset = (niftiVersion >= 2 ?
+                           vtkNIFTIHeader::Nifti2HeaderSize :
+                           vtkNIFTIHeader::Nifti1HeaderSize) + 4;
+    vtkTypeInt64 limit = (singleFile ? hdr2->vox_offset : VTK_TYPE_INT64_MAX);
+    int esize[2];
+    while (offset + 8 <= limit && gzread(file, esize, 8) == 8)
+      {
+      if (swapped)
+        {
+        vtkByteSwap::SwapVoidRange(esize, 2, 4);
+        }
+      if (esize[0] < 8 || offset + esize[0] > limit)
+        {
+        break;
+        }
+      HeaderExtensions::Extension ext;
+      ext.Code = esize[1];
+      ext.Offset = offset + 8;
+      ext.Size = esize[0] - 8;
+      this->Extensions->List.push_back(ext);
+      offset += esize[0];
+      if (gzseek(file, static_cast<z_off_t>(offset), SEEK_SET) !=
+          static_cast<z_off_t>(offset))
+        {
+        break;
+        }
+      }
+    }
+
   gzclose(file);
 
   // delete the NIFTIv1 header, use the NIFTIv2 header
@@ -1074,16 +2101,9 @@ int vtkNIFTIReader::RequestData(
   int extent[6];
   outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), extent);
 
-  // get the data object, allocate memory
+  // get the data object, memory is allocated after the file is opened
   vtkImageData *data =
     static_cast<vtkImageData *>(outInfo->Get(vtkDataObject::DATA_OBJECT()));
-#if VTK_MAJOR_VERSION >= 6
-  this->AllocateOutputData(data, outInfo, extent);
-#else
-  this->AllocateOutputData(data, extent);
-#endif
-
-  data->GetPointData()->GetScalars()->SetName("NIFTI");
 
   const char *filename = 0;
   char *imgname = 0;
@@ -1136,23 +2156,31 @@ int vtkNIFTIReader::RequestData(
 
   vtkDebugMacro("Opening NIFTI file " << imgname);
 
-  data->GetPointData()->GetScalars()->SetName("NIFTI");
-
-  unsigned char *dataPtr =
-    static_cast<unsigned char *>(data->GetScalarPointer());
-
-  gzFile file = gzopen(imgname, "rb");
+  // the index of access points is kept for the most recent file
+  if (!this->Index)
+    {
+    this->Index = new GzipIndex;
+    }
+  if (!this->Index->Matches(imgname, this->IndexSpacing))
+    {
+    this->Index->Reset(imgname, this->IndexSpacing);
+    if (this->IndexFileName)
+      {
+      this->Index->ReadFile(this->IndexFileName);
+      }
+    }
 
-  delete [] imgname;
+  InputStream file;
+  file.SetNumberOfThreads(this->NumberOfThreads);
+  bool isOpen = file.Open(imgname, this->Index);
 
-  if (!file)
+  if (!isOpen)
     {
+    delete [] imgname;
     return 0;
     }
 
   int swapBytes = this->GetSwapBytes();
-  int scalarSize = data->GetScalarSize();
-  int numComponents = data->GetNumberOfScalarComponents();
   int timeDim = (this->Dim[0] >= 4 ? this->Dim[4] : 1);
   int vectorDim = (this->Dim[0] >= 5 ? this->Dim[5] : 1);
   if (this->TimeAsVector)
@@ -1164,6 +2192,73 @@ int vtkNIFTIReader::RequestData(
   int outSizeY = extent[3] - extent[2] + 1;
   int outSizeZ = extent[5] - extent[4] + 1;
 
+  // the image can be mapped directly from the file if the file is not
+  // compressed and if the voxels are stored exactly as VTK needs them
+  int wholeExtent[6];
+  outInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), wholeExtent);
+  bool mapFile = (this->MemoryMapFile && !file.IsCompressed() &&
+                  (swapBytes == 0 ||
+                   vtkDataArray::GetDataTypeSize(this->DataScalarType) == 1) &&
+                  vectorDim == 1 && this->QFac >= 0);
+  for (int i = 0; i < 6 && mapFile; i++)
+    {
+    mapFile = (extent[i] == wholeExtent[i]);
+    }
+
+  // allocate memory, either as a mapping of the file, as a mapping
+  // of a scratch file, or from the heap
+  vtkIdType numTuples = outSizeX;
+  numTuples *= outSizeY;
+  numTuples *= outSizeZ;
+  vtkDataArray *array = 0;
+  bool fileMapped = false;
+  if (mapFile)
+    {
+    array = vtkDICOMUtilities::NewFileArray(
+      this->DataScalarType, this->NumberOfScalarComponents, numTuples,
+      imgname, this->GetHeaderSize());
+    fileMapped = (array != 0);
+    }
+  if (array == 0 && this->MemoryMapDirectory)
+    {
+    array = vtkDICOMUtilities::NewScratchArray(
+      this->DataScalarType, this->NumberOfScalarComponents, numTuples,
+      this->MemoryMapDirectory);
+    }
+  if (array)
+    {
+    data->SetExtent(extent);
+    data->GetPointData()->SetScalars(array);
+    array->Delete();
+    }
+  else
+    {
+#if VTK_MAJOR_VERSION >= 6
+    this->AllocateOutputData(data, outInfo, extent);
+#else
+    this->AllocateOutputData(data, extent);
+#endif
+    }
+
+  delete [] imgname;
+
+  data->GetPointData()->GetScalars()->SetName("NIFTI");
+
+  if (fileMapped)
+    {
+    // the voxels will be paged in from the file as they are accessed
+    this->InvokeEvent(vtkCommand::StartEvent);
+    this->UpdateProgress(1.0);
+    this->InvokeEvent(vtkCommand::EndEvent);
+    return 1;
+    }
+
+  unsigned char *dataPtr =
+    static_cast<unsigned char *>(data->GetScalarPointer());
+
+  int scalarSize = data->GetScalarSize();
+  int numComponents = data->GetNumberOfScalarComponents();
+
   z_off_t fileVoxelIncr = scalarSize*numComponents/vectorDim;
   z_off_t fileRowIncr = fileVoxelIncr*this->Dim[1];
   z_off_t fileSliceIncr = fileRowIncr*this->Dim[2];
@@ -1174,13 +2269,6 @@ int vtkNIFTIReader::RequestData(
     fileVectorIncr = fileTimeIncr;
     }
 
-  // add a buffer for planar-vector to packed-vector conversion
-  unsigned char *rowBuffer = 0;
-  if (vectorDim > 1)
-    {
-    rowBuffer = new unsigned char[outSizeX*fileVoxelIncr];
-    }
-
   // special increment to reverse the slices if needed
   vtkIdType sliceOffset = 0;
 
@@ -1200,13 +2288,50 @@ int vtkNIFTIReader::RequestData(
     static_cast<vtkIdType>(0.02*outSizeY*outSizeZ*vectorDim) + 1;
   vtkIdType count = 0;
 
+  // if the rows are whole, then each slice is contiguous in the file
+  // and can be read at once, and if the slices are whole (and are not
+  // reversed) then several slices can be read at once
+  bool wholeRows = (outSizeX == this->Dim[1]);
+  bool wholeSlices = (wholeRows && outSizeY == this->Dim[2] &&
+                      sliceOffset == 0);
+  int maxSlices = 1;
+  if (wholeSlices)
+    {
+    // limit the size of each read, so that progress can be reported,
+    // but make the reads larger if threads are used for decompression
+    int numThreads = (this->NumberOfThreads > 1 ? this->NumberOfThreads : 1);
+    vtkIdType n = target*numThreads/outSizeY;
+    if (vectorDim > 1)
+      {
+      // also limit the size of the conversion buffer to about 16MB
+      vtkIdType m = 16777216;
+      m = m*numThreads/(fileSliceIncr > 0 ? fileSliceIncr : 1);
+      n = (m < n ? m : n);
+      }
+    maxSlices = static_cast<int>(n < outSizeZ ? n : outSizeZ);
+    maxSlices = (maxSlices > 1 ? maxSlices : 1);
+    }
+
+  // add a buffer for planar-vector to packed-vector conversion
+  unsigned char *rowBuffer = 0;
+  if (vectorDim > 1)
+    {
+    size_t n = outSizeX*fileVoxelIncr;
+    if (wholeRows)
+      {
+      n *= static_cast<size_t>(outSizeY)*maxSlices;
+      }
+    rowBuffer = new unsigned char[n];
+    }
+
   // seek to the start of the data
   z_off_t offset = static_cast<z_off_t>(this->GetHeaderSize());
   offset += extent[0]*fileVoxelIncr;
   offset += extent[2]*fileRowIncr;
   offset += extent[4]*fileSliceIncr;
 
-  // read the data one row at a time, do planar-to-packed conversion
+  // read the data one row at a time, or one or more slices at a time
+  // if they are contiguous in the file, and do planar-to-packed conversion
   // of vector components if NIFTI file has a vector dimension
   int rowSize = numComponents/vectorDim*outSizeX;
   int t = 0; // counter for time
@@ -1221,11 +2346,10 @@ int vtkNIFTIReader::RequestData(
     {
     if (offset)
       {
-      int rval = gzseek(file, offset, SEEK_CUR);
-      if (rval == -1)
+      if (!file.Seek(file.Tell() + offset))
         {
         errorCode = vtkErrorCode::FileFormatError;
-        if (gzeof(file))
+        if (file.AtEnd())
           {
           errorCode = vtkErrorCode::PrematureEndOfFileError;
           }
@@ -1233,54 +2357,87 @@ int vtkNIFTIReader::RequestData(
         }
       }
 
+    // the number of rows and slices to read at once
+    int numRows = 1;
+    int numSlices = 1;
+    if (wholeRows)
+      {
+      // the row counter "j" is always zero here
+      numRows = outSizeY;
+      if (wholeSlices)
+        {
+        numSlices = outSizeZ - k;
+        numSlices = (numSlices < maxSlices ? numSlices : maxSlices);
+        }
+      }
+    size_t numVoxels = static_cast<size_t>(outSizeX)*numRows*numSlices;
+    size_t readSize = numVoxels*fileVoxelIncr;
+
     if (vectorDim == 1)
       {
       // read directly into the output instead of into a buffer
       rowBuffer = ptr;
       }
 
-    int code = gzread(file, rowBuffer, rowSize*scalarSize);
-    if (code != rowSize*scalarSize)
+    size_t code = file.Read(rowBuffer, readSize);
+    if (code != readSize)
       {
       errorCode = vtkErrorCode::FileFormatError;
-      if (gzeof(file))
+      if (file.AtEnd())
         {
         errorCode = vtkErrorCode::PrematureEndOfFileError;
         }
       break;
       }
 
-    if (swapBytes != 0 && scalarSize > 1)
-      {
-      vtkByteSwap::SwapVoidRange(rowBuffer, rowSize, scalarSize);
-      }
-
     if (vectorDim == 1)
       {
-      // advance the pointer to the next row
-      ptr += outSizeX*numComponents*scalarSize;
+      if (swapBytes != 0 && scalarSize > 1)
+        {
+        vtkByteSwap::SwapVoidRange(ptr, readSize/scalarSize, scalarSize);
+        }
+      // advance the pointer past the rows that were read
+      ptr += readSize;
       rowBuffer = 0;
       }
     else
       {
-      // write vector plane to packed vector component
-      unsigned char *tmpPtr = rowBuffer;
-      z_off_t skipOther = scalarSize*numComponents - fileVoxelIncr;
-      for (int i = 0; i < outSizeX; i++)
+      // write vector plane to packed vector component, with byte swap
+      int m = numComponents/vectorDim;
+      bool swap = (swapBytes != 0);
+      switch (scalarSize)
         {
-        // write one vector component of one voxel
-        z_off_t n = fileVoxelIncr;
-        do { *ptr++ = *tmpPtr++; } while (--n);
-        // skip past the other components
-        ptr += skipOther;
+        case 1:
+          vtkNIFTIReaderUnpack<vtkTypeUInt8>(
+            rowBuffer, ptr, numVoxels, m, numComponents, false);
+          break;
+        case 2:
+          vtkNIFTIReaderUnpack<vtkTypeUInt16>(
+            rowBuffer, ptr, numVoxels, m, numComponents, swap);
+          break;
+        case 4:
+          vtkNIFTIReaderUnpack<vtkTypeUInt32>(
+            rowBuffer, ptr, numVoxels, m, numComponents, swap);
+          break;
+        case 8:
+          vtkNIFTIReaderUnpack<vtkTypeUInt64>(
+            rowBuffer, ptr, numVoxels, m, numComponents, swap);
+          break;
         }
+      ptr += numVoxels*numComponents*scalarSize;
       }
 
-    if (++count % target == 0)
+    vtkIdType lastCount = count;
+    count += numRows*numSlices;
+    if (count/target != lastCount/target)
       {
-      this->UpdateProgress(0.02*count/target);
+      this->UpdateProgress(0.02*(count/target));
       }
 
+    // go to the last row that was read
+    j += numRows - 1;
+    k += numSlices - 1;
+
     // offset to skip unread sections of the file, for when
     // the update extent is less than the whole extent
     offset = fileRowIncr - outSizeX*fileVoxelIncr;
@@ -1321,7 +2478,14 @@ int vtkNIFTIReader::RequestData(
     delete [] rowBuffer;
     }
 
-  gzclose(file);
+  file.Close();
+
+  // save the index, if any new access points were added
+  if (this->IndexFileName && this->Index->Modified &&
+      !this->Index->WriteFile(this->IndexFileName))
+    {
+    vtkWarningMacro("Unable to write index file " << this->IndexFileName);
+    }
 
   if (errorCode)
     {
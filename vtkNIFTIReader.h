@@ -134,6 +134,83 @@ public:
   // Get the raw header information from the NIfTI file.
   vtkNIFTIHeader *GetNIFTIHeader();
 
+  // Description:
+  // Set the spacing of the access points for compressed files.
+  // When a .nii.gz file is read, the reader records an access point
+  // each time it decompresses this many bytes (the default is 4MB).
+  // An access point allows decompression to resume part-way through the
+  // file, so that a later read of a sub-extent (or of the same file) only
+  // has to decompress from the nearest access point.  Each access point
+  // uses 32k of memory.  The access points are kept for the most recently
+  // read file.
+  vtkSetClampMacro(IndexSpacing, int, 65536, VTK_INT_MAX);
+  vtkGetMacro(IndexSpacing, int);
+
+  // Description:
+  // Set a file for storing the access points for compressed files.
+  // If this is set, the access points are read from this file before
+  // the image is read (if the file was written for the same image), and
+  // the file is rewritten if new access points were added.
+  vtkSetStringMacro(IndexFileName);
+  vtkGetStringMacro(IndexFileName);
+
+  // Description:
+  // Set the number of threads to use for decompression.
+  // The threads decompress the data between the access points in
+  // parallel, so they are only used if the access points for the file
+  // are already known, either from a previous read or from the
+  // IndexFileName.  For BGZF files (gzip files that are made of many
+  // small members, each of which records its own size) the access points
+  // are found when the file is opened.  The default is 1.
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  // Description:
+  // Set a directory for a scratch file that will hold the image.
+  // If this is set, then rather than allocating memory for the output,
+  // the reader creates a temporary file in this directory and maps it
+  // into memory, so that images larger than the available RAM can be
+  // read and the operating system can page the voxels in and out as
+  // they are used.  The file is deleted when the output scalars are
+  // deleted.  If the file cannot be created, memory is allocated as
+  // usual.  The default is NULL, which means no scratch file.
+  vtkSetStringMacro(MemoryMapDirectory);
+  vtkGetStringMacro(MemoryMapDirectory);
+
+  // Description:
+  // Map the voxels directly from the NIFTI file, instead of reading them.
+  // This is only done if the file is not compressed, if it does not need
+  // byte swapping, if it has no vector dimension (or if TimeAsVector is
+  // off), if the slices do not have to be reversed, and if the whole
+  // image is being read.  The mapping is copy-on-write, so changes to
+  // the output scalars are never written to the file, but the file must
+  // not be changed by other programs while the output is in use.  When
+  // this is not possible, the image is read as usual.  Default: Off.
+  vtkSetMacro(MemoryMapFile, int);
+  vtkBooleanMacro(MemoryMapFile, int);
+  vtkGetMacro(MemoryMapFile, int);
+
+  // Description:
+  // Get the number of NIfTI header extensions in the file.
+  // The location of each extension is recorded when the header is read,
+  // but the contents of an extension are not read until they are
+  // requested with ReadHeaderExtension().
+  int GetNumberOfHeaderExtensions();
+
+  // Description:
+  // Get the code that says what kind of data an extension holds.
+  // For example, 2 is DICOM, 4 is AFNI, 6 is a comment, and 32 is JSON.
+  int GetHeaderExtensionCode(int i);
+
+  // Description:
+  // Get the size of an extension in bytes, not including its code.
+  vtkIdType GetHeaderExtensionSize(int i);
+
+  // Description:
+  // Read the contents of an extension from the file.  The buffer must be
+  // at least GetHeaderExtensionSize() bytes.  Returns false on failure.
+  bool ReadHeaderExtension(int i, void *buffer);
+
 protected:
   vtkNIFTIReader();
   ~vtkNIFTIReader();
@@ -204,9 +281,30 @@ protected:
   // A copy of the header from the file that was most recently read.
   vtkNIFTIHeader *NIFTIHeader;
 
+  // Description:
+  // The index of access points for compressed files.
+  char *IndexFileName;
+  int IndexSpacing;
+
+  // Description:
+  // The number of decompression threads.
+  int NumberOfThreads;
+
+  // Description:
+  // Memory mapping of the output.
+  char *MemoryMapDirectory;
+  int MemoryMapFile;
+
 private:
   vtkNIFTIReader(const vtkNIFTIReader&);  // Not implemented.
   void operator=(const vtkNIFTIReader&);  // Not implemented.
+
+  struct GzipIndex;
+  class InputStream;
+  struct HeaderExtensions;
+
+  GzipIndex *Index;
+  HeaderExtensions *Extensions;
 };
 
 #endif // __vtkNIFTIReader_h
@@ -18,6 +18,7 @@
 #include "vtkNIFTIReader.h"
 #include "vtkImageData.h"
 #include "vtkPointData.h"
+#include "vtkDataArray.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
@@ -27,6 +28,8 @@
 #include "vtkMath.h"
 #include "vtkCommand.h"
 #include "vtkVersion.h"
+#include "vtkMultiThreader.h"
+#include "vtkSmartPointer.h"
 
 #include "vtksys/SystemTools.hxx"
 #include "vtksys/ios/sstream"
@@ -47,7 +50,29 @@
 #include <float.h>
 #include <math.h>
 
+#include <vector>
+
 vtkStandardNewMacro(vtkNIFTIWriter);
+
+//----------------------------------------------------------------------------
+// The header extensions, each of which is written as an 8-byte size and
+// code followed by the data, padded to a multiple of 16 bytes.
+struct vtkNIFTIWriter::HeaderExtensions
+{
+  struct Extension
+  {
+    int Code;
+    std::vector<char> Data;
+  };
+
+  // Get the size of an extension in the file.
+  static vtkTypeInt64 FileSize(const Extension& ext)
+  {
+    return (static_cast<vtkTypeInt64>(ext.Data.size()) + 8 + 15)/16*16;
+  }
+
+  std::vector<Extension> List;
+};
 vtkCxxSetObjectMacro(vtkNIFTIWriter,QFormMatrix,vtkMatrix4x4);
 vtkCxxSetObjectMacro(vtkNIFTIWriter,SFormMatrix,vtkMatrix4x4);
 vtkCxxSetObjectMacro(vtkNIFTIWriter,NIFTIHeader,vtkNIFTIHeader);
@@ -68,6 +93,12 @@ vtkNIFTIWriter::vtkNIFTIWriter()
   this->OwnHeader = 0;
   this->NIFTIHeader = 0;
   this->NIFTIVersion = 0;
+  this->CompressionLevel = -1;
+  this->NumberOfThreads = 1;
+  this->UseBGZF = 1;
+  this->Streaming = 0;
+  this->Stream = 0;
+  this->Extensions = new HeaderExtensions;
   this->Description = new char[80];
   // Default description is "VTKX.Y.Z"
   strncpy(this->Description, "VTK", 3);
@@ -94,6 +125,7 @@ vtkNIFTIWriter::~vtkNIFTIWriter()
     this->NIFTIHeader->Delete();
     }
   delete [] this->Description;
+  delete this->Extensions;
 }
 
 //----------------------------------------------------------------------------
@@ -106,6 +138,37 @@ vtkNIFTIHeader *vtkNIFTIWriter::GetNIFTIHeader()
   return this->NIFTIHeader;
 }
 
+//----------------------------------------------------------------------------
+void vtkNIFTIWriter::AddHeaderExtension(
+  int code, const void *data, vtkIdType size)
+{
+  std::vector<HeaderExtensions::Extension>& list = this->Extensions->List;
+  list.resize(list.size() + 1);
+  list.back().Code = code;
+  if (size > 0)
+    {
+    const char *cp = static_cast<const char *>(data);
+    list.back().Data.assign(cp, cp + size);
+    }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkNIFTIWriter::RemoveAllHeaderExtensions()
+{
+  if (!this->Extensions->List.empty())
+    {
+    this->Extensions->List.clear();
+    this->Modified();
+    }
+}
+
+//----------------------------------------------------------------------------
+int vtkNIFTIWriter::GetNumberOfHeaderExtensions()
+{
+  return static_cast<int>(this->Extensions->List.size());
+}
+
 //----------------------------------------------------------------------------
 void vtkNIFTIWriter::PrintSelf(ostream& os, vtkIndent indent)
 {
@@ -152,6 +215,13 @@ void vtkNIFTIWriter::PrintSelf(ostream& os, vtkIndent indent)
 
   os << indent << "NIFTIHeader:" << (this->NIFTIHeader ? "\n" : " (none)\n");
   os << indent << "NIFTIVersion: " << this->NIFTIVersion << "\n";
+  os << indent << "CompressionLevel: " << this->CompressionLevel << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "UseBGZF: " << (this->UseBGZF ? "On\n" : "Off\n");
+  os << indent << "Streaming: "
+     << (this->Streaming ? "On\n" : "Off\n");
+  os << indent << "NumberOfHeaderExtensions: "
+     << this->GetNumberOfHeaderExtensions() << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -413,6 +483,59 @@ void vtkNIFTIWriterMatrix(
   mmat[11] = offset[2];
 }
 
+// copy "n" voxels from packed vectors with "nc" values per voxel into
+// a vector plane with "m" values per voxel, if "N" is not zero then
+// "m" is one and "N" is the constant stride
+template<class T, int N>
+void vtkNIFTIWriterPackVoxels(
+  const T *in, T *out, size_t n, int m, int nc)
+{
+  if (N != 0)
+    {
+    for (size_t i = 0; i < n; i++)
+      {
+      out[i] = in[i*N];
+      }
+    }
+  else
+    {
+    for (size_t i = 0; i < n; i++)
+      {
+      for (int j = 0; j < m; j++)
+        {
+        out[j] = in[j];
+        }
+      in += nc;
+      out += m;
+      }
+    }
+}
+
+// do packed-to-planar conversion of vector components
+template<class T>
+void vtkNIFTIWriterPack(
+  const void *in, void *out, size_t n, int m, int nc)
+{
+  const T *ip = static_cast<const T *>(in);
+  T *op = static_cast<T *>(out);
+  if (m == 1 && nc == 2)
+    {
+    vtkNIFTIWriterPackVoxels<T, 2>(ip, op, n, m, nc);
+    }
+  else if (m == 1 && nc == 3)
+    {
+    vtkNIFTIWriterPackVoxels<T, 3>(ip, op, n, m, nc);
+    }
+  else if (m == 1 && nc == 4)
+    {
+    vtkNIFTIWriterPackVoxels<T, 4>(ip, op, n, m, nc);
+    }
+  else
+    {
+    vtkNIFTIWriterPackVoxels<T, 0>(ip, op, n, m, nc);
+    }
+}
+
 } // end anonymous namespace
 
 //----------------------------------------------------------------------------
@@ -482,6 +605,12 @@ int vtkNIFTIWriter::GenerateHeader(vtkInformation *info, bool singleFile)
     {
     strncpy(hdr.magic, (version == 2 ? "n+2" : "n+1"), 4);
     hdr.vox_offset = (version == 2 ? 544 : 352);
+    // the extensions are between the header and the image
+    for (size_t i = 0; i < this->Extensions->List.size(); i++)
+      {
+      hdr.vox_offset += HeaderExtensions::FileSize(
+        this->Extensions->List[i]);
+      }
     }
   if (version == 2)
     {
@@ -576,29 +705,339 @@ int vtkNIFTIWriter::GenerateHeader(vtkInformation *info, bool singleFile)
 }
 
 //----------------------------------------------------------------------------
-int vtkNIFTIWriter::RequestData(
-  vtkInformation* vtkNotUsed(request),
-  vtkInformationVector** inputVector,
-  vtkInformationVector* vtkNotUsed(outputVector))
+namespace {
+
+// Write a gzip file by compressing blocks of data in parallel, in the
+// same manner as pigz.  Each block is compressed as a separate raw
+// deflate stream that ends on a byte boundary, with the last 32k of the
+// preceding block as its dictionary, so that the blocks can simply be
+// concatenated to form a single gzip member.  The CRC for the trailer
+// is combined from the CRC of each block.
+class vtkNIFTIWriterGzipStream
 {
-  this->SetErrorCode(vtkErrorCode::NoError);
+public:
+  vtkNIFTIWriterGzipStream(FILE *fp, int level, int numThreads, bool bgzf);
+  ~vtkNIFTIWriterGzipStream();
+
+  // Add data to the stream, return the number of bytes written.
+  size_t Write(const void *data, size_t n);
+
+  // Compress any remaining data, then write the gzip trailer.
+  bool Close();
+
+  // The number of threads that will be used.
+  int GetNumberOfThreads() { return this->NumberOfThreads; }
+
+  // Compress the blocks that belong to one thread.
+  void CompressBlocks(int threadId, int numThreads);
+
+private:
+  bool WriteBlocks(bool last);
+
+  static const size_t DictSize = 32768;
+
+  FILE *File;
+  bool BGZF; // write each block as a BGZF member
+  size_t BlockSize;
+  int NumberOfThreads;
+  int NumberOfBlocks; // the number of blocks in the buffer
+  bool Last; // whether the final block is in the buffer
+  bool Error;
+  uLong CRC;
+  uLong TotalSize;
+  std::vector<z_stream> Streams;
+  std::vector<Bytef> Input; // the blocks to compress
+  size_t InputSize;
+  std::vector<Bytef> Dictionary;
+  std::vector<std::vector<Bytef> > Output;
+  std::vector<uLong> BlockCRC;
+  std::vector<bool> BlockOK;
+};
+
+// the thread entry point for vtkMultiThreader
+VTK_THREAD_RETURN_TYPE vtkNIFTIWriterCompressBlocks(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *info =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkNIFTIWriterGzipStream *zs =
+    static_cast<vtkNIFTIWriterGzipStream *>(info->UserData);
 
-  vtkInformation *info = inputVector[0]->GetInformationObject(0);
-  vtkImageData *data =
-    vtkImageData::SafeDownCast(info->Get(vtkDataObject::DATA_OBJECT()));
+  zs->CompressBlocks(info->ThreadID, info->NumberOfThreads);
 
-  if (data == NULL)
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+vtkNIFTIWriterGzipStream::vtkNIFTIWriterGzipStream(
+  FILE *fp, int level, int numThreads, bool bgzf)
+{
+  this->File = fp;
+  this->BGZF = bgzf;
+  // a BGZF member, including its header and trailer, must fit in 64k
+  this->BlockSize = (bgzf ? 65280 : 131072);
+  this->NumberOfThreads = (numThreads > 1 ? numThreads : 1);
+  this->Last = false;
+  this->Error = false;
+  this->CRC = crc32(0, Z_NULL, 0);
+  this->TotalSize = 0;
+
+  // several blocks per thread, to even out the work between threads
+  this->NumberOfBlocks = 4*this->NumberOfThreads;
+  this->Input.resize(this->NumberOfBlocks*this->BlockSize);
+  this->InputSize = 0;
+  this->Output.resize(this->NumberOfBlocks);
+  this->BlockCRC.resize(this->NumberOfBlocks);
+  this->BlockOK.resize(this->NumberOfBlocks);
+
+  // each thread has its own deflate stream
+  this->Streams.resize(this->NumberOfThreads);
+  for (int i = 0; i < this->NumberOfThreads; i++)
     {
-    vtkErrorMacro("No input provided!");
-    return 0;
+    z_stream *strm = &this->Streams[i];
+    strm->zalloc = Z_NULL;
+    strm->zfree = Z_NULL;
+    strm->opaque = Z_NULL;
+    if (deflateInit2(strm, level, Z_DEFLATED, -MAX_WBITS,
+                     8, Z_DEFAULT_STRATEGY) != Z_OK)
+      {
+      this->Streams.resize(i);
+      this->Error = true;
+      break;
+      }
+    }
+
+  // write the gzip header: magic, method, flags, mtime, xfl, os
+  static const unsigned char header[10] = {
+    0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+  if (!bgzf && !this->Error && fwrite(header, 1, 10, fp) != 10)
+    {
+    this->Error = true;
+    }
+}
+
+vtkNIFTIWriterGzipStream::~vtkNIFTIWriterGzipStream()
+{
+  for (size_t i = 0; i < this->Streams.size(); i++)
+    {
+    deflateEnd(&this->Streams[i]);
+    }
+}
+
+size_t vtkNIFTIWriterGzipStream::Write(const void *data, size_t n)
+{
+  const Bytef *cp = static_cast<const Bytef *>(data);
+  size_t m = n;
+  while (m != 0 && !this->Error)
+    {
+    size_t k = this->Input.size() - this->InputSize;
+    k = (k < m ? k : m);
+    memcpy(&this->Input[this->InputSize], cp, k);
+    this->InputSize += k;
+    cp += k;
+    m -= k;
+    // compress as soon as the buffer is full
+    if (this->InputSize == this->Input.size())
+      {
+      this->WriteBlocks(false);
+      }
     }
 
+  return (this->Error ? 0 : n);
+}
+
+bool vtkNIFTIWriterGzipStream::Close()
+{
+  if (!this->Error)
+    {
+    this->WriteBlocks(true);
+    }
+
+  if (this->BGZF)
+    {
+    // BGZF files end with an empty member
+    static const unsigned char eof[28] = {
+      0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+      0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    if (!this->Error && fwrite(eof, 1, 28, this->File) != 28)
+      {
+      this->Error = true;
+      }
+    return !this->Error;
+    }
+
+  // write the trailer: the CRC and the size (modulo 2^32)
+  unsigned char trailer[8];
+  for (int i = 0; i < 4; i++)
+    {
+    trailer[i] = static_cast<unsigned char>(this->CRC >> (8*i));
+    trailer[4 + i] = static_cast<unsigned char>(this->TotalSize >> (8*i));
+    }
+  if (!this->Error && fwrite(trailer, 1, 8, this->File) != 8)
+    {
+    this->Error = true;
+    }
+
+  return !this->Error;
+}
+
+void vtkNIFTIWriterGzipStream::CompressBlocks(int threadId, int numThreads)
+{
+  z_stream *strm = &this->Streams[threadId];
+  size_t size = this->InputSize;
+  size_t blockSize = this->BlockSize;
+  int numBlocks = static_cast<int>((size + blockSize - 1)/blockSize);
+  if (this->Last && numBlocks == 0 && !this->BGZF)
+    {
+    // the final block must be written even if it is empty
+    numBlocks = 1;
+    }
+
+  for (int i = threadId; i < numBlocks; i += numThreads)
+    {
+    size_t start = i*blockSize;
+    size_t n = size - start;
+    n = (n < blockSize ? n : blockSize);
+    Bytef *ip = &this->Input[0] + start;
+    bool last = (this->BGZF || (this->Last && i == numBlocks - 1));
+
+    deflateReset(strm);
+    if (!this->BGZF)
+      {
+      // use the previous data as the dictionary, but not for BGZF,
+      // since each BGZF member must be independent of the others
+      if (i > 0)
+        {
+        deflateSetDictionary(strm, ip - DictSize, DictSize);
+        }
+      else if (this->Dictionary.size() > 0)
+        {
+        deflateSetDictionary(
+          strm, &this->Dictionary[0],
+          static_cast<uInt>(this->Dictionary.size()));
+        }
+      }
+
+    // end the block on a byte boundary, unless it is the final block,
+    // and leave room for the member header and trailer for BGZF
+    size_t headSize = (this->BGZF ? 18 : 0);
+    std::vector<Bytef>& output = this->Output[i];
+    output.resize(deflateBound(strm, static_cast<uLong>(n)) + 16 + 26);
+    strm->next_in = ip;
+    strm->avail_in = static_cast<uInt>(n);
+    strm->next_out = &output[headSize];
+    strm->avail_out = static_cast<uInt>(output.size() - headSize);
+    int code = deflate(strm, (last ? Z_FINISH : Z_SYNC_FLUSH));
+    this->BlockOK[i] = (code != Z_STREAM_ERROR && strm->avail_in == 0 &&
+                        strm->avail_out != 0);
+    output.resize(output.size() - strm->avail_out);
+
+    uLong crc = crc32(crc32(0, Z_NULL, 0), ip, static_cast<uInt>(n));
+    this->BlockCRC[i] = crc;
+
+    if (this->BGZF)
+      {
+      // the header has a "BC" extra field with the member size minus one
+      size_t bsize = output.size() + 8 - 1;
+      static const unsigned char header[16] = {
+        0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0 };
+      memcpy(&output[0], header, 16);
+      output[16] = static_cast<Bytef>(bsize);
+      output[17] = static_cast<Bytef>(bsize >> 8);
+      for (int j = 0; j < 4; j++)
+        {
+        output.push_back(static_cast<Bytef>(crc >> (8*j)));
+        }
+      for (int j = 0; j < 4; j++)
+        {
+        output.push_back(static_cast<Bytef>(n >> (8*j)));
+        }
+      this->BlockOK[i] = (this->BlockOK[i] && bsize <= 0xffff);
+      }
+    }
+}
+
+bool vtkNIFTIWriterGzipStream::WriteBlocks(bool last)
+{
+  this->Last = last;
+  size_t size = this->InputSize;
+  size_t blockSize = this->BlockSize;
+  int numBlocks = static_cast<int>((size + blockSize - 1)/blockSize);
+  if (last && numBlocks == 0 && !this->BGZF)
+    {
+    numBlocks = 1;
+    }
+
+  int numThreads = this->NumberOfThreads;
+  numThreads = (numThreads < numBlocks ? numThreads : numBlocks);
+  if (numThreads <= 1)
+    {
+    this->CompressBlocks(0, 1);
+    }
+  else
+    {
+    vtkSmartPointer<vtkMultiThreader> threader =
+      vtkSmartPointer<vtkMultiThreader>::New();
+    threader->SetNumberOfThreads(numThreads);
+    threader->SetSingleMethod(vtkNIFTIWriterCompressBlocks, this);
+    threader->SingleMethodExecute();
+    }
+
+  // write the compressed blocks in order
+  for (int i = 0; i < numBlocks && !this->Error; i++)
+    {
+    size_t start = i*blockSize;
+    size_t n = size - start;
+    n = (n < blockSize ? n : blockSize);
+    std::vector<Bytef>& output = this->Output[i];
+    if (!this->BlockOK[i] ||
+        fwrite(&output[0], 1, output.size(), this->File) != output.size())
+      {
+      this->Error = true;
+      }
+    this->CRC = crc32_combine(
+      this->CRC, this->BlockCRC[i], static_cast<z_off_t>(n));
+    this->TotalSize += static_cast<uLong>(n);
+    }
+
+  // keep the end of the data, for the dictionary of the next block
+  if (size >= DictSize)
+    {
+    this->Dictionary.assign(
+      this->Input.begin() + (size - DictSize), this->Input.begin() + size);
+    }
+  this->InputSize = 0;
+
+  return !this->Error;
+}
+
+} // end anonymous namespace
+
+//----------------------------------------------------------------------------
+// the state of a write, which is kept between pieces when streaming
+struct vtkNIFTIWriter::StreamInfo
+{
+  FILE *File;
+  vtkNIFTIWriterGzipStream *GzipFile;
+  char *HeaderName;
+  char *ImageName;
+  bool SingleFile;
+  vtkTypeInt64 DataOffset; // the offset to the image data in the file
+  vtkTypeInt64 FileOffset; // the current offset in the uncompressed file
+  std::vector<int> Pieces; // the first slice of each piece, plus the end
+  int NumberOfPasses; // passes through the slices
+  int CurrentPiece;
+  vtkIdType Count; // the number of rows that have been written
+  vtkIdType Target; // the number of rows per progress report
+};
+
+//----------------------------------------------------------------------------
+bool vtkNIFTIWriter::StartWrite(vtkInformation *info)
+{
   const char *filename = this->GetFileName();
   if (filename == NULL)
     {
     vtkErrorMacro("A FileName must be provided");
     this->SetErrorCode(vtkErrorCode::NoFileNameError);
-    return 0;
+    return false;
     }
 
   int extent[6];
@@ -632,7 +1071,7 @@ int vtkNIFTIWriter::RequestData(
   // generate the header information
   if (this->GenerateHeader(info, singleFile) == 0)
     {
-    return 0;
+    return false;
     }
 
   // if file is not .nii, then get .hdr and .img filenames
@@ -665,31 +1104,43 @@ int vtkNIFTIWriter::RequestData(
         extent[5] - extent[4] + 1 > VTK_SHORT_MAX)
       {
       vtkErrorMacro("Image too large to store in NIFTI-1 format");
-      return 0;
+      delete [] hdrname;
+      delete [] imgname;
+      return false;
       }
     }
 
   // try opening file
-  gzFile file = 0;
-  FILE *ufile = 0;
-  if (isCompressed)
+  vtkNIFTIWriterGzipStream *file = 0;
+  FILE *ufile = fopen(hdrname, "wb");
+  if (ufile && isCompressed)
     {
-    file = gzopen(hdrname, "wb");
-    }
-  else
-    {
-    ufile = fopen(hdrname, "wb");
+    file = new vtkNIFTIWriterGzipStream(
+      ufile, this->CompressionLevel, this->NumberOfThreads,
+      (this->UseBGZF != 0));
     }
 
-  if (!file && !ufile)
+  if (!ufile)
     {
     vtkErrorMacro("Cannot open file " << hdrname);
     delete [] hdrname;
     delete [] imgname;
     this->SetErrorCode(vtkErrorCode::CannotOpenFileError);
-    return 0;
+    return false;
     }
 
+  StreamInfo *stream = new StreamInfo;
+  this->Stream = stream;
+  stream->File = ufile;
+  stream->GzipFile = file;
+  stream->HeaderName = hdrname;
+  stream->ImageName = imgname;
+  stream->SingleFile = singleFile;
+  stream->DataOffset = 0;
+  stream->FileOffset = 0;
+  stream->CurrentPiece = 0;
+  stream->Count = 0;
+
   this->InvokeEvent(vtkCommand::StartEvent);
   this->UpdateProgress(0.0);
 
@@ -697,9 +1148,7 @@ int vtkNIFTIWriter::RequestData(
   size_t bytesWritten = 0;
   if (isCompressed)
     {
-    unsigned int hsize = static_cast<unsigned int>(hdrsize);
-    int code = gzwrite(file, hdrptr, hsize);
-    bytesWritten = (code < 0 ? 0 : code);
+    bytesWritten = file->Write(hdrptr, hdrsize);
     }
   else
     {
@@ -710,52 +1159,198 @@ int vtkNIFTIWriter::RequestData(
     this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
     }
 
-  if (singleFile && !this->ErrorCode)
+  // the header is followed by four "extender" bytes, the first of
+  // which is set if the extensions follow
+  const std::vector<HeaderExtensions::Extension>& extList =
+    this->Extensions->List;
+  std::vector<char> extensions(4, '\0');
+  extensions[0] = (extList.empty() ? 0 : 1);
+  for (size_t i = 0; i < extList.size(); i++)
     {
-    // write the padding between the header and the image to the .nii file
-    size_t padsize = (static_cast<size_t>(this->OwnHeader->GetVoxOffset()) -
-                      hdrsize);
-    char *padding = new char[padsize];
-    memset(padding, '\0', padsize);
+    int esize[2];
+    esize[0] = static_cast<int>(HeaderExtensions::FileSize(extList[i]));
+    esize[1] = extList[i].Code;
+    const char *cp = reinterpret_cast<const char *>(esize);
+    size_t pos = extensions.size();
+    extensions.insert(extensions.end(), cp, cp + 8);
+    extensions.insert(
+      extensions.end(), extList[i].Data.begin(), extList[i].Data.end());
+    extensions.resize(pos + esize[0], '\0');
+    }
+
+  if (singleFile)
+    {
+    // pad the .nii file to the start of the image
+    extensions.resize(
+      static_cast<size_t>(this->OwnHeader->GetVoxOffset()) - hdrsize, '\0');
+    stream->DataOffset = hdrsize + extensions.size();
+    stream->FileOffset = stream->DataOffset;
+    }
+  else if (extList.empty())
+    {
+    // a .hdr file without extensions ends after the header
+    extensions.clear();
+    }
+
+  if (!extensions.empty() && !this->ErrorCode)
+    {
+    // write the extensions and padding
     if (isCompressed)
       {
-      int code = gzwrite(file, padding, static_cast<unsigned int>(padsize));
-      bytesWritten = (code < 0 ? 0 : code);
+      bytesWritten = file->Write(&extensions[0], extensions.size());
       }
     else
       {
-      bytesWritten = fwrite(padding, 1, padsize, ufile);
+      bytesWritten = fwrite(&extensions[0], 1, extensions.size(), ufile);
       }
-    delete [] padding;
-    if (bytesWritten < padsize)
+    if (bytesWritten < extensions.size())
       {
       this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
       }
     }
-  else if (!this->ErrorCode)
+
+  if (!singleFile && !this->ErrorCode)
     {
     // close the .hdr file and open the .img file
     if (isCompressed)
       {
-      gzclose(file);
-      file = gzopen(imgname, "wb");
+      if (!file->Close())
+        {
+        this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
+        }
+      delete file;
+      file = 0;
       }
-    else
+    fclose(ufile);
+    ufile = fopen(imgname, "wb");
+    if (ufile && isCompressed)
       {
-      fclose(ufile);
-      ufile = fopen(imgname, "wb");
+      file = new vtkNIFTIWriterGzipStream(
+        ufile, this->CompressionLevel, this->NumberOfThreads,
+        (this->UseBGZF != 0));
       }
+    stream->File = ufile;
+    stream->GzipFile = file;
     }
 
-  if (!file && !ufile)
+  if (!ufile)
     {
     vtkErrorMacro("Cannot open file " << imgname);
     this->SetErrorCode(vtkErrorCode::CannotOpenFileError);
     }
 
-  // write the image
-  unsigned char *dataPtr =
-    static_cast<unsigned char *>(data->GetScalarPointer());
+  vtkInformation *scalarInfo = vtkDataObject::GetActiveFieldInformation(
+    info, vtkDataObject::FIELD_ASSOCIATION_POINTS,
+    vtkDataSetAttributes::SCALARS);
+  int scalarSize = vtkDataArray::GetDataTypeSize(
+    scalarInfo->Get(vtkDataObject::FIELD_ARRAY_TYPE()));
+  int numComponents = scalarInfo->Get(
+    vtkDataObject::FIELD_NUMBER_OF_COMPONENTS());
+  int outSizeX = static_cast<int>(this->OwnHeader->GetDim(1));
+  int outSizeY = static_cast<int>(this->OwnHeader->GetDim(2));
+  int outSizeZ = static_cast<int>(this->OwnHeader->GetDim(3));
+  int timeDim = static_cast<int>(this->OwnHeader->GetDim(4));
+  int vectorDim = static_cast<int>(this->OwnHeader->GetDim(5));
+
+  // for counting, include timeDim in vectorDim
+  vectorDim *= timeDim;
+
+  // report progress every 2% of the way to completion
+  stream->Target =
+    static_cast<vtkIdType>(0.02*outSizeY*outSizeZ*vectorDim) + 1;
+
+  // divide the slices into pieces: when streaming, each piece is a slab
+  // of slices that uses at most 64MB (but has at least one slice)
+  int piece = outSizeZ;
+  if (this->Streaming)
+    {
+    vtkIdType sliceSize = scalarSize*numComponents;
+    sliceSize *= outSizeX;
+    sliceSize *= outSizeY;
+    vtkIdType maxSlices = 67108864/(sliceSize > 0 ? sliceSize : 1);
+    piece = static_cast<int>(maxSlices < outSizeZ ? maxSlices : outSizeZ);
+    piece = (piece > 1 ? piece : 1);
+    }
+  int sliceIdx = 0;
+  do
+    {
+    stream->Pieces.push_back(sliceIdx);
+    sliceIdx += piece;
+    }
+  while (sliceIdx < outSizeZ);
+  stream->Pieces.push_back(outSizeZ);
+
+  // a compressed file cannot seek, so if the vector components are
+  // in separate pieces, then the pieces are requested once per component
+  stream->NumberOfPasses = 1;
+  if (isCompressed && vectorDim > 1 && stream->Pieces.size() > 2)
+    {
+    stream->NumberOfPasses = vectorDim;
+    }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkNIFTIWriter::ComputePieceExtent(int extent[6])
+{
+  // the slices of the piece, in the order that they are stored in the file
+  StreamInfo *stream = this->Stream;
+  int numPieces = static_cast<int>(stream->Pieces.size()) - 1;
+  int pieceIdx = stream->CurrentPiece % numPieces;
+  int firstSlice = stream->Pieces[pieceIdx];
+  int lastSlice = stream->Pieces[pieceIdx + 1] - 1;
+
+  if (this->QFac < 0)
+    {
+    // the slices are stored in reverse order
+    int outSizeZ = stream->Pieces[numPieces];
+    extent[5] = extent[4] + outSizeZ - 1 - firstSlice;
+    extent[4] = extent[4] + outSizeZ - 1 - lastSlice;
+    }
+  else
+    {
+    extent[5] = extent[4] + lastSlice;
+    extent[4] = extent[4] + firstSlice;
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkNIFTIWriter::WritePiece(vtkInformation *info)
+{
+  StreamInfo *stream = this->Stream;
+  vtkImageData *data =
+    vtkImageData::SafeDownCast(info->Get(vtkDataObject::DATA_OBJECT()));
+
+  int extent[6];
+  info->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
+
+  // make sure that the data holds all of the slices that were requested,
+  // in case the upstream algorithm did not respect the update extent
+  int dataExtent[6];
+  data->GetExtent(dataExtent);
+  int pieceExtent[6];
+  for (int i = 0; i < 6; i++)
+    {
+    pieceExtent[i] = extent[i];
+    }
+  this->ComputePieceExtent(pieceExtent);
+  if (dataExtent[0] != pieceExtent[0] || dataExtent[1] != pieceExtent[1] ||
+      dataExtent[2] != pieceExtent[2] || dataExtent[3] != pieceExtent[3] ||
+      dataExtent[4] > pieceExtent[4] || dataExtent[5] < pieceExtent[5])
+    {
+    vtkErrorMacro("WritePiece: The input extent [" << dataExtent[0] << ","
+                  << dataExtent[1] << "," << dataExtent[2] << ","
+                  << dataExtent[3] << "," << dataExtent[4] << ","
+                  << dataExtent[5] << "] does not contain the requested "
+                  "extent [" << pieceExtent[0] << "," << pieceExtent[1]
+                  << "," << pieceExtent[2] << "," << pieceExtent[3] << ","
+                  << pieceExtent[4] << "," << pieceExtent[5] << "]");
+    // the error code makes IsWriteComplete() stop the write
+    this->SetErrorCode(vtkErrorCode::UnknownError);
+    stream->CurrentPiece++;
+    return;
+    }
 
   int swapBytes = 0;
   int scalarSize = data->GetScalarSize();
@@ -770,6 +1365,21 @@ int vtkNIFTIWriter::RequestData(
   vectorDim *= timeDim;
 
   z_off_t fileVoxelIncr = scalarSize*numComponents/vectorDim;
+  vtkTypeInt64 fileSliceIncr = fileVoxelIncr*outSizeX;
+  fileSliceIncr *= outSizeY;
+
+  // the slices and vector components that are in this piece
+  int numPieces = static_cast<int>(stream->Pieces.size()) - 1;
+  int pieceIdx = stream->CurrentPiece % numPieces;
+  int firstSlice = stream->Pieces[pieceIdx];
+  int lastSlice = stream->Pieces[pieceIdx + 1];
+  int firstComponent = 0;
+  int lastComponent = vectorDim;
+  if (stream->NumberOfPasses > 1)
+    {
+    firstComponent = stream->CurrentPiece/numPieces;
+    lastComponent = firstComponent + 1;
+    }
 
   // add a buffer for planar-vector to packed-vector conversion
   unsigned char *rowBuffer = 0;
@@ -778,106 +1388,109 @@ int vtkNIFTIWriter::RequestData(
     rowBuffer = new unsigned char[outSizeX*fileVoxelIncr];
     }
 
-  // special increment to reverse the slices if needed
-  vtkIdType sliceOffset = 0;
-
-  if (this->QFac < 0)
-    {
-    // put slices in reverse order
-    sliceOffset = scalarSize*numComponents;
-    sliceOffset *= outSizeX;
-    sliceOffset *= outSizeY;
-    dataPtr += sliceOffset*(outSizeZ - 1);
-    }
-
-  // report progress every 2% of the way to completion
-  vtkIdType target =
-    static_cast<vtkIdType>(0.02*outSizeY*outSizeZ*vectorDim) + 1;
-  vtkIdType count = 0;
-
   // write the data one row at a time, do planar-to-packed conversion
   // of vector components if NIFTI file has a vector dimension
   int rowSize = numComponents/vectorDim*outSizeX;
-  int c = 0; // counter for vector components
-  int j = 0; // counter for rows
-  int k = 0; // counter for slices
-  int t = 0; // counter for time
-
-  unsigned char *ptr = dataPtr;
+  vtkIdType rowIncr = outSizeX*numComponents*scalarSize;
+  size_t bytesWritten = 0;
 
-  while (!this->AbortExecute && !this->ErrorCode)
+  for (int c = firstComponent; c < lastComponent; c++)
     {
-    if (vectorDim == 1 && swapBytes == 0)
+    // the offset to this vector component within each voxel
+    vtkIdType componentOffset = c*fileVoxelIncr;
+    if (timeDim > 1)
       {
-      // write directly from input, instead of using a buffer
-      rowBuffer = ptr;
-      ptr += outSizeX*numComponents*scalarSize;
+      // if timeDim is included in the vectorDim (and hence in the
+      // VTK scalar components) then we have to make sure that
+      // the vector components are packed before the time steps
+      int t = c % timeDim;
+      componentOffset = (c + t*(vectorDim - 1))/timeDim*fileVoxelIncr;
       }
-    else
+
+    // seek to the slab, which only occurs for uncompressed files
+    vtkTypeInt64 offset = stream->DataOffset;
+    offset += (static_cast<vtkTypeInt64>(c)*outSizeZ + firstSlice)*
+      fileSliceIncr;
+    if (offset != stream->FileOffset && !this->ErrorCode)
       {
-      // create a vector plane from packed vector components
-      unsigned char *tmpPtr = rowBuffer;
-      z_off_t skipOther = scalarSize*numComponents - fileVoxelIncr;
-      for (int i = 0; i < outSizeX; i++)
+      if (!vtkNIFTIPrivateSeek(stream->File, offset))
         {
-        // write one vector component of one voxel
-        z_off_t nn = fileVoxelIncr;
-        do { *tmpPtr++ = *ptr++; } while (--nn);
-        // skip past the other components
-        ptr += skipOther;
+        this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
         }
+      stream->FileOffset = offset;
       }
 
-    if (swapBytes != 0 && scalarSize > 1)
+    for (int k = firstSlice; k < lastSlice; k++)
       {
-      vtkByteSwap::SwapVoidRange(rowBuffer, rowSize, scalarSize);
-      }
+      // the slice order is reversed if QFac is negative
+      int sliceIdx = (this->QFac < 0 ? outSizeZ - 1 - k : k);
+      unsigned char *ptr = static_cast<unsigned char *>(
+        data->GetScalarPointer(extent[0], extent[2], extent[4] + sliceIdx));
+      ptr += componentOffset;
 
-    if (isCompressed)
-      {
-      int code = gzwrite(file, rowBuffer, rowSize*scalarSize);
-      bytesWritten = (code < 0 ? 0 : code);
-      }
-    else
-      {
-      bytesWritten = fwrite(rowBuffer, scalarSize, rowSize, ufile)*scalarSize;
-      }
-    if (bytesWritten < static_cast<size_t>(rowSize*scalarSize))
-      {
-      this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
-      break;
-      }
+      for (int j = 0; j < outSizeY; j++)
+        {
+        if (this->AbortExecute || this->ErrorCode)
+          {
+          break;
+          }
 
-    if (++count % target == 0)
-      {
-      this->UpdateProgress(0.02*count/target);
-      }
+        if (vectorDim == 1 && swapBytes == 0)
+          {
+          // write directly from input, instead of using a buffer
+          rowBuffer = ptr;
+          }
+        else
+          {
+          // create a vector plane from packed vector components
+          int m = numComponents/vectorDim;
+          switch (scalarSize)
+            {
+            case 1:
+              vtkNIFTIWriterPack<vtkTypeUInt8>(
+                ptr, rowBuffer, outSizeX, m, numComponents);
+              break;
+            case 2:
+              vtkNIFTIWriterPack<vtkTypeUInt16>(
+                ptr, rowBuffer, outSizeX, m, numComponents);
+              break;
+            case 4:
+              vtkNIFTIWriterPack<vtkTypeUInt32>(
+                ptr, rowBuffer, outSizeX, m, numComponents);
+              break;
+            case 8:
+              vtkNIFTIWriterPack<vtkTypeUInt64>(
+                ptr, rowBuffer, outSizeX, m, numComponents);
+              break;
+            }
+          }
+        ptr += rowIncr;
 
-    if (++j == outSizeY)
-      {
-      j = 0;
-      ptr -= 2*sliceOffset; // for reverse slice order
-      if (++k == outSizeZ)
-        {
-        k = 0;
-        if (++t == timeDim)
+        if (swapBytes != 0 && scalarSize > 1)
           {
-          t = 0;
+          vtkByteSwap::SwapVoidRange(rowBuffer, rowSize, scalarSize);
           }
-        if (++c == vectorDim)
+
+        if (stream->GzipFile)
           {
+          bytesWritten = stream->GzipFile->Write(
+            rowBuffer, rowSize*scalarSize);
+          }
+        else
+          {
+          bytesWritten = fwrite(
+            rowBuffer, scalarSize, rowSize, stream->File)*scalarSize;
+          }
+        if (bytesWritten < static_cast<size_t>(rowSize*scalarSize))
+          {
+          this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
           break;
           }
-        // back up the ptr to the beginning of the image,
-        // then increment to the next vector component
-        ptr = dataPtr + c*fileVoxelIncr;
+        stream->FileOffset += bytesWritten;
 
-        if (timeDim > 1)
+        if (++stream->Count % stream->Target == 0)
           {
-          // if timeDim is included in the vectorDim (and hence in the
-          // VTK scalar components) then we have to make sure that
-          // the vector components are packed before the time steps
-          ptr = dataPtr + (c + t*(vectorDim - 1))/timeDim*fileVoxelIncr;
+          this->UpdateProgress(0.02*stream->Count/stream->Target);
           }
         }
       }
@@ -888,31 +1501,144 @@ int vtkNIFTIWriter::RequestData(
     delete [] rowBuffer;
     }
 
-  if (isCompressed)
+  stream->CurrentPiece++;
+}
+
+//----------------------------------------------------------------------------
+bool vtkNIFTIWriter::IsWriteComplete()
+{
+  StreamInfo *stream = this->Stream;
+  int numPieces = static_cast<int>(stream->Pieces.size()) - 1;
+  return (stream->CurrentPiece >= numPieces*stream->NumberOfPasses ||
+          this->AbortExecute || this->ErrorCode);
+}
+
+//----------------------------------------------------------------------------
+void vtkNIFTIWriter::FinishWrite()
+{
+  StreamInfo *stream = this->Stream;
+
+  if (stream->GzipFile)
     {
-    gzclose(file);
+    if (!stream->GzipFile->Close() && !this->ErrorCode)
+      {
+      this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
+      }
+    delete stream->GzipFile;
     }
-  else
+  if (stream->File && fclose(stream->File) != 0 && !this->ErrorCode)
     {
-    fclose(ufile);
+    this->SetErrorCode(vtkErrorCode::OutOfDiskSpaceError);
     }
 
   if (this->ErrorCode == vtkErrorCode::OutOfDiskSpaceError)
     {
     // erase the file, rather than leave a corrupt file on disk
-    vtkErrorMacro("Out of disk space, removing incomplete file " << imgname);
-    vtksys::SystemTools::RemoveFile(imgname);
-    if (!singleFile)
+    vtkErrorMacro("Out of disk space, removing incomplete file "
+                  << stream->ImageName);
+    vtksys::SystemTools::RemoveFile(stream->ImageName);
+    if (!stream->SingleFile)
       {
-      vtksys::SystemTools::RemoveFile(hdrname);
+      vtksys::SystemTools::RemoveFile(stream->HeaderName);
       }
     }
 
+  delete [] stream->HeaderName;
+  delete [] stream->ImageName;
+  delete stream;
+  this->Stream = 0;
+
   this->UpdateProgress(1.0);
   this->InvokeEvent(vtkCommand::EndEvent);
+}
 
-  delete [] hdrname;
-  delete [] imgname;
+//----------------------------------------------------------------------------
+void vtkNIFTIWriter::Write()
+{
+  this->Superclass::Write();
+
+  // if the pipeline failed before the last piece arrived, end the write
+  if (this->Stream)
+    {
+    this->FinishWrite();
+    }
+}
+
+//----------------------------------------------------------------------------
+int vtkNIFTIWriter::RequestUpdateExtent(
+  vtkInformation* vtkNotUsed(request),
+  vtkInformationVector** inputVector,
+  vtkInformationVector* vtkNotUsed(outputVector))
+{
+  if (!this->Streaming)
+    {
+    // the whole extent was requested by Write()
+    return 1;
+    }
+
+  vtkInformation *info = inputVector[0]->GetInformationObject(0);
+
+  if (this->Stream == 0)
+    {
+    // the header is written before the first piece is requested
+    this->SetErrorCode(vtkErrorCode::NoError);
+    if (!this->StartWrite(info))
+      {
+      return 0;
+      }
+    }
+
+  // request the slices for the current piece
+  int extent[6];
+  info->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
+  this->ComputePieceExtent(extent);
+  info->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), extent, 6);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkNIFTIWriter::RequestData(
+  vtkInformation* request,
+  vtkInformationVector** inputVector,
+  vtkInformationVector* vtkNotUsed(outputVector))
+{
+  vtkInformation *info = inputVector[0]->GetInformationObject(0);
+  vtkImageData *data =
+    vtkImageData::SafeDownCast(info->Get(vtkDataObject::DATA_OBJECT()));
+
+  if (data == NULL)
+    {
+    vtkErrorMacro("No input provided!");
+    if (this->Stream)
+      {
+      this->FinishWrite();
+      }
+    return 0;
+    }
+
+  if (this->Stream == 0)
+    {
+    // not streaming, so the whole image is present
+    this->SetErrorCode(vtkErrorCode::NoError);
+    if (!this->StartWrite(info))
+      {
+      return 0;
+      }
+    }
+
+  this->WritePiece(info);
+
+  // ask the executive to call us again for the next piece
+  if (this->IsWriteComplete())
+    {
+    request->Remove(vtkStreamingDemandDrivenPipeline::CONTINUE_EXECUTING());
+    this->FinishWrite();
+    }
+  else
+    {
+    request->Set(vtkStreamingDemandDrivenPipeline::CONTINUE_EXECUTING(), 1);
+    }
 
   return 1;
 }
@@ -118,6 +118,58 @@ public:
   void SetNIFTIHeader(vtkNIFTIHeader *hdr);
   vtkNIFTIHeader *GetNIFTIHeader();
 
+  // Description:
+  // Add a NIfTI header extension to be written after the header.
+  // The code says what kind of data the extension holds, for example
+  // 2 for DICOM, 4 for AFNI, 6 for a comment, or 32 for JSON.  The data
+  // is copied, and is padded with zeros to a multiple of 16 bytes in the
+  // file.  The extensions are kept until RemoveAllHeaderExtensions().
+  void AddHeaderExtension(int code, const void *data, vtkIdType size);
+  void RemoveAllHeaderExtensions();
+  int GetNumberOfHeaderExtensions();
+
+  // Description:
+  // Set the zlib compression level for .nii.gz and .img.gz files.
+  // The level goes from 1 (fastest) to 9 (smallest), and the default
+  // of -1 uses the zlib default.
+  vtkSetClampMacro(CompressionLevel, int, -1, 9);
+  vtkGetMacro(CompressionLevel, int);
+
+  // Description:
+  // Set the number of threads to use for compression.
+  // The data is compressed in blocks, and the blocks are divided
+  // between the threads.  The result is a standard gzip file
+  // regardless of the number of threads.  The default is 1.
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  // Description:
+  // Write compressed files in the BGZF format (default: On).
+  // A BGZF file is a series of small gzip members, each of which
+  // records its own size, so vtkNIFTIReader can find the members and
+  // decompress them with several threads.  Any gzip program can read
+  // these files.  If this is off, a single gzip member is written,
+  // which is about one percent smaller.
+  vtkSetMacro(UseBGZF, int);
+  vtkBooleanMacro(UseBGZF, int);
+  vtkGetMacro(UseBGZF, int);
+
+  // Description:
+  // Request the image from the pipeline in pieces (default: Off).
+  // If this is on, the header is written first, and then the writer
+  // requests slabs of slices (of at most 64MB each) and appends them to
+  // the file in order, so the input does not have to fit in memory.
+  // Since a .nii.gz file cannot seek, if the image has more than one
+  // vector component (or time point) then the slabs are requested from
+  // the pipeline once for each component when writing a .nii.gz file.
+  vtkSetMacro(Streaming, int);
+  vtkBooleanMacro(Streaming, int);
+  vtkGetMacro(Streaming, int);
+
+  // Description:
+  // Write the file.
+  virtual void Write();
+
 protected:
   vtkNIFTIWriter();
   ~vtkNIFTIWriter();
@@ -126,6 +178,12 @@ protected:
   // Generate the header information for the file.
   int GenerateHeader(vtkInformation *info, bool singleFile);
 
+  // Description:
+  // Request the slices for the next piece, if streaming.
+  virtual int RequestUpdateExtent(vtkInformation *request,
+                                  vtkInformationVector** inputVector,
+                                  vtkInformationVector* outputVector);
+
   // Description:
   // The main execution method, which writes the file.
   virtual int RequestData(vtkInformation *request,
@@ -169,9 +227,50 @@ protected:
   vtkNIFTIHeader *OwnHeader;
   int NIFTIVersion;
 
+  // Description:
+  // The compression level and the number of compression threads.
+  int CompressionLevel;
+  int NumberOfThreads;
+  int UseBGZF;
+
+  // Description:
+  // Whether to request the image in pieces.
+  int Streaming;
+
 private:
   vtkNIFTIWriter(const vtkNIFTIWriter&);  // Not implemented.
   void operator=(const vtkNIFTIWriter&);  // Not implemented.
+
+  struct StreamInfo;
+  struct HeaderExtensions;
+
+  // Description:
+  // Generate the header, open the file, and write the header.
+  bool StartWrite(vtkInformation *info);
+
+  // Description:
+  // Compute the update extent for the current piece.
+  void ComputePieceExtent(int extent[6]);
+
+  // Description:
+  // Write the slices for the current piece.
+  void WritePiece(vtkInformation *info);
+
+  // Description:
+  // Check whether there are no more pieces to write.
+  bool IsWriteComplete();
+
+  // Description:
+  // Close the file and report any errors.
+  void FinishWrite();
+
+  // Description:
+  // The state of the write, kept between pieces.
+  StreamInfo *Stream;
+
+  // Description:
+  // The extensions to write after the header.
+  HeaderExtensions *Extensions;
 };
 
 #endif // __vtkNIFTIWriter_h